@@ -0,0 +1,754 @@
+#include "archive.h"
+#include "lz.h"
+#include "metrics.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SEGMENT_MAGIC 0x57534547u /* "WSEG" */
+#define SEGMENT_VERSION 1
+
+#define SEGMENT_ENTRIES 4096
+
+/* Uncompressed size of the text blocks: they end on entry boundaries, so that a text lies in a single block */
+#define TEXT_BLOCK (64 * 1024)
+
+/* entry.text.size is 8 bits */
+#define TEXT_SIZE 256
+
+/* entry.src is 10 bits */
+#define SOURCES (1u << 10)
+
+#define SOURCE_SIZE 64
+
+#define SPARSE_STEP 64
+
+#define CACHED_BLOCKS 8
+
+#define SEGMENT_NAME "seg-%020zu.wseg"
+
+/* Segment file: this header, then the columns and the compressed text blocks, each at an offset multiple of 8.
+ * Integers are in host byte order.
+ */
+struct segment_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t first;        /* index of the first entry */
+	uint64_t size;         /* of the file */
+	uint32_t count;
+	uint32_t names;
+	uint32_t blocks;
+	uint32_t groups;
+	uint64_t times;        /* uint32_t[count] */
+	uint64_t chans;        /* uint8_t[count] */
+	uint64_t srcs;         /* uint16_t[count], index of the source in the dictionary */
+	uint64_t texts;        /* uint32_t[count + 1], offsets of the texts once uncompressed */
+	uint64_t name_srcs;    /* uint16_t[names], index of the sources in the characters table when archived */
+	uint64_t name_offsets; /* uint32_t[names + 1], offsets of the names in name_chars */
+	uint64_t name_chars;
+	uint64_t block_table;  /* struct segment_block[blocks] */
+	uint64_t sparse;       /* struct segment_group[groups] */
+};
+
+struct segment_block {
+	uint64_t offset; /* in the file */
+	uint32_t size;   /* compressed */
+	uint32_t start;  /* offset of its first byte once uncompressed */
+	uint32_t raw_size;
+	uint32_t reserved;
+};
+
+/* Time range of the entries [i * SPARSE_STEP, (i + 1) * SPARSE_STEP) of the segment */
+struct segment_group {
+	uint32_t min_time;
+	uint32_t max_time;
+};
+
+struct segment {
+	size_t first;
+	size_t count;
+	const char *map;
+	size_t size;
+};
+
+/* Segment being filled, with the same columns as a segment file */
+struct pending {
+	size_t first;
+	size_t count;
+	size_t names;
+	size_t name_size;
+	uint32_t times[SEGMENT_ENTRIES];
+	uint8_t chans[SEGMENT_ENTRIES];
+	uint16_t srcs[SEGMENT_ENTRIES];
+	uint32_t texts[SEGMENT_ENTRIES + 1];
+	uint16_t name_srcs[SEGMENT_ENTRIES];
+	uint32_t name_offsets[SEGMENT_ENTRIES + 1];
+	uint16_t dict[SOURCES]; /* index + 1 in the dictionary of the current name of each source, 0 if not in it */
+	char name_chars[SEGMENT_ENTRIES * SOURCE_SIZE];
+	char text[SEGMENT_ENTRIES * TEXT_SIZE];
+};
+
+struct cached_block {
+	size_t segment_first; /* identifies the segment, SIZE_MAX for an unused slot */
+	size_t block;
+	uint64_t used;
+	size_t size;
+	char data[TEXT_BLOCK];
+};
+
+struct archive {
+	pthread_mutex_t lock;
+	char *dir;
+	size_t segments;
+	size_t alloc;
+	struct segment *segment; /* sorted by first entry, without overlaps */
+	struct pending *pending;
+	uint64_t clock;
+	struct cached_block cache[CACHED_BLOCKS];
+	uint64_t written;
+	uint64_t entries;
+	uint64_t raw_bytes;    /* texts archived */
+	uint64_t stored_bytes; /* segment files written */
+	uint64_t lost;         /* entries of segments which could not be written */
+	uint64_t reads;
+	uint64_t block_hits;
+	uint64_t block_misses;
+	struct histogram write_ns;
+};
+
+static size_t align8(size_t offset) {
+	return (offset + 7) & ~(size_t)7;
+}
+
+static const struct segment_header *header(const struct segment *s) {
+	return (const struct segment_header *)s->map;
+}
+
+static const void *column(const struct segment *s, uint64_t offset) {
+	return s->map + offset;
+}
+
+/* Returns 1 if [n] elements of [elem] bytes at [offset] lie in the file */
+static _Bool in_file(const struct segment_header *h, uint64_t offset, uint64_t n, uint64_t elem) {
+	return ((offset % 8) == 0) && (offset <= h->size) && (n <= ((h->size - offset) / elem));
+}
+
+static _Bool valid_segment(const char *map, size_t size) {
+	const struct segment_header *h = (const struct segment_header *)map;
+	if ((size < sizeof(*h)) || (h->magic != SEGMENT_MAGIC) || (h->version != SEGMENT_VERSION) || (h->size != size)) {
+		return 0;
+	}
+	if ((h->count == 0) || (h->count > SEGMENT_ENTRIES) || (h->names > h->count)
+			|| (h->groups != ((h->count + SPARSE_STEP - 1) / SPARSE_STEP)) || (h->blocks > h->count)) {
+		return 0;
+	}
+	if (!in_file(h, h->times, h->count, sizeof(uint32_t)) || !in_file(h, h->chans, h->count, sizeof(uint8_t))
+			|| !in_file(h, h->srcs, h->count, sizeof(uint16_t)) || !in_file(h, h->texts, h->count + 1, sizeof(uint32_t))
+			|| !in_file(h, h->name_srcs, h->names, sizeof(uint16_t)) || !in_file(h, h->name_offsets, h->names + 1, sizeof(uint32_t))
+			|| !in_file(h, h->block_table, h->blocks, sizeof(struct segment_block)) || !in_file(h, h->sparse, h->groups, sizeof(struct segment_group))) {
+		return 0;
+	}
+	const uint32_t *name_offsets = (const uint32_t *)(map + h->name_offsets);
+	if (!in_file(h, h->name_chars, name_offsets[h->names], 1)) {
+		return 0;
+	}
+	const struct segment_block *blocks = (const struct segment_block *)(map + h->block_table);
+	for (size_t i = 0; i < h->blocks; ++i) {
+		if ((blocks[i].offset > h->size) || (blocks[i].size > (h->size - blocks[i].offset)) || (blocks[i].raw_size > TEXT_BLOCK)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Returns 0 on success, -1 if the file is not a valid segment */
+static int map_segment(const char *path, struct segment *s) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(struct segment_header))) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	if (!valid_segment(map, st.st_size)) {
+		munmap(map, st.st_size);
+		errno = EINVAL;
+		return -1;
+	}
+	s->map = map;
+	s->size = st.st_size;
+	s->first = header(s)->first;
+	s->count = header(s)->count;
+	return 0;
+}
+
+static int add_segment(struct archive *a, const struct segment *s) {
+	if (a->segments == a->alloc) {
+		size_t alloc = (a->alloc == 0) ? 64 : 2 * a->alloc;
+		struct segment *segment = realloc(a->segment, alloc * sizeof(segment[0]));
+		if (segment == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		a->segment = segment;
+		a->alloc = alloc;
+	}
+	a->segment[a->segments] = *s;
+	++a->segments;
+	return 0;
+}
+
+static int segment_cmp(const void *x, const void *y) {
+	const struct segment *sx = x;
+	const struct segment *sy = y;
+	return (sx->first > sy->first) - (sx->first < sy->first);
+}
+
+static char *segment_path(const struct archive *a, size_t first) {
+	size_t size = strlen(a->dir) + 64;
+	char *path = malloc(size);
+	if (path != NULL) {
+		snprintf(path, size, "%s/" SEGMENT_NAME, a->dir, first);
+	}
+	return path;
+}
+
+/* Map the segments of the directory, removing the invalid ones and those from [next] on */
+static int load_segments(struct archive *a, size_t next) {
+	DIR *d = opendir(a->dir);
+	if (d == NULL) {
+		return -1;
+	}
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		size_t first;
+		char name[64];
+		if ((sscanf(de->d_name, "seg-%zu.wseg", &first) != 1)
+				|| (snprintf(name, sizeof(name), SEGMENT_NAME, first) >= (int)sizeof(name)) || (strcmp(name, de->d_name) != 0)) {
+			continue;
+		}
+		char *path = segment_path(a, first);
+		if (path == NULL) {
+			closedir(d);
+			errno = ENOMEM;
+			return -1;
+		}
+		struct segment s;
+		if (map_segment(path, &s) != 0) {
+			if (errno == EINVAL) {
+				unlink(path);
+			}
+		} else if ((s.first != first) || ((s.first + s.count) > next) || (add_segment(a, &s) != 0)) {
+			munmap((void *)s.map, s.size);
+			unlink(path);
+		}
+		free(path);
+	}
+	closedir(d);
+	if (a->segments == 0) {
+		return 0;
+	}
+	qsort(a->segment, a->segments, sizeof(a->segment[0]), segment_cmp);
+	size_t kept = 0;
+	for (size_t i = 0; i < a->segments; ++i) {
+		if ((kept > 0) && (a->segment[i].first < (a->segment[kept - 1].first + a->segment[kept - 1].count))) {
+			/* Overlapping an older segment */
+			char *path = segment_path(a, a->segment[i].first);
+			munmap((void *)a->segment[i].map, a->segment[i].size);
+			if (path != NULL) {
+				unlink(path);
+			}
+			free(path);
+			continue;
+		}
+		a->segment[kept] = a->segment[i];
+		++kept;
+	}
+	a->segments = kept;
+	return 0;
+}
+
+static void reset_pending(struct pending *p, size_t first) {
+	p->first = first;
+	p->count = 0;
+	p->names = 0;
+	p->name_size = 0;
+	p->texts[0] = 0;
+	p->name_offsets[0] = 0;
+	memset(p->dict, 0, sizeof(p->dict));
+	return;
+}
+
+struct archive *archive_open(const char *dir, size_t next) {
+	if (dir == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+	if ((mkdir(dir, 0755) != 0) && (errno != EEXIST)) {
+		return NULL;
+	}
+	struct archive *a = calloc(1, sizeof(*a));
+	if (a == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	a->dir = strdup(dir);
+	a->pending = malloc(sizeof(*a->pending));
+	if ((a->dir == NULL) || (a->pending == NULL) || (pthread_mutex_init(&a->lock, NULL) != 0)) {
+		free(a->pending);
+		free(a->dir);
+		free(a);
+		errno = ENOMEM;
+		return NULL;
+	}
+	if (load_segments(a, next) != 0) {
+		int err = errno;
+		archive_close(a);
+		errno = err;
+		return NULL;
+	}
+	if (next == ARCHIVE_CONTINUE) {
+		next = (a->segments > 0) ? a->segment[a->segments - 1].first + a->segment[a->segments - 1].count : 0;
+	}
+	reset_pending(a->pending, next);
+	for (size_t i = 0; i < CACHED_BLOCKS; ++i) {
+		a->cache[i].segment_first = SIZE_MAX;
+	}
+	histogram_reset(&a->write_ns);
+	return a;
+}
+
+static int write_file(const char *path, const char *data, size_t size) {
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		return -1;
+	}
+	while (size > 0) {
+		ssize_t w = write(fd, data, size);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			int err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		data += w;
+		size -= w;
+	}
+	return close(fd);
+}
+
+/* Build the segment file of the pending entries, returns its size, 0 on failure */
+static size_t build_segment(const struct pending *p, char **file) {
+	/* Block boundaries first, so that the block table can be placed before the blocks */
+	size_t blocks = 0;
+	size_t block_end[SEGMENT_ENTRIES];
+	size_t start = 0;
+	for (size_t i = 0; i < p->count; ++i) {
+		if ((blocks == 0) || ((p->texts[i + 1] - start) > TEXT_BLOCK)) {
+			start = p->texts[i];
+			++blocks;
+		}
+		block_end[blocks - 1] = i + 1;
+	}
+	size_t groups = (p->count + SPARSE_STEP - 1) / SPARSE_STEP;
+	struct segment_header h = {
+		.magic = SEGMENT_MAGIC,
+		.version = SEGMENT_VERSION,
+		.first = p->first,
+		.count = p->count,
+		.names = p->names,
+		.blocks = blocks,
+		.groups = groups,
+	};
+	h.times = align8(sizeof(h));
+	h.chans = align8(h.times + p->count * sizeof(p->times[0]));
+	h.srcs = align8(h.chans + p->count * sizeof(p->chans[0]));
+	h.texts = align8(h.srcs + p->count * sizeof(p->srcs[0]));
+	h.name_srcs = align8(h.texts + (p->count + 1) * sizeof(p->texts[0]));
+	h.name_offsets = align8(h.name_srcs + p->names * sizeof(p->name_srcs[0]));
+	h.name_chars = align8(h.name_offsets + (p->names + 1) * sizeof(p->name_offsets[0]));
+	h.block_table = align8(h.name_chars + p->name_size);
+	h.sparse = align8(h.block_table + blocks * sizeof(struct segment_block));
+	size_t data = align8(h.sparse + groups * sizeof(struct segment_group));
+	size_t text_size = p->texts[p->count];
+	size_t capacity = data + lz_bound(text_size) + 16 * blocks;
+	char *f = calloc(1, capacity);
+	if (f == NULL) {
+		return 0;
+	}
+	memcpy(f + h.times, p->times, p->count * sizeof(p->times[0]));
+	memcpy(f + h.chans, p->chans, p->count * sizeof(p->chans[0]));
+	memcpy(f + h.srcs, p->srcs, p->count * sizeof(p->srcs[0]));
+	memcpy(f + h.texts, p->texts, (p->count + 1) * sizeof(p->texts[0]));
+	memcpy(f + h.name_srcs, p->name_srcs, p->names * sizeof(p->name_srcs[0]));
+	memcpy(f + h.name_offsets, p->name_offsets, (p->names + 1) * sizeof(p->name_offsets[0]));
+	memcpy(f + h.name_chars, p->name_chars, p->name_size);
+	struct segment_group *sparse = (struct segment_group *)(f + h.sparse);
+	for (size_t i = 0; i < p->count; ++i) {
+		struct segment_group *g = &sparse[i / SPARSE_STEP];
+		if (((i % SPARSE_STEP) == 0) || (p->times[i] < g->min_time)) {
+			g->min_time = p->times[i];
+		}
+		if (((i % SPARSE_STEP) == 0) || (p->times[i] > g->max_time)) {
+			g->max_time = p->times[i];
+		}
+	}
+	struct segment_block *table = (struct segment_block *)(f + h.block_table);
+	size_t pos = data;
+	size_t first_entry = 0;
+	for (size_t b = 0; b < blocks; ++b) {
+		size_t start = p->texts[first_entry];
+		size_t raw = p->texts[block_end[b]] - start;
+		size_t size = lz_compress(p->text + start, raw, f + pos, capacity - pos);
+		if ((size == 0) && (raw > 0)) {
+			free(f);
+			return 0;
+		}
+		table[b] = (struct segment_block){ .offset = pos, .size = size, .start = start, .raw_size = raw };
+		pos = align8(pos + size);
+		first_entry = block_end[b];
+	}
+	h.size = pos;
+	memcpy(f, &h, sizeof(h));
+	*file = f;
+	return pos;
+}
+
+/* Write the pending entries to a segment file, called with the lock held */
+static int seal(struct archive *a) {
+	struct pending *p = a->pending;
+	if (p->count == 0) {
+		return 0;
+	}
+	uint64_t start = metrics_now();
+	char *file = NULL;
+	size_t size = build_segment(p, &file);
+	char *path = segment_path(a, p->first);
+	char *tmp = (path != NULL) ? malloc(strlen(path) + sizeof(".tmp")) : NULL;
+	int res = -1;
+	struct segment s;
+	if ((size > 0) && (tmp != NULL)) {
+		sprintf(tmp, "%s.tmp", path);
+		if ((write_file(tmp, file, size) == 0) && (rename(tmp, path) == 0)) {
+			if ((map_segment(path, &s) == 0) && (add_segment(a, &s) == 0)) {
+				res = 0;
+			} else {
+				unlink(path);
+			}
+		} else {
+			unlink(tmp);
+		}
+	}
+	if (res == 0) {
+		++a->written;
+		a->stored_bytes += size;
+		histogram_record(&a->write_ns, metrics_now() - start);
+	} else {
+		a->lost += p->count;
+	}
+	free(tmp);
+	free(path);
+	free(file);
+	reset_pending(p, p->first + p->count);
+	return res;
+}
+
+void archive_close(struct archive *a) {
+	if (a == NULL) {
+		return;
+	}
+	if (a->pending != NULL) {
+		(void)seal(a);
+	}
+	for (size_t i = 0; i < a->segments; ++i) {
+		munmap((void *)a->segment[i].map, a->segment[i].size);
+	}
+	pthread_mutex_destroy(&a->lock);
+	free(a->segment);
+	free(a->pending);
+	free(a->dir);
+	free(a);
+	return;
+}
+
+/* Index of the source in the dictionary of the pending segment, added if needed */
+static uint16_t dictionary(struct pending *p, size_t src, const char *source) {
+	size_t size = strnlen(source, SOURCE_SIZE - 1);
+	uint16_t d = p->dict[src];
+	if (d > 0) {
+		const char *name = p->name_chars + p->name_offsets[d - 1];
+		size_t nsize = p->name_offsets[d] - p->name_offsets[d - 1];
+		if ((nsize == size) && (memcmp(name, source, size) == 0)) {
+			return d - 1;
+		}
+	}
+	/* New source, or renamed since it was added */
+	d = p->names;
+	memcpy(p->name_chars + p->name_size, source, size);
+	p->name_size += size;
+	p->name_srcs[d] = src;
+	p->name_offsets[d + 1] = p->name_size;
+	++p->names;
+	p->dict[src] = d + 1;
+	return d;
+}
+
+int archive_append(struct archive *a, size_t index, const struct entry *e, const char *text, const char *source) {
+	if ((a == NULL) || (e == NULL) || ((text == NULL) && (e->text.size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	pthread_mutex_lock(&a->lock);
+	struct pending *p = a->pending;
+	if (index < (p->first + p->count)) {
+		pthread_mutex_unlock(&a->lock);
+		errno = EINVAL;
+		return -1;
+	}
+	int res = 0;
+	if (index > (p->first + p->count)) {
+		/* Entries were discarded without being archived */
+		res = seal(a);
+		p->first = index;
+	}
+	size_t i = p->count;
+	p->times[i] = e->time;
+	p->chans[i] = e->chan;
+	p->srcs[i] = dictionary(p, e->src, (source != NULL) ? source : "");
+	memcpy(p->text + p->texts[i], text, e->text.size);
+	p->texts[i + 1] = p->texts[i] + e->text.size;
+	++p->count;
+	++a->entries;
+	a->raw_bytes += e->text.size;
+	if ((p->count == SEGMENT_ENTRIES) && (seal(a) != 0)) {
+		res = -1;
+	}
+	pthread_mutex_unlock(&a->lock);
+	return res;
+}
+
+void archive_range(struct archive *a, size_t *first, size_t *next) {
+	if ((a == NULL) || (first == NULL) || (next == NULL)) {
+		return;
+	}
+	pthread_mutex_lock(&a->lock);
+	*first = (a->segments > 0) ? a->segment[0].first : a->pending->first;
+	*next = a->pending->first + a->pending->count;
+	pthread_mutex_unlock(&a->lock);
+	return;
+}
+
+/* Segment holding entry [index], NULL if none */
+static const struct segment *find_segment(const struct archive *a, size_t index) {
+	size_t lo = 0;
+	size_t hi = a->segments;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((a->segment[mid].first + a->segment[mid].count) <= index) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if ((lo < a->segments) && (a->segment[lo].first <= index)) {
+		return &a->segment[lo];
+	}
+	return NULL;
+}
+
+/* Uncompressed text block [b] of segment [s], NULL if it is corrupted */
+static const struct cached_block *text_block(struct archive *a, const struct segment *s, size_t b) {
+	struct cached_block *victim = &a->cache[0];
+	for (size_t i = 0; i < CACHED_BLOCKS; ++i) {
+		struct cached_block *c = &a->cache[i];
+		if ((c->segment_first == s->first) && (c->block == b)) {
+			++a->block_hits;
+			c->used = ++a->clock;
+			return c;
+		}
+		if (c->used < victim->used) {
+			victim = c;
+		}
+	}
+	++a->block_misses;
+	const struct segment_block *blk = (const struct segment_block *)column(s, header(s)->block_table) + b;
+	ssize_t size = lz_decompress(s->map + blk->offset, blk->size, victim->data, sizeof(victim->data));
+	if ((size < 0) || ((size_t)size != blk->raw_size)) {
+		victim->segment_first = SIZE_MAX;
+		return NULL;
+	}
+	victim->segment_first = s->first;
+	victim->block = b;
+	victim->size = size;
+	victim->used = ++a->clock;
+	return victim;
+}
+
+static void copy_name(char *source, size_t source_size, const char *name, size_t size) {
+	if (source_size == 0) {
+		return;
+	}
+	if (size >= source_size) {
+		size = source_size - 1;
+	}
+	memcpy(source, name, size);
+	source[size] = '\0';
+	return;
+}
+
+static int read_pending(const struct pending *p, size_t i, struct entry *e, char *text, char *source, size_t source_size) {
+	e->time = p->times[i];
+	e->chan = p->chans[i];
+	uint16_t d = p->srcs[i];
+	e->src = p->name_srcs[d];
+	e->text.offset = 0;
+	e->text.size = p->texts[i + 1] - p->texts[i];
+	memcpy(text, p->text + p->texts[i], e->text.size);
+	copy_name(source, source_size, p->name_chars + p->name_offsets[d], p->name_offsets[d + 1] - p->name_offsets[d]);
+	return 0;
+}
+
+static int read_segment(struct archive *a, const struct segment *s, size_t i, struct entry *e, char *text, char *source, size_t source_size) {
+	const struct segment_header *h = header(s);
+	const uint32_t *texts = column(s, h->texts);
+	const uint16_t *srcs = column(s, h->srcs);
+	const uint32_t *name_offsets = column(s, h->name_offsets);
+	uint16_t d = srcs[i];
+	if ((d >= h->names) || (name_offsets[d] > name_offsets[d + 1]) || (name_offsets[d + 1] > name_offsets[h->names])
+			|| (texts[i] > texts[i + 1]) || ((texts[i + 1] - texts[i]) >= TEXT_SIZE)) {
+		errno = EIO;
+		return -1;
+	}
+	/* Last block starting at or before the text */
+	const struct segment_block *blocks = column(s, h->block_table);
+	size_t lo = 0;
+	size_t hi = h->blocks;
+	while ((hi - lo) > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (blocks[mid].start <= texts[i]) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	size_t size = texts[i + 1] - texts[i];
+	const struct cached_block *c = (h->blocks > 0) ? text_block(a, s, lo) : NULL;
+	if ((c == NULL) || (texts[i] < blocks[lo].start) || ((texts[i] - blocks[lo].start + size) > c->size)) {
+		errno = EIO;
+		return -1;
+	}
+	e->time = ((const uint32_t *)column(s, h->times))[i];
+	e->chan = ((const uint8_t *)column(s, h->chans))[i];
+	e->src = ((const uint16_t *)column(s, h->name_srcs))[d];
+	e->text.offset = 0;
+	e->text.size = size;
+	memcpy(text, c->data + (texts[i] - blocks[lo].start), size);
+	copy_name(source, source_size, s->map + h->name_chars + name_offsets[d], name_offsets[d + 1] - name_offsets[d]);
+	return 0;
+}
+
+int archive_read(struct archive *a, size_t index, struct entry *e, char *text, char *source, size_t source_size) {
+	if ((a == NULL) || (e == NULL) || (text == NULL) || ((source == NULL) && (source_size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	pthread_mutex_lock(&a->lock);
+	++a->reads;
+	int res = -1;
+	const struct pending *p = a->pending;
+	const struct segment *s;
+	if ((index >= p->first) && (index < (p->first + p->count))) {
+		res = read_pending(p, index - p->first, e, text, source, source_size);
+	} else if ((s = find_segment(a, index)) != NULL) {
+		res = read_segment(a, s, index - s->first, e, text, source, source_size);
+	} else {
+		errno = ENOENT;
+	}
+	pthread_mutex_unlock(&a->lock);
+	return res;
+}
+
+/* First of [count] times at or after [time], returns count if none */
+static size_t scan_times(const uint32_t *times, size_t count, unsigned int time) {
+	size_t i = 0;
+	while ((i < count) && (times[i] < time)) {
+		++i;
+	}
+	return i;
+}
+
+int archive_find_time(struct archive *a, unsigned int time, size_t *index) {
+	if ((a == NULL) || (index == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	pthread_mutex_lock(&a->lock);
+	for (size_t i = 0; i < a->segments; ++i) {
+		const struct segment *s = &a->segment[i];
+		const struct segment_header *h = header(s);
+		const struct segment_group *groups = column(s, h->sparse);
+		const uint32_t *times = column(s, h->times);
+		for (size_t g = 0; g < h->groups; ++g) {
+			if (groups[g].max_time < time) {
+				continue;
+			}
+			size_t start = g * SPARSE_STEP;
+			size_t count = ((h->count - start) < SPARSE_STEP) ? h->count - start : SPARSE_STEP;
+			size_t j = scan_times(times + start, count, time);
+			if (j < count) {
+				*index = s->first + start + j;
+				pthread_mutex_unlock(&a->lock);
+				return 0;
+			}
+		}
+	}
+	const struct pending *p = a->pending;
+	size_t j = scan_times(p->times, p->count, time);
+	int res = 0;
+	if (j < p->count) {
+		*index = p->first + j;
+	} else {
+		errno = ENOENT;
+		res = -1;
+	}
+	pthread_mutex_unlock(&a->lock);
+	return res;
+}
+
+void archive_dump_metrics(struct archive *a, int fd) {
+	if (a == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&a->lock);
+	metrics_dump_counter(fd, "archive", "segments", a->segments);
+	metrics_dump_counter(fd, "archive", "segments_written", a->written);
+	metrics_dump_counter(fd, "archive", "entries", a->entries);
+	metrics_dump_counter(fd, "archive", "entries_lost", a->lost);
+	metrics_dump_counter(fd, "archive", "text_bytes", a->raw_bytes);
+	metrics_dump_counter(fd, "archive", "stored_bytes", a->stored_bytes);
+	metrics_dump_counter(fd, "archive", "reads", a->reads);
+	metrics_dump_counter(fd, "archive", "block_hits", a->block_hits);
+	metrics_dump_counter(fd, "archive", "block_misses", a->block_misses);
+	metrics_dump_histogram(fd, "archive", "write_ns", &a->write_ns);
+	pthread_mutex_unlock(&a->lock);
+	return;
+}
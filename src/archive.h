@@ -0,0 +1,58 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "entry.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Entries discarded by the log engine, kept on disk in a directory of immutable segment files.
+ *
+ * Entries are appended in index order to a pending segment in memory, which is written
+ * once full (or when the archive is closed) to a file named after its first entry index.
+ * A segment stores the entry metadata by columns (times, channels, sources), a dictionary
+ * of the source names, and the texts in independently LZ compressed blocks (see lz.h),
+ * so that reading an entry only decompresses the block holding its text.
+ * A sparse index (time range of every group of entries) speeds up searches by time.
+ * Segments are mapped in memory, recently decompressed blocks are cached.
+ *
+ * All functions may be called from different threads.
+ */
+struct archive;
+
+#define ARCHIVE_CONTINUE SIZE_MAX
+
+/* Open the archive of directory [dir] (created if needed), whose next appended entry will be [next].
+ * Segment files of entries from [next] on are removed: they were archived after the state the engine was restored from,
+ * and will be archived again. With ARCHIVE_CONTINUE, all the segments are kept, and the next appended entry
+ * is the one following the last archived entry (see archive_range).
+ * Returns NULL on failure.
+ */
+struct archive *archive_open(const char *dir, size_t next);
+
+/* Write the pending segment and release the archive */
+void archive_close(struct archive *a);
+
+/* Append entry [index] with its text and the name of its source (NULL if unknown).
+ * Entries are expected in index order, an index lower than the last appended one is rejected.
+ * Returns 0 on success, -1 on failure (the entries of a pending segment which cannot be written are lost).
+ */
+int archive_append(struct archive *a, size_t index, const struct entry *e, const char *text, const char *source);
+
+/* Archived entries are within [*first, *next), there may be holes (entries discarded while no archive was open) */
+void archive_range(struct archive *a, size_t *first, size_t *next);
+
+/* Read archived entry [index]: its text (e->text.size bytes, e->text.offset is 0) to text,
+ * which must have room for 256 bytes, and the name of its source to source (empty if unknown).
+ * Returns 0 on success, -1 on failure (ENOENT if the entry is not archived).
+ */
+int archive_read(struct archive *a, size_t index, struct entry *e, char *text, char *source, size_t source_size);
+
+/* Find the first archived entry logged at or after [time] (seconds in the day),
+ * returns 0 on success, -1 if there is none.
+ */
+int archive_find_time(struct archive *a, unsigned int time, size_t *index);
+
+/* Writes the archive metrics to fd, one "<name> <value>" line per metric */
+void archive_dump_metrics(struct archive *a, int fd);
+
+#endif /* ARCHIVE_H */
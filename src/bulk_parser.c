@@ -0,0 +1,265 @@
+#include "bulk_parser.h"
+#include "entry_parser.h"
+#include "log_engine.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BULK_CHUNK_SIZE (1u << 20)
+
+/* Chunks parsed ahead of the merge, per worker, bounding the memory used by pending batches */
+#define BULK_WINDOW 4
+
+/* Chunk [k] is parsed into slot k % window, which is reused once chunk [k] has been merged */
+struct bulk_slot {
+	_Bool done;
+	_Bool failed;
+	size_t alloc;
+	size_t names_alloc;
+	struct parsed_batch batch;
+};
+
+struct bulk_pool {
+	const char *text;
+	size_t size;
+	size_t chunks;
+	size_t next_chunk;
+	size_t merged;
+	size_t window;
+	_Bool abort;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+	pthread_cond_t free;
+	struct bulk_slot *slots;
+};
+
+struct bulk_worker {
+	struct bulk_pool *pool;
+	size_t id;
+	struct characters *chars;
+	_Bool *seen; /* sources already handed in a batch */
+	pthread_t thread;
+};
+
+/* Chunk [k] starts after the first newline found from its nominal start - 1 */
+static size_t chunk_start(const struct bulk_pool *pool, size_t k) {
+	if (k == 0) {
+		return 0;
+	}
+	size_t nominal = k * BULK_CHUNK_SIZE;
+	if (nominal >= pool->size) {
+		return pool->size;
+	}
+	const char *nl = memchr(pool->text + nominal - 1, '\n', pool->size - nominal + 1);
+	return (nl == NULL) ? pool->size : (size_t)(nl - pool->text) + 1;
+}
+
+static int push(struct bulk_slot *s, const struct entry *e, size_t line) {
+	struct parsed_batch *b = &s->batch;
+	if (b->count == s->alloc) {
+		size_t alloc = (s->alloc == 0) ? 1024 : 2 * s->alloc;
+		struct parsed_line *items = realloc(b->items, alloc * sizeof(items[0]));
+		if (items == NULL) {
+			return -1;
+		}
+		b->items = items;
+		s->alloc = alloc;
+	}
+	b->items[b->count].entry = *e;
+	b->items[b->count].line = line;
+	++b->count;
+	return 0;
+}
+
+static int push_name(struct bulk_worker *w, struct bulk_slot *s, size_t src) {
+	struct parsed_batch *b = &s->batch;
+	if (b->names_count == s->names_alloc) {
+		size_t alloc = (s->names_alloc == 0) ? 64 : 2 * s->names_alloc;
+		struct parsed_name *names = realloc(b->names, alloc * sizeof(names[0]));
+		if (names == NULL) {
+			return -1;
+		}
+		b->names = names;
+		s->names_alloc = alloc;
+	}
+	struct parsed_name *n = &b->names[b->names_count];
+	if (characters_get_name(w->chars, src, n->name, sizeof(n->name)) != 0) {
+		return -1;
+	}
+	n->src = src;
+	++b->names_count;
+	w->seen[src] = 1;
+	return 0;
+}
+
+static int parse_chunk(struct bulk_worker *w, size_t k, struct bulk_slot *s) {
+	const struct bulk_pool *pool = w->pool;
+	struct parsed_batch *b = &s->batch;
+	b->worker = w->id;
+	b->names_count = 0;
+	b->lines = 0;
+	b->dropped_parse = 0;
+	b->dropped_names = 0;
+	b->count = 0;
+	size_t psize = sizeof(LOGS_MARKER_PREFIX) - 1;
+	size_t pos = chunk_start(pool, k);
+	size_t end = chunk_start(pool, k + 1);
+	while (pos < end) {
+		const char *line = pool->text + pos;
+		const char *nl = memchr(line, '\n', end - pos);
+		size_t len = (nl == NULL) ? end - pos : (size_t)(nl - line);
+		if ((len <= psize) || (memcmp(line, LOGS_MARKER_PREFIX, psize) != 0)) {
+			struct entry e;
+			++b->lines;
+			errno = 0;
+			int r = entry_parser(w->chars, line, len, &e);
+			if (r == 0) {
+				if ((!w->seen[e.src] && (push_name(w, s, e.src) != 0)) || (push(s, &e, pos) != 0)) {
+					return -1;
+				}
+			} else if (errno == ENOSPC) {
+				++b->dropped_names;
+			} else {
+				++b->dropped_parse;
+			}
+		}
+		pos += len + 1;
+	}
+	return 0;
+}
+
+static void *work(void *arg) {
+	struct bulk_worker *w = arg;
+	struct bulk_pool *pool = w->pool;
+	while (1) {
+		size_t k = __atomic_fetch_add(&pool->next_chunk, 1, __ATOMIC_RELAXED);
+		if (k >= pool->chunks) {
+			break;
+		}
+		struct bulk_slot *s = &pool->slots[k % pool->window];
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->abort && (k >= (pool->merged + pool->window))) {
+			pthread_cond_wait(&pool->free, &pool->lock);
+		}
+		_Bool abort = pool->abort;
+		pthread_mutex_unlock(&pool->lock);
+		if (abort) {
+			break;
+		}
+		s->failed = (parse_chunk(w, k, s) != 0);
+		pthread_mutex_lock(&pool->lock);
+		s->done = 1;
+		pthread_cond_broadcast(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+/* Hand the chunks to [batch] in order, returns 0 on success, -1 on failure */
+static int merge(struct bulk_pool *pool, bulk_batch_cb batch, void *ctx) {
+	for (size_t k = 0; k < pool->chunks; ++k) {
+		struct bulk_slot *s = &pool->slots[k % pool->window];
+		pthread_mutex_lock(&pool->lock);
+		while (!s->done) {
+			pthread_cond_wait(&pool->done, &pool->lock);
+		}
+		pthread_mutex_unlock(&pool->lock);
+		if (s->failed) {
+			errno = ENOMEM;
+			return -1;
+		}
+		if (batch(ctx, &s->batch) != 0) {
+			return -1;
+		}
+		pthread_mutex_lock(&pool->lock);
+		s->done = 0;
+		++pool->merged;
+		pthread_cond_broadcast(&pool->free);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return 0;
+}
+
+int bulk_parse(const char *text, size_t size, size_t threads, size_t names, bulk_batch_cb batch, void *ctx) {
+	if (((text == NULL) && (size > 0)) || (batch == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0) ? cpus : 1;
+	}
+	struct bulk_pool pool = {
+		.text = text,
+		.size = size,
+		.chunks = (size + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE,
+		.next_chunk = 0,
+		.merged = 0,
+		.window = BULK_WINDOW * threads,
+		.abort = 0,
+	};
+	if (threads > pool.chunks) {
+		threads = (pool.chunks > 0) ? pool.chunks : 1;
+	}
+	pool.slots = calloc(pool.window, sizeof(pool.slots[0]));
+	struct bulk_worker *workers = calloc(threads, sizeof(workers[0]));
+	if ((pool.slots == NULL) || (workers == NULL)) {
+		free(workers);
+		free(pool.slots);
+		errno = ENOMEM;
+		return -1;
+	}
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pthread_cond_init(&pool.free, NULL);
+	int res = 0;
+	size_t started = 0;
+	while (started < threads) {
+		struct bulk_worker *w = &workers[started];
+		w->pool = &pool;
+		w->id = started;
+		w->chars = characters_create(names, CHARACTERS_RBT);
+		w->seen = calloc(names, sizeof(w->seen[0]));
+		if ((w->chars == NULL) || (w->seen == NULL)) {
+			characters_destroy(w->chars);
+			free(w->seen);
+			res = -1;
+			break;
+		}
+		if (pthread_create(&w->thread, NULL, work, w) != 0) {
+			characters_destroy(w->chars);
+			free(w->seen);
+			res = -1;
+			break;
+		}
+		++started;
+	}
+	if (res == 0) {
+		res = merge(&pool, batch, ctx);
+	}
+	int err = errno;
+	pthread_mutex_lock(&pool.lock);
+	pool.abort = 1;
+	pthread_cond_broadcast(&pool.free);
+	pthread_mutex_unlock(&pool.lock);
+	for (size_t i = 0; i < started; ++i) {
+		pthread_join(workers[i].thread, NULL);
+		characters_destroy(workers[i].chars);
+		free(workers[i].seen);
+	}
+	for (size_t i = 0; i < pool.window; ++i) {
+		free(pool.slots[i].batch.items);
+		free(pool.slots[i].batch.names);
+	}
+	pthread_cond_destroy(&pool.free);
+	pthread_cond_destroy(&pool.done);
+	pthread_mutex_destroy(&pool.lock);
+	free(workers);
+	free(pool.slots);
+	if (res != 0) {
+		errno = err;
+	}
+	return res;
+}
@@ -0,0 +1,48 @@
+#ifndef BULK_PARSER
+#define BULK_PARSER
+
+#include "characters.h"
+#include "entry.h"
+#include <stddef.h>
+
+/* Parallel parsing of a large text already in memory (eg. a mapped log file).
+ *
+ * The text is split in chunks at line boundaries, parsed by a pool of threads,
+ * each one indexing sources in its own characters table, so that workers never synchronize on names.
+ * Parsed chunks are handed back to the calling thread strictly in text order.
+ */
+
+struct parsed_line {
+	struct entry entry; /* entry.src is an index in the characters table of the batch */
+	size_t line;        /* offset of the line in the parsed text, entry.text.offset is relative to it */
+};
+
+/* Source first seen by a worker in a chunk: the characters table of the worker is still
+ * being modified by later chunks while this one is merged, so its names are copied
+ */
+struct parsed_name {
+	size_t src; /* index in the characters table of the worker */
+	char name[64];
+};
+
+struct parsed_batch {
+	size_t worker;            /* worker which parsed the chunk, in [0, threads) */
+	size_t names_count;
+	struct parsed_name *names; /* sources of the items not seen in the previous chunks of the worker */
+	size_t lines;             /* lines read, latency markers (LOGS_MARKER_PREFIX) excluded */
+	size_t dropped_parse;     /* lines which could not be parsed */
+	size_t dropped_names;     /* lines whose source could not be indexed */
+	size_t count;
+	struct parsed_line *items;
+};
+
+/* Called in text order for each parsed chunk, returns 0 to continue, -1 to abort */
+typedef int (*bulk_batch_cb)(void *ctx, const struct parsed_batch *batch);
+
+/* Parse [text, text + size) with [threads] workers (0 for one per online CPU),
+ * each with a characters table of [names] names.
+ * Returns 0 on success, -1 on failure or if [batch] aborted.
+ */
+int bulk_parse(const char *text, size_t size, size_t threads, size_t names, bulk_batch_cb batch, void *ctx);
+
+#endif /* BULK_PARSER */
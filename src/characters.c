@@ -1,51 +1,196 @@
 #include "characters.h"
 #include <string.h>
 #include "rbt.h"
+#include "eytzinger.h"
+#include "name_index.h"
 #include <errno.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#define NAME_SIZE 64
+
 struct character_entry {
-	char name[64];
+	char name[NAME_SIZE];
 };
 
+/* The table is a single memory block without pointers (the tree and the names are located by offsets),
+ * so that it can be mapped at different addresses (eg. in shared memory).
+ */
 struct characters {
 	size_t tot_size;
 	size_t max_names;
-	struct rbt *rbt;
-	struct character_entry *config;
+	enum characters_backend backend;
+	size_t order_offset;
+	size_t config_offset;
+	size_t index_offset;
 	char data_pool[];
 };
 
-struct characters *characters_create(size_t names) {
+static struct rbt *chars_rbt(const struct characters *chars) {
+	return (struct rbt *)((char *)chars + chars->order_offset);
+}
+
+static struct eytzinger *chars_eytzinger(const struct characters *chars) {
+	return (struct eytzinger *)((char *)chars + chars->order_offset);
+}
+
+static struct character_entry *chars_config(const struct characters *chars) {
+	return (struct character_entry *)((char *)chars + chars->config_offset);
+}
+
+static struct name_index *chars_index(const struct characters *chars) {
+	return (struct name_index *)((char *)chars + chars->index_offset);
+}
+
+/* Ordered index of the names, by backend */
+
+static _Bool order_is_bound_hash(const struct characters *chars, size_t hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_is_bound_hash(chars_eytzinger(chars), hash);
+	}
+	return rbt_is_bound_hash(chars_rbt(chars), hash);
+}
+
+static _Bool order_get_free(const struct characters *chars, size_t *hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_get_free(chars_eytzinger(chars), hash);
+	}
+	return rbt_get_free(chars_rbt(chars), hash);
+}
+
+static _Bool order_get_least(const struct characters *chars, size_t *hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_get_least(chars_eytzinger(chars), hash);
+	}
+	return rbt_get_least(chars_rbt(chars), hash);
+}
+
+static _Bool order_get_next_hash(const struct characters *chars, size_t hash, size_t *next) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_get_next_hash(chars_eytzinger(chars), hash, next);
+	}
+	return rbt_get_next_hash(chars_rbt(chars), hash, next);
+}
+
+static _Bool order_get_prefix_range(const struct characters *chars, const void *prefix, size_t size, size_t *first, size_t *last) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_get_prefix_range(chars_eytzinger(chars), prefix, size, first, last);
+	}
+	return rbt_get_prefix_range(chars_rbt(chars), prefix, size, first, last);
+}
+
+static _Bool order_get_hash(const struct characters *chars, const void *key, size_t *hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_get_hash(chars_eytzinger(chars), key, hash);
+	}
+	return rbt_get_hash(chars_rbt(chars), key, hash);
+}
+
+static _Bool order_bind_key(struct characters *chars, const void *key, size_t *hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_bind_key(chars_eytzinger(chars), key, hash);
+	}
+	return rbt_bind_key(chars_rbt(chars), key, hash);
+}
+
+static _Bool order_unbind(struct characters *chars, size_t hash) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_unbind(chars_eytzinger(chars), hash);
+	}
+	return rbt_unbind(chars_rbt(chars), hash);
+}
+
+static _Bool order_bulk_load(struct characters *chars, size_t *hashes, size_t count) {
+	if (chars->backend == CHARACTERS_EYTZINGER) {
+		return eytzinger_bulk_load(chars_eytzinger(chars), hashes, count);
+	}
+	return rbt_bulk_load(chars_rbt(chars), hashes, count);
+}
+
+static size_t order_alignment(enum characters_backend backend) {
+	return (backend == CHARACTERS_EYTZINGER) ? eytzinger_alignment() : rbt_alignment();
+}
+
+static size_t order_required_size(size_t names, enum characters_backend backend) {
+	return (backend == CHARACTERS_EYTZINGER) ? eytzinger_required_size(names) : rbt_required_size(names);
+}
+
+static size_t layout(size_t names, enum characters_backend backend, size_t *conf_start, size_t *conf_end, size_t *index_start) {
 	size_t data_pool_off = offsetof(struct characters, data_pool);
 	size_t confa = _Alignof(struct character_entry);
-	size_t conf_start = ((data_pool_off + confa - 1) / confa) * confa;
-	size_t conf_size = sizeof(struct character_entry) * names;
-	size_t conf_end = conf_start + conf_size;
-	size_t rbta = rbt_alignment();
-	size_t rbt_start = ((conf_end + rbta - 1) / rbta) * rbta;
-	size_t rbt_size = rbt_required_size(names);
-	size_t rbt_end = rbt_start + rbt_size;
-	size_t charsa = _Alignof(struct characters);
+	*conf_start = ((data_pool_off + confa - 1) / confa) * confa;
+	*conf_end = *conf_start + sizeof(struct character_entry) * names;
+	size_t ordera = order_alignment(backend);
+	size_t order_start = ((*conf_end + ordera - 1) / ordera) * ordera;
+	size_t indexa = name_index_alignment();
+	*index_start = ((order_start + order_required_size(names, backend) + indexa - 1) / indexa) * indexa;
+	return *index_start + name_index_required_size(names);
+}
+
+size_t characters_required_size(size_t names, enum characters_backend backend) {
+	size_t conf_start;
+	size_t conf_end;
+	size_t index_start;
+	return layout(names, backend, &conf_start, &conf_end, &index_start);
+}
+
+size_t characters_alignment(void) {
 	size_t alignment = sizeof(void *);
+	size_t charsa = _Alignof(struct characters);
+	size_t confa = _Alignof(struct character_entry);
+	size_t rbta = rbt_alignment();
+	size_t eytza = eytzinger_alignment();
+	size_t indexa = name_index_alignment();
 	alignment = (charsa > alignment) ? charsa : alignment;
 	alignment = (confa > alignment) ? confa : alignment;
 	alignment = (rbta > alignment) ? rbta : alignment;
-	struct characters *res = NULL;
-	int r = posix_memalign((void **)&res, alignment, rbt_end);
+	alignment = (eytza > alignment) ? eytza : alignment;
+	alignment = (indexa > alignment) ? indexa : alignment;
+	return alignment;
+}
+
+struct characters *characters_init(void *mem, size_t names, enum characters_backend backend) {
+	if ((mem == NULL) || (((uintptr_t)mem % characters_alignment()) != 0)) {
+		return NULL;
+	}
+	size_t conf_start;
+	size_t conf_end;
+	size_t index_start;
+	size_t end = layout(names, backend, &conf_start, &conf_end, &index_start);
+	struct characters *res = mem;
+	res->config_offset = conf_start;
+	void *order;
+	if (backend == CHARACTERS_EYTZINGER) {
+		size_t ordera = eytzinger_alignment();
+		order = eytzinger_init((char *)res + ((conf_end + ordera - 1) / ordera) * ordera, sizeof(chars_config(res)[0].name), sizeof(chars_config(res)[0]), chars_config(res)[0].name, names);
+	} else {
+		void *data = (void *)((char *)res + conf_end);
+		size_t data_size = index_start - conf_end;
+		order = rbt_init_empty(&data, &data_size, sizeof(chars_config(res)[0].name), sizeof(chars_config(res)[0]), chars_config(res)[0].name, names);
+	}
+	if ((order == NULL) || (name_index_init((char *)res + index_start, names) == NULL)) {
+		return NULL;
+	}
+	res->backend = backend;
+	res->order_offset = (char *)order - (char *)res;
+	res->index_offset = index_start;
+	res->tot_size = end;
+	res->max_names = names;
+	return res;
+}
+
+struct characters *characters_create(size_t names, enum characters_backend backend) {
+	void *mem = NULL;
+	int r = posix_memalign(&mem, characters_alignment(), characters_required_size(names, backend));
 	if (r != 0) {
 		return NULL;
 	}
-	res->config = (struct character_entry *)(res->data_pool + (conf_start - data_pool_off));
-	void *data = (void *)(res->data_pool + (conf_end - data_pool_off));
-	size_t data_size = rbt_end - conf_end;
-	res->rbt = rbt_init_empty(&data, &data_size, sizeof(res->config[0].name), sizeof(res->config[0]), res->config[0].name, names);
-	if (res->rbt == NULL) {
-		free(res);
+	struct characters *res = characters_init(mem, names, backend);
+	if (res == NULL) {
+		free(mem);
 		return NULL;
 	}
-	res->tot_size = rbt_end;
 	return res;
 }
 
@@ -68,23 +213,60 @@ int characters_hash(struct characters *chars, const char *name, size_t *hash) {
 		errno = EFAULT;
 		return -1;
 	}
-	char nm[sizeof(chars->config[0].name)];
+	char nm[NAME_SIZE];
 	memset(nm, 0, sizeof(nm));
-	strncpy(nm, name, sizeof(nm));
-	if (!rbt_get_free(chars->rbt, hash)) {
-		if (!rbt_get_hash(chars->rbt, (void *)nm, hash)) {
+	strncpy(nm, name, sizeof(nm) - 1);
+	if (!order_get_free(chars, hash)) {
+		if (!order_get_hash(chars, (void *)nm, hash)) {
 			errno = ENOSPC;
 			return -1;
 		}
 		return 0;
 	}
+	/* The free slot gets the name before it is bound, as the tree expects */
 	size_t aux = *hash;
-	if (!rbt_bind_key(chars->rbt, (void *)nm, hash)) {
+	memcpy(chars_config(chars)[*hash].name, nm, sizeof(nm));
+	if (!order_bind_key(chars, (void *)nm, hash)) {
 		errno = EFAULT;
 		return -1;
 	}
 	if (aux == *hash) {
-		memcpy(chars->config[*hash].name, nm, sizeof(nm));
+		(void)name_index_add(chars_index(chars), *hash, nm);
+	}
+	return 0;
+}
+
+int characters_hash_all(struct characters *chars, const char *const *names, size_t count, size_t *hashes) {
+	if ((chars == NULL) || ((count > 0) && ((names == NULL) || (hashes == NULL)))) {
+		errno = EFAULT;
+		return -1;
+	}
+	size_t *sorted = NULL;
+	if (!order_get_least(chars, NULL) && (count <= chars->max_names)) {
+		sorted = malloc(count * sizeof(*sorted));
+	}
+	if (sorted != NULL) {
+		/* Empty table: the names take the first slots, and the tree is built at once */
+		for (size_t i = 0; i < count; ++i) {
+			memset(chars_config(chars)[i].name, 0, NAME_SIZE);
+			strncpy(chars_config(chars)[i].name, names[i], NAME_SIZE - 1);
+			hashes[i] = i;
+			sorted[i] = i;
+		}
+		_Bool loaded = order_bulk_load(chars, sorted, count);
+		free(sorted);
+		if (loaded) {
+			for (size_t i = 0; i < count; ++i) {
+				(void)name_index_add(chars_index(chars), i, chars_config(chars)[i].name);
+			}
+			return 0;
+		}
+	}
+	/* Repeated names, or names already hashed */
+	for (size_t i = 0; i < count; ++i) {
+		if (characters_hash(chars, names[i], &hashes[i]) != 0) {
+			return -1;
+		}
 	}
 	return 0;
 }
@@ -94,10 +276,11 @@ int characters_unhash(struct characters *chars, size_t hash) {
 		errno = EFAULT;
 		return -1;
 	}
-	if (!rbt_unbind(chars->rbt, hash)) {
+	if (!order_unbind(chars, hash)) {
 		errno = ENOENT;
 		return -1;
 	}
+	(void)name_index_remove(chars_index(chars), hash);
 	return 0;
 }
 
@@ -106,50 +289,52 @@ int characters_get_name(struct characters *chars, size_t hash, char *name, size_
 		errno = EFAULT;
 		return -1;
 	}
-	if (!rbt_is_bound_hash(chars->rbt, hash)) {
+	if (!order_is_bound_hash(chars, hash)) {
 		errno = ENOENT;
 		return -1;
 	}
-	if (name_size > sizeof(chars->config[0].name)) {
-		name_size = sizeof(chars->config[0].name);
+	if (name_size > NAME_SIZE) {
+		name_size = NAME_SIZE;
 	}
-	strncpy(name, chars->config[hash].name, name_size);
+	strncpy(name, chars_config(chars)[hash].name, name_size);
 	name[name_size - 1] = '\0';
 	return 0;
 }
 
-int characters_complete(struct characters *chars, const char *name, size_t *level, size_t *hash) {
+const char *characters_name(const struct characters *chars, size_t hash) {
+	if ((chars == NULL) || !order_is_bound_hash(chars, hash)) {
+		return NULL;
+	}
+	return chars_config(chars)[hash].name;
+}
+
+int characters_complete(const struct characters *chars, const char *name, size_t *level, size_t *hash) {
 	if ((chars == NULL) || (hash == NULL) || (name == NULL) || (level == NULL)) {
 		errno = EFAULT;
 		return -1;
 	}
-	char nm[sizeof(chars->config[0].name)];
-	memset(nm, 0, sizeof(nm));
-	strncpy(nm, name, sizeof(nm));
-	if (!rbt_get_free(chars->rbt, hash)) {
-		if (!rbt_get_hash(chars->rbt, (void *)nm, hash)) {
-			errno = ENOSPC;
-			return -1;
-		}
-		return 0;
+	*level = strnlen(name, NAME_SIZE - 1);
+	if (!order_get_prefix_range(chars, name, *level, hash, NULL)) {
+		errno = ENOENT;
+		return -1;
 	}
-	size_t aux = *hash;
-	if (!rbt_bind_key(chars->rbt, (void *)nm, hash)) {
+	return 0;
+}
+
+int characters_next_complete(const struct characters *chars, size_t level, size_t *hash) {
+	if ((chars == NULL) || (hash == NULL)) {
 		errno = EFAULT;
 		return -1;
 	}
-	*level = strnlen(name, sizeof(nm));
-	if (aux != *hash) {
-		return 0;
-	}
 	size_t next;
-	_Bool t = rbt_get_next_hash(chars->rbt, *hash, &next);
-	rbt_unbind(chars->rbt, *hash);
-	if (!t) {
+	if (!order_get_next_hash(chars, *hash, &next) || (next >= chars->max_names)) {
 		errno = ENOENT;
 		return -1;
 	}
-	if (memcmp(chars->config[*hash].name, chars->config[next].name, *level) != 0) {
+	if (level > NAME_SIZE) {
+		level = NAME_SIZE;
+	}
+	if (memcmp(chars_config(chars)[*hash].name, chars_config(chars)[next].name, level) != 0) {
 		errno = ENOENT;
 		return -1;
 	}
@@ -157,24 +342,53 @@ int characters_complete(struct characters *chars, const char *name, size_t *leve
 	return 0;
 }
 
-int characters_next_complete(struct characters *chars, size_t level, size_t *hash) {
-	if ((chars == NULL) || (hash == NULL)) {
+int characters_complete_all(const struct characters *chars, const char *name, size_t *hashes, size_t max, size_t *count) {
+	if ((chars == NULL) || (name == NULL) || ((hashes == NULL) && (max > 0)) || (count == NULL)) {
 		errno = EFAULT;
 		return -1;
 	}
-	size_t next;
-	if (!rbt_get_next_hash(chars->rbt, *hash, &next)) {
-		errno = ENOENT;
-		return -1;
+	*count = 0;
+	size_t hash;
+	size_t last;
+	if (!order_get_prefix_range(chars, name, strnlen(name, NAME_SIZE - 1), &hash, &last)) {
+		return 0;
 	}
-	if (level > sizeof(chars->config[0].name)) {
-		level = sizeof(chars->config[0].name);
+	while (*count < max) {
+		hashes[(*count)++] = hash;
+		if ((hash == last) || !order_get_next_hash(chars, hash, &hash)) {
+			break;
+		}
 	}
-	if (memcmp(chars->config[*hash].name, chars->config[next].name, level) != 0) {
-		errno = ENOENT;
+	return 0;
+}
+
+int characters_suggest(const struct characters *chars, const char *text, size_t *hashes, size_t max, size_t *count) {
+	if (chars == NULL) {
+		errno = EFAULT;
 		return -1;
 	}
-	*hash = next;
-	return 0;
+	return name_index_suggest(chars_index(chars), text, hashes, max, count);
 }
 
+/* Read-only scan: it never follows the tree links, so it only reads bounded locations
+ * and terminates even if the table is modified meanwhile (results are then unreliable).
+ */
+
+int characters_find(const struct characters *chars, const char *name, size_t *hash) {
+	if ((chars == NULL) || (name == NULL) || (hash == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	char nm[NAME_SIZE];
+	memset(nm, 0, sizeof(nm));
+	strncpy(nm, name, sizeof(nm) - 1);
+	const struct character_entry *config = chars_config(chars);
+	for (size_t i = 0; i < chars->max_names; ++i) {
+		if (order_is_bound_hash(chars, i) && (memcmp(config[i].name, nm, sizeof(nm)) == 0)) {
+			*hash = i;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
@@ -5,29 +5,75 @@
 
 struct characters;
 
+/* Ordered index of the names of a table */
+enum characters_backend {
+	CHARACTERS_RBT,       /* RedBlack tree (see rbt.h), for tables which are often modified */
+	CHARACTERS_EYTZINGER, /* sorted array (see eytzinger.h), faster lookups but O(names) updates, for mostly static tables */
+};
+
 /* Returns NULL if not enough memory for a characters table of names entries */
-struct characters *characters_create(size_t names);
+struct characters *characters_create(size_t names, enum characters_backend backend);
+
+/* Number of bytes and alignment of the memory needed by a characters table of names entries */
+size_t characters_required_size(size_t names, enum characters_backend backend);
+size_t characters_alignment(void);
+
+/* Build an empty table in a memory block of characters_required_size(names) bytes
+ * aligned on characters_alignment(). The table does not contain any pointer,
+ * it stays valid if the block is moved, or mapped at another address.
+ * Returns NULL on failure.
+ */
+struct characters *characters_init(void *mem, size_t names, enum characters_backend backend);
 
-/* Release resources allocated for the characters table */
+/* Release resources allocated for the characters table (only for tables returned by characters_create) */
 void characters_destroy(struct characters *chars);
 
 /* Return number of managed names */
 size_t characters_max_names(struct characters *chars);
 
-/* Hash a name, if not previously hashed, bind it to the default configuration */
+/* Hash a name, if not previously hashed, bind it to the default configuration.
+ * Names are truncated to 63 bytes, so that the stored ones are always NUL terminated.
+ */
 int characters_hash(struct characters *chars, const char *name, size_t *hash);
 
+/* Hash [count] names at once, and set their hashes. In an empty table, the names get the first hashes
+ * and are sorted once, instead of being inserted one by one.
+ */
+int characters_hash_all(struct characters *chars, const char *const *names, size_t count, size_t *hashes);
+
 /* Unhash a name (ie. make it unbound) */
 int characters_unhash(struct characters *chars, size_t hash);
 
 /* Get the name bound to a hash, take care of having name_size (size of allocated buffer for name) big enough */
 int characters_get_name(struct characters *chars, size_t hash, char *name, size_t name_size);
 
-/* Complete the start of a string to get an already hashed name, *level is set to length of string */
-int characters_complete(struct characters *chars, const char *name, size_t *level, size_t *hash);
+/* Get the name bound to a hash in place, NULL if the hash is not bound.
+ * The name stays in place until the hash is unhashed.
+ */
+const char *characters_name(const struct characters *chars, size_t hash);
+
+/* Completions only read the table, they are safe to call while another process modifies it,
+ * in which case they always terminate but their result must be discarded.
+ */
+
+/* Get the least hashed name starting with a string, in O(log(names)), *level is set to length of string */
+int characters_complete(const struct characters *chars, const char *name, size_t *level, size_t *hash);
 
 /* Return next completion, level is the length of string from which to search */
-int characters_next_complete(struct characters *chars, size_t level, size_t *hash);
+int characters_next_complete(const struct characters *chars, size_t level, size_t *hash);
 
-#endif /* CHARACTERS_H */
+/* Get the hashes of the names starting with a string, in order, at most [max] of them, in O(log(names) + *count) */
+int characters_complete_all(const struct characters *chars, const char *name, size_t *hashes, size_t max, size_t *count);
+
+/* Rank the names matching a typed text regardless of case and accents, or despite a typo (see name_index.h),
+ * and get the hashes of the best ones, at most [max] of them.
+ */
+int characters_suggest(const struct characters *chars, const char *text, size_t *hashes, size_t max, size_t *count);
 
+/* Read-only version of the lookup, in O(names):
+ * it never modifies the table, and is safe to call while another process modifies it,
+ * in which case it always terminates but its result must be discarded.
+ */
+int characters_find(const struct characters *chars, const char *name, size_t *hash);
+
+#endif /* CHARACTERS_H */
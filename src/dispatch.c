@@ -0,0 +1,133 @@
+#include "dispatch.h"
+#include "metrics.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPATCH_BATCH 256
+
+/* entry.text.size is 8 bits */
+#define TEXT_SIZE 256
+
+struct dispatcher {
+	size_t next_entry;
+	uint64_t batches;
+	uint64_t entries;
+	uint64_t missed;
+	struct histogram batch_size;
+	struct entry entry[DISPATCH_BATCH];
+	const char *texts[DISPATCH_BATCH];
+	const char *sources[DISPATCH_BATCH]; /* borrowed from the characters table */
+	size_t repeat_of[DISPATCH_BATCH];
+	char text[DISPATCH_BATCH][TEXT_SIZE];
+};
+
+struct dispatcher *dispatcher_create(void) {
+	struct dispatcher *d = calloc(1, sizeof(*d));
+	if (d == NULL) {
+		return NULL;
+	}
+	histogram_reset(&d->batch_size);
+	for (size_t i = 0; i < DISPATCH_BATCH; ++i) {
+		d->texts[i] = d->text[i];
+	}
+	return d;
+}
+
+void dispatcher_destroy(struct dispatcher *d) {
+	free(d);
+	return;
+}
+
+static void overrun(struct dispatcher *d, const struct interface *iface, struct iface_state *state, size_t missed) {
+	d->missed += missed;
+	if (iface->on_overrun != NULL) {
+		iface->on_overrun(state, missed);
+	}
+	return;
+}
+
+size_t dispatch(struct dispatcher *d, struct logs *logs, const struct interface *iface, struct iface_state *state) {
+	size_t delivered = 0;
+	while (1) {
+		size_t first;
+		size_t next;
+		logs_get_range(logs, &first, &next);
+		if (d->next_entry < first) {
+			overrun(d, iface, state, first - d->next_entry);
+			d->next_entry = first;
+		}
+		if (d->next_entry >= next) {
+			break;
+		}
+		size_t count = next - d->next_entry;
+		if (count > DISPATCH_BATCH) {
+			count = DISPATCH_BATCH;
+		}
+		struct logs_run runs[2];
+		int nruns = logs_get_entries(logs, d->next_entry, count, runs);
+		if (nruns < 0) {
+			break;
+		}
+		if ((nruns == 0) || (runs[0].first != d->next_entry)) {
+			/* Discarded since the range was read */
+			continue;
+		}
+		size_t read = 0;
+		for (int r = 0; r < nruns; ++r) {
+			memcpy(d->entry + read, runs[r].entries, runs[r].count * sizeof(d->entry[0]));
+			read += runs[r].count;
+		}
+		size_t texts = 0;
+		while ((texts < read) && (logs_get_text(logs, d->entry[texts].text.offset, d->entry[texts].text.size, d->text[texts]) == 0)) {
+			++texts;
+		}
+		read = texts;
+		logs_name_sources(logs, d->entry, read, d->sources);
+		for (size_t i = 0; i < read; ++i) {
+			if (d->sources[i] == NULL) {
+				d->sources[i] = "";
+			}
+			d->repeat_of[i] = logs_get_repeat(logs, &d->entry[i]);
+		}
+		/* Entries are discarded oldest first, those overwritten while being read lead the batch */
+		size_t skip = 0;
+		while ((skip < read) && (logs_check_entry(logs, d->next_entry + skip) != 0)) {
+			++skip;
+		}
+		if (read == 0) {
+			/* Unreadable text, the entry is lost */
+			skip = 1;
+			read = 1;
+		}
+		if (skip > 0) {
+			overrun(d, iface, state, skip);
+		}
+		if (read > skip) {
+			struct entries_batch batch = {
+				.first = d->next_entry + skip,
+				.count = read - skip,
+				.entries = d->entry + skip,
+				.texts = d->texts + skip,
+				.sources = d->sources + skip,
+				.repeat_of = d->repeat_of + skip,
+				.logs = logs,
+			};
+			iface->on_entries(state, &batch);
+			++d->batches;
+			d->entries += batch.count;
+			histogram_record(&d->batch_size, batch.count);
+			delivered += batch.count;
+		}
+		d->next_entry += read;
+	}
+	return delivered;
+}
+
+void dispatcher_dump_metrics(const struct dispatcher *d, int fd) {
+	metrics_dump_counter(fd, "dispatch", "batches", d->batches);
+	metrics_dump_counter(fd, "dispatch", "entries", d->entries);
+	metrics_dump_counter(fd, "dispatch", "missed", d->missed);
+	metrics_dump_histogram(fd, "dispatch", "batch_size", &d->batch_size);
+	return;
+}
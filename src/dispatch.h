@@ -0,0 +1,25 @@
+#ifndef DISPATCH
+#define DISPATCH
+
+#include "interface.h"
+#include "log_engine.h"
+
+/* Pushes the logged entries to an interface implementing on_entries.
+ * Each call delivers the entries logged since the previous one, in batches of consecutive entries
+ * whose texts and source names are read once for all, entries discarded before being delivered
+ * are reported to on_overrun.
+ */
+struct dispatcher;
+
+/* Returns NULL on failure, the first entry delivered is the oldest retained one */
+struct dispatcher *dispatcher_create(void);
+
+void dispatcher_destroy(struct dispatcher *d);
+
+/* Deliver the pending entries of [logs] to [iface], returns the number of delivered entries */
+size_t dispatch(struct dispatcher *d, struct logs *logs, const struct interface *iface, struct iface_state *state);
+
+/* Writes the dispatch metrics to fd, one "<name> <value>" line per metric */
+void dispatcher_dump_metrics(const struct dispatcher *d, int fd);
+
+#endif /* DISPATCH */
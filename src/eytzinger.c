@@ -0,0 +1,330 @@
+#include "eytzinger.h"
+#include <stdint.h>
+#include <string.h>
+
+/* Bytes of the keys copied in the nodes, so that a node is a quarter of a cache line */
+#define PREFIX 12
+
+/* The rank of a free hash is its position in the stack of free hashes, flagged */
+#define FREE_BIT (((uint32_t)1) << 31)
+
+/* Node k of the implicit tree (from 1) has children 2k and 2k + 1 */
+struct eytz_node {
+	uint32_t hash;
+	unsigned char prefix[PREFIX];
+};
+
+struct eytzinger {
+	size_t key_size;
+	size_t cell_size;
+	ptrdiff_t first_key; /* relative to the array */
+	size_t max_slots;
+	size_t count;
+	size_t free_count;
+	size_t nodes_offset;  /* struct eytz_node [max_slots + 1], the first one unused */
+	size_t sorted_offset; /* uint32_t [max_slots], bound hashes in key order */
+	size_t rank_offset;   /* uint32_t [max_slots], position of each hash in sorted, or in free */
+	size_t free_offset;   /* uint32_t [max_slots], stack of the free hashes */
+};
+
+static size_t align_up(size_t offset, size_t alignment) {
+	return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+static size_t layout(size_t keys, struct eytzinger *l) {
+	l->nodes_offset = align_up(sizeof(struct eytzinger), _Alignof(struct eytz_node));
+	l->sorted_offset = align_up(l->nodes_offset + (keys + 1) * sizeof(struct eytz_node), _Alignof(uint32_t));
+	l->rank_offset = l->sorted_offset + keys * sizeof(uint32_t);
+	l->free_offset = l->rank_offset + keys * sizeof(uint32_t);
+	return l->free_offset + keys * sizeof(uint32_t);
+}
+
+size_t eytzinger_alignment(void) {
+	return _Alignof(struct eytzinger);
+}
+
+size_t eytzinger_required_size(size_t keys) {
+	struct eytzinger l;
+	return layout(keys, &l);
+}
+
+static struct eytz_node *nodes(const struct eytzinger *e) {
+	return (struct eytz_node *)((char *)e + e->nodes_offset);
+}
+
+static uint32_t *sorted(const struct eytzinger *e) {
+	return (uint32_t *)((char *)e + e->sorted_offset);
+}
+
+static uint32_t *rank(const struct eytzinger *e) {
+	return (uint32_t *)((char *)e + e->rank_offset);
+}
+
+static uint32_t *free_stack(const struct eytzinger *e) {
+	return (uint32_t *)((char *)e + e->free_offset);
+}
+
+static const char *key_of(const struct eytzinger *e, size_t hash) {
+	return (const char *)e + e->first_key + hash * e->cell_size;
+}
+
+static void push_free(struct eytzinger *e, size_t hash) {
+	free_stack(e)[e->free_count] = hash;
+	rank(e)[hash] = FREE_BIT | e->free_count;
+	++e->free_count;
+	return;
+}
+
+/* Remove a free hash from the stack, the top one takes its place */
+static void take_free(struct eytzinger *e, size_t hash) {
+	uint32_t position = rank(e)[hash] & ~FREE_BIT;
+	uint32_t top = free_stack(e)[--e->free_count];
+	free_stack(e)[position] = top;
+	rank(e)[top] = FREE_BIT | position;
+	return;
+}
+
+struct eytzinger *eytzinger_init(void *mem, size_t key_size, size_t cell_size, void *first_key, size_t keys) {
+	if ((mem == NULL) || (((uintptr_t)mem % eytzinger_alignment()) != 0) || (key_size > cell_size) || (keys >= FREE_BIT)) {
+		return NULL;
+	}
+	struct eytzinger *e = mem;
+	layout(keys, e);
+	e->key_size = key_size;
+	e->cell_size = cell_size;
+	e->first_key = (const char *)first_key - (const char *)e;
+	e->max_slots = keys;
+	e->count = 0;
+	e->free_count = 0;
+	/* The least hashes are given first */
+	for (size_t i = keys; i > 0; --i) {
+		push_free(e, i - 1);
+	}
+	return e;
+}
+
+/* Compare the first [size] bytes of [key] to those of the key of node [k], from its prefix first */
+static int compare_node(const struct eytzinger *e, const void *key, size_t size, size_t k) {
+	const struct eytz_node *n = &nodes(e)[k];
+	size_t prefix = (size < PREFIX) ? size : PREFIX;
+	int c = memcmp(key, n->prefix, prefix);
+	if ((c != 0) || (prefix == size) || (n->hash >= e->max_slots)) {
+		return c;
+	}
+	return memcmp((const char *)key + prefix, key_of(e, n->hash) + prefix, size - prefix);
+}
+
+/* Rank of the least key greater than [key] on their first [size] bytes (or equal, unless [strict]), count if none.
+ * Only bounded locations are read: the descent stops at the bottom of the tree.
+ */
+static size_t find_rank(const struct eytzinger *e, const void *key, size_t size, _Bool strict) {
+	size_t count = e->count;
+	if (count > e->max_slots) {
+		return 0;
+	}
+	size_t k = 1;
+	while (k <= count) {
+		/* The 16 descendants 4 levels below are contiguous */
+		if (16 * k <= count) {
+			__builtin_prefetch(&nodes(e)[16 * k]);
+		}
+		int c = compare_node(e, key, size, k);
+		k = 2 * k + (strict ? (c >= 0) : (c > 0));
+	}
+	/* Back to the last node where the descent went to the lesser side */
+	k >>= __builtin_ffsl(~(long)k);
+	if (k == 0) {
+		return count;
+	}
+	uint32_t hash = nodes(e)[k].hash;
+	if ((hash >= e->max_slots) || (rank(e)[hash] >= count)) {
+		return count;
+	}
+	return rank(e)[hash];
+}
+
+static size_t fill(struct eytzinger *e, size_t r, size_t k) {
+	if (k > e->count) {
+		return r;
+	}
+	r = fill(e, r, 2 * k);
+	struct eytz_node *n = &nodes(e)[k];
+	n->hash = sorted(e)[r++];
+	memcpy(n->prefix, key_of(e, n->hash), (e->key_size < PREFIX) ? e->key_size : PREFIX);
+	return fill(e, r, 2 * k + 1);
+}
+
+/* Lay the sorted hashes out again, from rank [first] which moved */
+static void rebuild(struct eytzinger *e, size_t first) {
+	for (size_t r = first; r < e->count; ++r) {
+		rank(e)[sorted(e)[r]] = r;
+	}
+	fill(e, 0, 1);
+	return;
+}
+
+_Bool eytzinger_is_free_hash(const struct eytzinger *e, size_t hash) {
+	if ((e == NULL) || (hash >= e->max_slots)) {
+		return 0;
+	}
+	return (rank(e)[hash] & FREE_BIT) != 0;
+}
+
+_Bool eytzinger_is_bound_hash(const struct eytzinger *e, size_t hash) {
+	if ((e == NULL) || (hash >= e->max_slots)) {
+		return 0;
+	}
+	return (rank(e)[hash] & FREE_BIT) == 0;
+}
+
+_Bool eytzinger_get_free(const struct eytzinger *e, size_t *hash) {
+	if ((e == NULL) || (e->free_count == 0)) {
+		return 0;
+	}
+	if (hash != NULL) {
+		*hash = free_stack(e)[e->free_count - 1];
+	}
+	return 1;
+}
+
+_Bool eytzinger_get_least(const struct eytzinger *e, size_t *hash) {
+	if ((e == NULL) || (e->count == 0)) {
+		return 0;
+	}
+	if (hash != NULL) {
+		*hash = sorted(e)[0];
+	}
+	return 1;
+}
+
+_Bool eytzinger_get_next_hash(const struct eytzinger *e, size_t hash, size_t *next) {
+	if (!eytzinger_is_bound_hash(e, hash)) {
+		return 0;
+	}
+	size_t r = rank(e)[hash];
+	if ((r + 1 >= e->count) || (r + 1 >= e->max_slots)) {
+		return 0;
+	}
+	if (next != NULL) {
+		*next = sorted(e)[r + 1];
+	}
+	return 1;
+}
+
+_Bool eytzinger_get_prefix_range(const struct eytzinger *e, const void *prefix, size_t size, size_t *first, size_t *last) {
+	if ((e == NULL) || ((prefix == NULL) && (size > 0)) || (size > e->key_size)) {
+		return 0;
+	}
+	size_t least = find_rank(e, prefix, size, 0);
+	if ((least >= e->count) || (memcmp(prefix, key_of(e, sorted(e)[least]), size) != 0)) {
+		return 0;
+	}
+	size_t after = find_rank(e, prefix, size, 1);
+	if (first != NULL) {
+		*first = sorted(e)[least];
+	}
+	if (last != NULL) {
+		*last = sorted(e)[after - 1];
+	}
+	return 1;
+}
+
+_Bool eytzinger_get_hash(const struct eytzinger *e, const void *key, size_t *hash) {
+	if ((e == NULL) || (key == NULL)) {
+		return 0;
+	}
+	size_t r = find_rank(e, key, e->key_size, 0);
+	if ((r >= e->count) || (memcmp(key, key_of(e, sorted(e)[r]), e->key_size) != 0)) {
+		return 0;
+	}
+	if (hash != NULL) {
+		*hash = sorted(e)[r];
+	}
+	return 1;
+}
+
+_Bool eytzinger_bind_key(struct eytzinger *e, const void *key, size_t *hash) {
+	if ((e == NULL) || (key == NULL) || (hash == NULL)) {
+		return 0;
+	}
+	size_t r = find_rank(e, key, e->key_size, 0);
+	if ((r < e->count) && (memcmp(key, key_of(e, sorted(e)[r]), e->key_size) == 0)) {
+		/* Already here! */
+		*hash = sorted(e)[r];
+		return 1;
+	}
+	if (!eytzinger_is_free_hash(e, *hash)) {
+		return 0;
+	}
+	take_free(e, *hash);
+	memmove(&sorted(e)[r + 1], &sorted(e)[r], (e->count - r) * sizeof(uint32_t));
+	sorted(e)[r] = *hash;
+	++e->count;
+	rebuild(e, r);
+	return 1;
+}
+
+_Bool eytzinger_unbind(struct eytzinger *e, size_t hash) {
+	if (!eytzinger_is_bound_hash(e, hash)) {
+		return 0;
+	}
+	size_t r = rank(e)[hash];
+	memmove(&sorted(e)[r], &sorted(e)[r + 1], (e->count - r - 1) * sizeof(uint32_t));
+	--e->count;
+	push_free(e, hash);
+	rebuild(e, r);
+	return 1;
+}
+
+static int compare_hashes(const struct eytzinger *e, size_t a, size_t b) {
+	return memcmp(key_of(e, a), key_of(e, b), e->key_size);
+}
+
+static void sift_down(const struct eytzinger *e, size_t *hashes, size_t root, size_t count) {
+	for (size_t child = 2 * root + 1; child < count; child = 2 * root + 1) {
+		if ((child + 1 < count) && (compare_hashes(e, hashes[child], hashes[child + 1]) < 0)) {
+			++child;
+		}
+		if (compare_hashes(e, hashes[root], hashes[child]) >= 0) {
+			return;
+		}
+		size_t tmp = hashes[root];
+		hashes[root] = hashes[child];
+		hashes[child] = tmp;
+		root = child;
+	}
+	return;
+}
+
+_Bool eytzinger_bulk_load(struct eytzinger *e, size_t *hashes, size_t count) {
+	if ((e == NULL) || ((hashes == NULL) && (count > 0)) || (e->count != 0) || (count > e->max_slots)) {
+		return 0;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (!eytzinger_is_free_hash(e, hashes[i])) {
+			return 0;
+		}
+	}
+	/* Heap sort */
+	for (size_t i = count / 2; i > 0; --i) {
+		sift_down(e, hashes, i - 1, count);
+	}
+	for (size_t end = count; end > 1; --end) {
+		size_t tmp = hashes[0];
+		hashes[0] = hashes[end - 1];
+		hashes[end - 1] = tmp;
+		sift_down(e, hashes, 0, end - 1);
+	}
+	for (size_t i = 1; i < count; ++i) {
+		if (compare_hashes(e, hashes[i - 1], hashes[i]) >= 0) {
+			return 0;
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		take_free(e, hashes[i]);
+		sorted(e)[i] = hashes[i];
+	}
+	e->count = count;
+	rebuild(e, 0);
+	return 1;
+}
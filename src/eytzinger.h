@@ -0,0 +1,53 @@
+#ifndef EYTZINGER_HEADER
+#define EYTZINGER_HEADER
+
+#include <stddef.h>
+
+/* Sorted array of keys for mostly static tables, an alternative to the RedBlack trees of rbt.h with the same interface.
+ *
+ * Keys are stored in a separate array, as for rbt.h, and designated by hashes (their index in that array).
+ * The sorted hashes are also laid out in Eytzinger order (the breadth first order of a complete binary tree),
+ * along with the start of their keys, so that a lookup reads a few cache lines in a predictable pattern,
+ * without following links. Binding or unbinding a key is in O(keys) instead.
+ *
+ * No pointer is stored, so that the array can be mapped at different addresses (eg. in shared memory).
+ * Lookups only read bounded locations, so they terminate even if the array is modified meanwhile.
+ */
+struct eytzinger;
+
+/* Returns the required alignment to store an array. */
+size_t eytzinger_alignment(void);
+
+/* Returns the number of bytes required to store an array of at most [keys] keys. */
+size_t eytzinger_required_size(size_t keys);
+
+/* Initializes an empty array at [mem], of eytzinger_required_size(keys) bytes aligned on eytzinger_alignment().
+ * [key_size], [cell_size] and [first_key] describe the keys array as for rbt_init_empty.
+ * NULL is returned in case of failure.
+ */
+struct eytzinger *eytzinger_init(void *mem, size_t key_size, size_t cell_size, void *first_key, size_t keys);
+
+/* All following functions return 1 in case of success, and 0 in case of failure, as their rbt.h equivalents */
+
+_Bool eytzinger_is_free_hash(const struct eytzinger *e, size_t hash);
+
+_Bool eytzinger_is_bound_hash(const struct eytzinger *e, size_t hash);
+
+_Bool eytzinger_get_free(const struct eytzinger *e, size_t *hash);
+
+_Bool eytzinger_get_least(const struct eytzinger *e, size_t *hash);
+
+_Bool eytzinger_get_next_hash(const struct eytzinger *e, size_t hash, size_t *next);
+
+_Bool eytzinger_get_prefix_range(const struct eytzinger *e, const void *prefix, size_t size, size_t *first, size_t *last);
+
+_Bool eytzinger_get_hash(const struct eytzinger *e, const void *key, size_t *hash);
+
+/* As for rbt_bind_key, the key must be stored at the address of its hash in the keys array. */
+_Bool eytzinger_bind_key(struct eytzinger *e, const void *key, size_t *hash);
+
+_Bool eytzinger_unbind(struct eytzinger *e, size_t hash);
+
+_Bool eytzinger_bulk_load(struct eytzinger *e, size_t *hashes, size_t count);
+
+#endif
@@ -6,11 +6,28 @@
 
 struct iface_state;
 
+/* Consecutive entries, with their text and the name of their source, valid during the on_entries call only */
+struct entries_batch {
+	size_t first;               /* index of entries[0] */
+	size_t count;
+	const struct entry *entries;
+	const char *const *texts;   /* texts[i] holds the entries[i].text.size bytes of text of entries[i] */
+	const char *const *sources; /* sources[i] is the NUL terminated name of entries[i].src */
+	const size_t *repeat_of;    /* see logs_get_repeat, to collapse reposts of the same text */
+	struct logs *logs;          /* the entries are read from, for further lookups (eg. logs_get_presence) */
+};
+
 struct interface {
 	const char *name;
 	struct iface_state *(*init)(void);
 	int (*refresh)(struct iface_state *state, struct logs *logs);
 	void (*release)(struct iface_state *state);
+	/* Optional, writes the interface metrics to fd, one "<name> <value>" line per metric */
+	void (*dump_metrics)(struct iface_state *state, int fd);
+	/* Optional, receives every entry in order as it is logged, in batches, before each refresh */
+	void (*on_entries)(struct iface_state *state, const struct entries_batch *batch);
+	/* Optional, along with on_entries: [missed] entries were discarded before they could be delivered */
+	void (*on_overrun)(struct iface_state *state, size_t missed);
 };
 
 size_t supported_interfaces(void);
@@ -3,6 +3,7 @@
 #include "interfaces/basic.h"
 #include "interfaces/simple_colors.h"
 #include "interfaces/inout.h"
+#include "interfaces/server.h"
 #include "interfaces/term.h"
 
 static struct interface *interfaces[] = {
@@ -10,6 +11,7 @@ static struct interface *interfaces[] = {
 	&basic,
 	&simple_colors,
 	&inout,
+	&server,
 	&term,
 };
 
@@ -1,7 +1,6 @@
 #include "basic.h"
 #include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
 
 struct iface_state {
 	size_t next_entry;
@@ -29,29 +28,32 @@ static const char *chan(enum chan_id ci) {
 	}
 }
 
-static int basic_refresh(struct iface_state *state, struct logs *logs) {
+static void basic_on_entries(struct iface_state *state, const struct entries_batch *batch) {
 	printf("%s\n", __func__);
-	struct entry e;
-	size_t ne = logs_get_next_entry(logs);
-	printf("%zu\n", ne);
-	while (state->next_entry < ne) {
-		printf("Trying entry %zu\n", state->next_entry);
-		int r = logs_get_entry(logs, state->next_entry, &e);
-		if (r == 0) {
-			printf("Entry found\n");
-			static char name[64];
-			static char buf[512];
-			printf("Getting text\n");
-			logs_get_text(logs, e.text.offset, e.text.size, buf);
-			printf("Getting source\n");
-			logs_name_source(logs, e.src, name, sizeof(name));
-			printf("%u - %s, %s: %.*s\n", e.time, chan(e.chan), name, e.text.size, buf);
-		} else {
-			printf("Entry not found\n");
+	printf("Entries %zu to %zu\n", batch->first, batch->first + batch->count);
+	for (size_t i = 0; i < batch->count; ++i) {
+		const struct entry *e = &batch->entries[i];
+		if (batch->repeat_of[i] != LOGS_NO_REPEAT) {
+			printf("%u - %s, %s: repeat of entry %zu\n", e->time, chan(e->chan), batch->sources[i], batch->repeat_of[i]);
+			continue;
 		}
-		++state->next_entry;
+		printf("%u - %s, %s: %.*s\n", e->time, chan(e->chan), batch->sources[i], e->text.size, batch->texts[i]);
 	}
-	sleep(1);
+	state->next_entry = batch->first + batch->count;
+	return;
+}
+
+static void basic_on_overrun(struct iface_state *state, size_t missed) {
+	printf("%s\n", __func__);
+	printf("Entries %zu to %zu not found\n", state->next_entry, state->next_entry + missed);
+	state->next_entry += missed;
+	return;
+}
+
+static int basic_refresh(struct iface_state *state, struct logs *logs) {
+	printf("%s\n", __func__);
+	(void)state;
+	logs_wait(logs, 1000);
 	return 1;
 }
 
@@ -66,5 +68,7 @@ struct interface basic = {
 	.init = basic_init,
 	.refresh = basic_refresh,
 	.release = basic_release,
+	.on_entries = basic_on_entries,
+	.on_overrun = basic_on_overrun,
 };
 
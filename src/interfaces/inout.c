@@ -1,18 +1,14 @@
 #include "inout.h"
-#include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
 
 struct iface_state {
-	size_t next_entry;
+	size_t dummy;
 };
 
+static struct iface_state inout_;
+
 static struct iface_state *inout_init(void) {
-	struct iface_state *st = malloc(sizeof(*st));
-	if (st != NULL) {
-		st->next_entry = 0;
-	}
-	return st;
+	return &inout_;
 }
 
 static const char *chan_mod(enum chan_id ci) {
@@ -49,31 +45,54 @@ static const char *color(unsigned int index) {
 	return colors[index % mod];
 }
 
-static int inout_refresh(struct iface_state *state, struct logs *logs) {
-	struct entry e;
-	size_t ne = logs_get_next_entry(logs);
-	while (state->next_entry < ne) {
-		int r = logs_get_entry(logs, state->next_entry, &e);
-		if ((r == 0) && (chan_mod(e.chan) != NULL)) {
-			static char name[64];
-			static char buf[512];
-			logs_get_text(logs, e.text.offset, e.text.size, buf);
-			logs_name_source(logs, e.src, name, sizeof(name));
-			unsigned int aux = e.time;
+/* Duration of the session a leave line ends, empty if unknown:
+ * the presence only tells the last session, which may have ended after that line.
+ */
+static void session(const struct entries_batch *batch, const struct entry *e, char *buf, size_t size) {
+	struct logs_presence p;
+	buf[0] = '\0';
+	if ((e->chan != chan_out) || (logs_get_presence(batch->logs, e->src, &p) != 0) || p.online || (p.until != e->time)
+			|| (p.last_duration == LOGS_NO_DURATION)) {
+		return;
+	}
+	unsigned int d = p.last_duration;
+	snprintf(buf, size, " (%uh%02um%02us online)", d / 3600, (d / 60) % 60, d % 60);
+	return;
+}
+
+static void inout_on_entries(struct iface_state *state, const struct entries_batch *batch) {
+	(void)state;
+	char duration[32];
+	for (size_t i = 0; i < batch->count; ++i) {
+		const struct entry *e = &batch->entries[i];
+		if (chan_mod(e->chan) != NULL) {
+			unsigned int aux = e->time;
 			unsigned int s = aux % 60;
 			aux /= 60;
 			unsigned int m = aux % 60;
 			aux /= 60;
-			printf("%s%s%02u:%02u:%02u - %.26s\x1b[37G: %.*s\x1b[0m\n", color(e.src), chan_mod(e.chan), aux, m, s, name, e.text.size, buf);
+			session(batch, e, duration, sizeof(duration));
+			printf("%s%s%02u:%02u:%02u - %.26s\x1b[37G: %.*s%s\x1b[0m\n", color(e->src), chan_mod(e->chan), aux, m, s, batch->sources[i], e->text.size, batch->texts[i], duration);
 		}
-		++state->next_entry;
 	}
-	sleep(1);
+	fflush(stdout);
+	return;
+}
+
+static void inout_on_overrun(struct iface_state *state, size_t missed) {
+	(void)state;
+	printf("\x1b[2m%zu entries missed\x1b[0m\n", missed);
+	return;
+}
+
+static int inout_refresh(struct iface_state *state, struct logs *logs) {
+	(void)state;
+	logs_wait(logs, 1000);
 	return 1;
 }
 
 static void inout_release(struct iface_state *state) {
-	free(state);
+	(void)state;
 	return;
 }
 
@@ -82,5 +101,7 @@ struct interface inout = {
 	.init = inout_init,
 	.refresh = inout_refresh,
 	.release = inout_release,
+	.on_entries = inout_on_entries,
+	.on_overrun = inout_on_overrun,
 };
 
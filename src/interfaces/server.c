@@ -0,0 +1,455 @@
+#include "server.h"
+#include "../metrics.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_CLIENTS 32
+
+/* Output queued per client, beyond which entries wait in the ring */
+#define QUEUE_SIZE (64 * 1024)
+
+#define REQUEST_SIZE 64
+
+#define SOURCE_SIZE 64
+
+#define TEXT_SIZE 256
+
+/* Largest frame: json with every byte of the source and of the text escaped as \u00XX */
+#define FRAME_SIZE (128 + 6 * (SOURCE_SIZE + TEXT_SIZE))
+
+enum format {
+	format_json,
+	format_binary,
+};
+
+struct client {
+	int fd;
+	_Bool subscribed;
+	enum format format;
+	size_t cursor; /* next entry to queue */
+	size_t request_size;
+	char request[REQUEST_SIZE];
+	size_t out_start;
+	size_t out_end;
+	char out[QUEUE_SIZE];
+};
+
+struct iface_state {
+	int listener;
+	char path[sizeof(((struct sockaddr_un *)NULL)->sun_path)];
+	size_t clients;
+	struct client *client[MAX_CLIENTS];
+	uint64_t accepted;
+	uint64_t rejected;     /* connections refused because MAX_CLIENTS are served */
+	uint64_t bad_requests;
+	uint64_t dropped_slow; /* clients disconnected because they did not keep up with the ring */
+	uint64_t frames;
+	uint64_t bytes;
+	struct histogram write_bytes; /* bytes sent by each write, the batching achieved */
+	char frame[2][FRAME_SIZE];    /* last frame encoded in each format */
+};
+
+static struct iface_state *server_init(void) {
+	const char *path = getenv("WLOG_SOCKET");
+	if ((path == NULL) || (*path == '\0')) {
+		path = "wlog.sock";
+	}
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		dprintf(2, "Socket path too long: %s\n", path);
+		return NULL;
+	}
+	strcpy(addr.sun_path, path);
+	struct iface_state *st = calloc(1, sizeof(*st));
+	if (st == NULL) {
+		return NULL;
+	}
+	strcpy(st->path, path);
+	histogram_reset(&st->write_bytes);
+	st->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (st->listener < 0) {
+		free(st);
+		return NULL;
+	}
+	/* A socket file nobody listens on is left over by a previous run */
+	int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((probe >= 0) && (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) != 0) && (errno == ECONNREFUSED)) {
+		unlink(path);
+	}
+	if (probe >= 0) {
+		close(probe);
+	}
+	if ((bind(st->listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(st->listener, MAX_CLIENTS) != 0)) {
+		dprintf(2, "Cannot listen on %s: %s\n", path, strerror(errno));
+		close(st->listener);
+		free(st);
+		return NULL;
+	}
+	dprintf(2, "Serving logs on %s\n", path);
+	return st;
+}
+
+static void drop_client(struct iface_state *state, size_t i) {
+	close(state->client[i]->fd);
+	free(state->client[i]);
+	--state->clients;
+	state->client[i] = state->client[state->clients];
+	state->client[state->clients] = NULL;
+	return;
+}
+
+static char *put_le(char *out, uint64_t value, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		out[i] = (char)(value >> (8 * i));
+	}
+	return out + bytes;
+}
+
+static char *put_json_string(char *out, const char *s, size_t size) {
+	static const char hex[] = "0123456789abcdef";
+	*out++ = '"';
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = s[i];
+		if ((c == '"') || (c == '\\')) {
+			*out++ = '\\';
+			*out++ = c;
+		} else if (c < 0x20) {
+			memcpy(out, "\\u00", 4);
+			out[4] = hex[c >> 4];
+			out[5] = hex[c & 0xf];
+			out += 6;
+		} else {
+			*out++ = c;
+		}
+	}
+	*out++ = '"';
+	return out;
+}
+
+static const char *chan(enum chan_id ci) {
+	switch (ci) {
+		case chan_commerce:    return "commerce";
+		case chan_guilde:      return "guilde";
+		case chan_proximite:   return "proximite";
+		case chan_recrutement: return "recrutement";
+		case chan_prive_from:  return "prive_from";
+		case chan_prive_to:    return "prive_to";
+		case chan_group:       return "group";
+		case chan_in:          return "in";
+		case chan_out:         return "out";
+		default:               return "invalid";
+	}
+}
+
+/* Encode entry [index] at [out], which has room for FRAME_SIZE bytes, returns the frame size */
+static size_t encode(enum format format, size_t index, const struct entry *e, size_t repeat_of, const char *text, const char *source, char *out) {
+	size_t ssize = strlen(source);
+	char *o = out;
+	if (format == format_binary) {
+		o = put_le(o, 0, 4);
+		o = put_le(o, index, 8);
+		o = put_le(o, e->time, 4);
+		o = put_le(o, e->chan, 1);
+		o = put_le(o, ssize, 1);
+		o = put_le(o, e->text.size, 2);
+		memcpy(o, source, ssize);
+		o += ssize;
+		memcpy(o, text, e->text.size);
+		o += e->text.size;
+		put_le(out, o - out, 4);
+	} else {
+		unsigned int t = e->time;
+		o += sprintf(o, "{\"entry\":%zu,\"time\":\"%02u:%02u:%02u\",\"chan\":\"%s\",\"src\":", index, t / 3600, (t / 60) % 60, t % 60, chan(e->chan));
+		o = put_json_string(o, source, ssize);
+		if (repeat_of != LOGS_NO_REPEAT) {
+			o += sprintf(o, ",\"repeat_of\":%zu", repeat_of);
+		}
+		o += sprintf(o, ",\"text\":");
+		o = put_json_string(o, text, e->text.size);
+		*o++ = '}';
+		*o++ = '\n';
+	}
+	return o - out;
+}
+
+/* Encode entry [index] read from the ring or the archive, returns 0 if it cannot be read anymore */
+static size_t encode_stored(struct logs *logs, enum format format, size_t index, char *out) {
+	struct logs_record rec;
+	if (logs_read_entry(logs, index, &rec) != 0) {
+		return 0;
+	}
+	return encode(format, index, &rec.entry, rec.repeat_of, rec.text, rec.source, out);
+}
+
+/* Make room for a frame at the end of the queue, returns 0 if there is not enough */
+static _Bool reserve(struct client *c) {
+	if ((QUEUE_SIZE - c->out_end) >= FRAME_SIZE) {
+		return 1;
+	}
+	if (c->out_start == 0) {
+		return 0;
+	}
+	memmove(c->out, c->out + c->out_start, c->out_end - c->out_start);
+	c->out_end -= c->out_start;
+	c->out_start = 0;
+	return (QUEUE_SIZE - c->out_end) >= FRAME_SIZE;
+}
+
+/* Queue the entries the client has not been sent yet, as long as its queue has room,
+ * for clients behind the entries delivered by on_entries (backfill, or queue full).
+ * Returns -1 if some of them were discarded without being archived.
+ */
+static int fill(struct iface_state *state, struct client *c, struct logs *logs) {
+	size_t next = logs_get_next_entry(logs);
+	while (c->cursor < next) {
+		if (!reserve(c)) {
+			break;
+		}
+		size_t size = encode_stored(logs, c->format, c->cursor, c->out + c->out_end);
+		if (size == 0) {
+			return -1;
+		}
+		c->out_end += size;
+		++c->cursor;
+		++state->frames;
+	}
+	return 0;
+}
+
+/* Send as much of the queue as the socket accepts, returns -1 if the client is gone */
+static int flush(struct iface_state *state, struct client *c) {
+	while (c->out_start < c->out_end) {
+		ssize_t w = send(c->fd, c->out + c->out_start, c->out_end - c->out_start, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+		}
+		histogram_record(&state->write_bytes, w);
+		state->bytes += w;
+		c->out_start += w;
+	}
+	c->out_start = 0;
+	c->out_end = 0;
+	return 0;
+}
+
+/* Parse the request line, returns -1 if it is invalid */
+static int subscribe(struct client *c, struct logs *logs) {
+	char format[8];
+	char from[8];
+	char arg[24];
+	int n = sscanf(c->request, "%7s %7s %23s", format, from, arg);
+	if (n < 1) {
+		return -1;
+	}
+	if (strcmp(format, "json") == 0) {
+		c->format = format_json;
+	} else if (strcmp(format, "binary") == 0) {
+		c->format = format_binary;
+	} else {
+		return -1;
+	}
+	size_t first = logs_get_oldest_entry(logs);
+	size_t next = logs_get_next_entry(logs);
+	if (n == 1) {
+		c->cursor = next;
+	} else if ((n == 3) && (strcmp(from, "from") == 0)) {
+		char *end;
+		unsigned long long index = strtoull(arg, &end, 10);
+		if ((*end != '\0') || (arg[0] == '-')) {
+			return -1;
+		}
+		c->cursor = (index < first) ? first : index;
+	} else if ((n == 3) && (strcmp(from, "since") == 0)) {
+		unsigned int h;
+		unsigned int m;
+		unsigned int s;
+		char end;
+		if ((sscanf(arg, "%2u:%2u:%2u%c", &h, &m, &s, &end) != 3) || (h > 23) || (m > 59) || (s > 59)) {
+			return -1;
+		}
+		if (logs_find_time(logs, (h * 60 + m) * 60 + s, &c->cursor) != 0) {
+			c->cursor = next;
+		}
+	} else {
+		return -1;
+	}
+	c->subscribed = 1;
+	return 0;
+}
+
+/* Read from the client, returns -1 if it should be disconnected */
+static int receive(struct iface_state *state, struct client *c, struct logs *logs) {
+	char buf[REQUEST_SIZE];
+	ssize_t r = recv(c->fd, buf, sizeof(buf), MSG_DONTWAIT);
+	if (r < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : -1;
+	}
+	if (r == 0) {
+		return -1;
+	}
+	if (c->subscribed) {
+		/* Nothing is expected after the request */
+		return 0;
+	}
+	char *nl = memchr(buf, '\n', r);
+	size_t size = (nl == NULL) ? (size_t)r : (size_t)(nl - buf);
+	if ((c->request_size + size) >= REQUEST_SIZE) {
+		++state->bad_requests;
+		return -1;
+	}
+	memcpy(c->request + c->request_size, buf, size);
+	c->request_size += size;
+	c->request[c->request_size] = '\0';
+	if (nl == NULL) {
+		return 0;
+	}
+	if (subscribe(c, logs) != 0) {
+		static const char msg[] = "error: expected \"json|binary [from <entry> | since <hh:mm:ss>]\"\n";
+		send(c->fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+		++state->bad_requests;
+		return -1;
+	}
+	return 0;
+}
+
+static void accept_clients(struct iface_state *state) {
+	while (1) {
+		/* The listener is non-blocking, this ends with EAGAIN once no connection is pending.
+		 * Accepted sockets are blocking, every transfer on them is done with MSG_DONTWAIT.
+		 */
+		int fd = accept(state->listener, NULL, NULL);
+		if (fd < 0) {
+			return;
+		}
+		struct client *c = (state->clients < MAX_CLIENTS) ? malloc(sizeof(*c)) : NULL;
+		if (c == NULL) {
+			++state->rejected;
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->subscribed = 0;
+		c->format = format_json;
+		c->cursor = 0;
+		c->request_size = 0;
+		c->out_start = 0;
+		c->out_end = 0;
+		state->client[state->clients] = c;
+		++state->clients;
+		++state->accepted;
+	}
+}
+
+/* Entries are encoded once per format for all the clients which are up to date,
+ * the others catch up from the ring in refresh.
+ */
+static void server_on_entries(struct iface_state *state, const struct entries_batch *batch) {
+	for (size_t i = 0; i < batch->count; ++i) {
+		size_t index = batch->first + i;
+		size_t size[2] = { 0, 0 };
+		for (size_t j = 0; j < state->clients; ++j) {
+			struct client *c = state->client[j];
+			if (!c->subscribed || (c->cursor != index) || !reserve(c)) {
+				continue;
+			}
+			if (size[c->format] == 0) {
+				size[c->format] = encode(c->format, index, &batch->entries[i], batch->repeat_of[i], batch->texts[i], batch->sources[i], state->frame[c->format]);
+			}
+			memcpy(c->out + c->out_end, state->frame[c->format], size[c->format]);
+			c->out_end += size[c->format];
+			++c->cursor;
+			++state->frames;
+		}
+	}
+	return;
+}
+
+/* Clients are served from the ring without ever blocking on one of them:
+ * a stuck client only stops being sent entries until they are discarded from the ring, then it is dropped.
+ */
+static int server_refresh(struct iface_state *state, struct logs *logs) {
+	size_t i = 0;
+	while (i < state->clients) {
+		struct client *c = state->client[i];
+		if (c->subscribed && (fill(state, c, logs) != 0)) {
+			dprintf(2, "Dropped a client %zu entries behind\n", logs_get_next_entry(logs) - c->cursor);
+			++state->dropped_slow;
+			drop_client(state, i);
+			continue;
+		}
+		if (flush(state, c) != 0) {
+			drop_client(state, i);
+			continue;
+		}
+		++i;
+	}
+	struct pollfd fds[2 + MAX_CLIENTS];
+	fds[0] = (struct pollfd){ .fd = state->listener, .events = POLLIN };
+	fds[1] = (struct pollfd){ .fd = logs_notify_fd(logs), .events = POLLIN };
+	size_t next = logs_get_next_entry(logs);
+	for (i = 0; i < state->clients; ++i) {
+		struct client *c = state->client[i];
+		/* Clients still catching up are woken up as soon as they can take more */
+		_Bool pending = (c->out_start < c->out_end) || (c->subscribed && (c->cursor < next));
+		fds[2 + i] = (struct pollfd){ .fd = c->fd, .events = POLLIN | (pending ? POLLOUT : 0) };
+	}
+	size_t polled = state->clients;
+	if (poll(fds, 2 + polled, 1000) <= 0) {
+		return 1;
+	}
+	if (fds[1].revents & POLLIN) {
+		logs_notify_clear(logs);
+	}
+	/* Backwards, so that dropping a client does not move the ones not handled yet */
+	for (i = polled; i > 0; --i) {
+		short ev = fds[1 + i].revents;
+		if ((ev & (POLLIN | POLLHUP | POLLERR)) && (receive(state, state->client[i - 1], logs) != 0)) {
+			drop_client(state, i - 1);
+		}
+	}
+	if (fds[0].revents & POLLIN) {
+		accept_clients(state);
+	}
+	return 1;
+}
+
+static void server_dump_metrics(struct iface_state *state, int fd) {
+	metrics_dump_counter(fd, "server", "clients", state->clients);
+	metrics_dump_counter(fd, "server", "accepted", state->accepted);
+	metrics_dump_counter(fd, "server", "rejected", state->rejected);
+	metrics_dump_counter(fd, "server", "bad_requests", state->bad_requests);
+	metrics_dump_counter(fd, "server", "dropped_slow", state->dropped_slow);
+	metrics_dump_counter(fd, "server", "frames", state->frames);
+	metrics_dump_counter(fd, "server", "bytes", state->bytes);
+	metrics_dump_histogram(fd, "server", "write_bytes", &state->write_bytes);
+	return;
+}
+
+static void server_release(struct iface_state *state) {
+	while (state->clients > 0) {
+		drop_client(state, state->clients - 1);
+	}
+	close(state->listener);
+	unlink(state->path);
+	free(state);
+	return;
+}
+
+struct interface server = {
+	.name = "server",
+	.init = server_init,
+	.refresh = server_refresh,
+	.release = server_release,
+	.dump_metrics = server_dump_metrics,
+	.on_entries = server_on_entries,
+};
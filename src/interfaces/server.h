@@ -0,0 +1,29 @@
+#ifndef INTERFACES_SERVER
+#define INTERFACES_SERVER
+
+#include "../interface.h"
+
+/* Serves the logs to local clients on a Unix domain socket,
+ * bound to $WLOG_SOCKET (default: "wlog.sock" in the working directory).
+ *
+ * A client first sends a single request line:
+ *   <format> [from <entry> | since <hh:mm:ss>]\n
+ * with format "json" or "binary". The retained entries (archived ones included,
+ * see logs_archive) from the requested entry index, or from the first entry
+ * logged at or after the requested time, are sent first, then new entries
+ * as they are logged. Without "from" or "since", only new entries are sent.
+ *
+ * json: one object per line,
+ *   {"entry":12,"time":"21:03:17","chan":"guilde","src":"Name","text":"..."}
+ *   with "repeat_of":<entry> before "text" if the text repeats the one of that entry (see logs_get_repeat)
+ * binary: one frame per entry, integers little-endian,
+ *   u32 frame size (header included), u64 entry, u32 time (seconds in the day),
+ *   u8 chan (enum chan_id), u8 source size, u16 text size, source, text
+ *
+ * Each client has a bounded output queue. A client which is so slow that
+ * entries it has not been sent yet are discarded from the ring (without
+ * being archived) is disconnected.
+ */
+extern struct interface server;
+
+#endif
@@ -1,18 +1,14 @@
 #include "simple_colors.h"
-#include <stdlib.h>
 #include <stdio.h>
-#include <unistd.h>
 
 struct iface_state {
-	size_t next_entry;
+	size_t dummy;
 };
 
+static struct iface_state simple_colors_;
+
 static struct iface_state *simple_colors_init(void) {
-	struct iface_state *st = malloc(sizeof(*st));
-	if (st != NULL) {
-		st->next_entry = 0;
-	}
-	return st;
+	return &simple_colors_;
 }
 
 static const char *chan_mod(enum chan_id ci) {
@@ -49,31 +45,37 @@ static const char *color(unsigned int index) {
 	return colors[index % mod];
 }
 
-static int simple_colors_refresh(struct iface_state *state, struct logs *logs) {
-	struct entry e;
-	size_t ne = logs_get_next_entry(logs);
-	while (state->next_entry < ne) {
-		int r = logs_get_entry(logs, state->next_entry, &e);
-		if ((r == 0) && (chan_mod(e.chan) != NULL)) {
-			static char name[64];
-			static char buf[512];
-			logs_get_text(logs, e.text.offset, e.text.size, buf);
-			logs_name_source(logs, e.src, name, sizeof(name));
-			unsigned int aux = e.time;
+static void simple_colors_on_entries(struct iface_state *state, const struct entries_batch *batch) {
+	(void)state;
+	for (size_t i = 0; i < batch->count; ++i) {
+		const struct entry *e = &batch->entries[i];
+		if (chan_mod(e->chan) != NULL) {
+			unsigned int aux = e->time;
 			unsigned int s = aux % 60;
 			aux /= 60;
 			unsigned int m = aux % 60;
 			aux /= 60;
-			printf("%s%s%02u:%02u:%02u - %.26s\x1b[37G: %.*s\x1b[0m\n", color(e.src), chan_mod(e.chan), aux, m, s, name, e.text.size, buf);
+			printf("%s%s%02u:%02u:%02u - %.26s\x1b[37G: %.*s\x1b[0m\n", color(e->src), chan_mod(e->chan), aux, m, s, batch->sources[i], e->text.size, batch->texts[i]);
 		}
-		++state->next_entry;
 	}
-	sleep(1);
+	fflush(stdout);
+	return;
+}
+
+static void simple_colors_on_overrun(struct iface_state *state, size_t missed) {
+	(void)state;
+	printf("\x1b[2m%zu entries missed\x1b[0m\n", missed);
+	return;
+}
+
+static int simple_colors_refresh(struct iface_state *state, struct logs *logs) {
+	(void)state;
+	logs_wait(logs, 1000);
 	return 1;
 }
 
 static void simple_colors_release(struct iface_state *state) {
-	free(state);
+	(void)state;
 	return;
 }
 
@@ -82,5 +84,7 @@ struct interface simple_colors = {
 	.init = simple_colors_init,
 	.refresh = simple_colors_refresh,
 	.release = simple_colors_release,
+	.on_entries = simple_colors_on_entries,
+	.on_overrun = simple_colors_on_overrun,
 };
 
@@ -3,6 +3,12 @@
 
 #include "../interface.h"
 
+/* Interactive view of the logs in the terminal.
+ *
+ * The styles are read from the config file $WLOG_CONFIG if set (see config_save), which is watched:
+ * when it is rewritten or replaced, it is loaded again and the new styles apply from the next frame on.
+ * An invalid file is ignored, the previous styles are kept.
+ */
 extern struct interface term;
 
 #endif
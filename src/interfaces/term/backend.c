@@ -1,15 +1,18 @@
 #include "../term.h"
 #include "command.h"
 #include "config.h"
-#include "debug.h"
 #include "logview.h"
 #include "raw_mode.h"
+#include "status.h"
+#include "viewport.h"
 #include "window_print.h"
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 #include <termios.h>
 #include <unistd.h>
@@ -29,19 +32,30 @@ static void term_resize_handler(int signo, siginfo_t *info, void *context) {
 	return;
 }
 
-/* WSL specific workaround as read does not honnor VTIME on WSL */
-static ssize_t tout_read(int fd, char *buffer, size_t buffer_size, unsigned long timeout) {
+/* WSL specific workaround as read does not honnor VTIME on WSL.
+ * Also returns 0 as soon as one of the [count] descriptors of [notify] is readable, ignoring the invalid ones.
+ */
+static ssize_t tout_read(int fd, const int *notify, size_t count, char *buffer, size_t buffer_size, unsigned long timeout) {
 	fd_set set;
 	FD_ZERO(&set);
 	FD_SET(fd, &set);
+	int nfds = fd + 1;
+	for (size_t i = 0; i < count; ++i) {
+		if (notify[i] >= 0) {
+			FD_SET(notify[i], &set);
+			if (notify[i] >= nfds) {
+				nfds = notify[i] + 1;
+			}
+		}
+	}
 	struct timeval tout;
 	tout.tv_sec = timeout / 1000000;
 	tout.tv_usec = timeout % 1000000;
-	int r = select(fd + 1, &set, NULL, NULL, &tout);
+	int r = select(nfds, &set, NULL, NULL, &tout);
 	if (r == -1) {
 		return -1;
 	}
-	if (r == 0) {
+	if ((r == 0) || !FD_ISSET(fd, &set)) {
 		return 0;
 	}
 	return read(fd, buffer, buffer_size);
@@ -49,13 +63,77 @@ static ssize_t tout_read(int fd, char *buffer, size_t buffer_size, unsigned long
 
 struct iface_state {
 	struct config *cfg;
+	const char *config_path; /* NULL without config file */
+	int config_watch; /* inotify descriptor watching the directory of the config file, -1 if none */
+	_Bool config_pending; /* the config file is to be loaded (again) */
 	size_t width;
 	size_t height;
-	size_t focused_entry;
+	struct viewport *vp;
+	struct term_metrics metrics;
 };
 
 static struct iface_state term_ = {0};
 
+/* Editors often replace the file instead of writing it: its directory is watched, for events on its name */
+static void watch_config(struct iface_state *state) {
+	state->config_path = getenv("WLOG_CONFIG");
+	state->config_watch = -1;
+	state->config_pending = (state->config_path != NULL);
+	if (state->config_path == NULL) {
+		return;
+	}
+	const char *slash = strrchr(state->config_path, '/');
+	char *dir = (slash == NULL) ? strdup(".") : strndup(state->config_path, (slash == state->config_path) ? 1 : slash - state->config_path);
+	int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ((dir == NULL) || (fd < 0) || (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)) {
+		dprintf(2, "Cannot watch %s, it will not be reloaded.\n", state->config_path);
+		if (fd >= 0) {
+			close(fd);
+		}
+		fd = -1;
+	}
+	free(dir);
+	state->config_watch = fd;
+	return;
+}
+
+/* Drains the events of the watch, returns 1 if the config file changed */
+static _Bool config_changed(struct iface_state *state) {
+	if (state->config_watch < 0) {
+		return 0;
+	}
+	const char *slash = strrchr(state->config_path, '/');
+	const char *name = (slash == NULL) ? state->config_path : slash + 1;
+	_Bool changed = 0;
+	_Alignas(struct inotify_event) char buffer[4096];
+	ssize_t rd;
+	while ((rd = read(state->config_watch, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t i = 0; i < rd; ) {
+			const struct inotify_event *ev = (const struct inotify_event *)(buffer + i);
+			changed |= (ev->len > 0) && (strcmp(ev->name, name) == 0);
+			i += sizeof(*ev) + ev->len;
+		}
+	}
+	return changed;
+}
+
+/* The new config replaces the previous one between two frames, only if it is valid */
+static _Bool reload_config(struct iface_state *state, struct logs *logs) {
+	state->config_pending = 0;
+	int fd = open(state->config_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return 0;
+	}
+	struct config *cfg = config_load(fd, logs);
+	close(fd);
+	if (cfg == NULL) {
+		return 0;
+	}
+	config_destroy(state->cfg);
+	state->cfg = cfg;
+	return 1;
+}
+
 static struct iface_state *term_init(void) {
 	struct sigaction old_sa;
 	struct sigaction new_sa;
@@ -64,10 +142,11 @@ static struct iface_state *term_init(void) {
 		config_destroy(term_.cfg);
 		term_.cfg = NULL;
 	}
-	term_.cfg = config_create(32768);
+	term_.cfg = config_create();
 	if (term_.cfg == NULL) {
 		return NULL;
 	}
+	watch_config(&term_);
 	new_sa.sa_sigaction = term_resize_handler;
 	sigemptyset(&new_sa.sa_mask);
 	new_sa.sa_flags = SA_SIGINFO | SA_RESTART;
@@ -108,6 +187,10 @@ static struct iface_state *term_init(void) {
 		printf("Terminal window is too small (%zu)\n", term_.height);
 		return NULL;
 	}
+	term_.metrics.frames = 0;
+	term_.metrics.markers_unseen = 0;
+	histogram_reset(&term_.metrics.render_ns);
+	histogram_reset(&term_.metrics.e2e_ns);
 	enter_raw_mode();
 	return &term_;
 }
@@ -118,7 +201,16 @@ static int term_refresh(struct iface_state *state, struct logs *logs) {
 	_Bool quit = 0;
 	_Bool resized = 0;
 	_Bool lv_needs_refresh;
-	ssize_t rd = tout_read(0, buffer, sizeof(buffer), 1000000);
+	int r;
+	int notify[2] = { logs_notify_fd(logs), state->config_watch };
+	ssize_t rd = tout_read(0, notify, 2, buffer, sizeof(buffer), 1000000);
+	logs_notify_clear(logs);
+	state->config_pending |= config_changed(state);
+	_Bool reloaded = state->config_pending && reload_config(state, logs);
+	/* The speakers of unresolved profiles may have been logged since */
+	if ((state->cfg->unresolved_count > 0) && (config_resolve(state->cfg, logs) > 0)) {
+		reloaded = 1;
+	}
 	if (rd < 0) {
 		if (errno != EINTR) {
 			return -1;
@@ -150,20 +242,56 @@ static int term_refresh(struct iface_state *state, struct logs *logs) {
 		printf("Terminal window is too small\r\n");
 		return 1;
 	}
-	refresh_inputs(state->cfg, logs, 1, state->width, state->height - 1, 2, buffer, rd, resized, &state->focused_entry, &quit, &lv_needs_refresh);
+	if (state->vp == NULL) {
+		state->vp = viewport_create(logs_get_max_entries(logs));
+		if (state->vp == NULL) {
+			return -1;
+		}
+		resized = 1;
+	}
+	refresh_inputs(state->cfg, logs, 1, state->width, state->height - 1, 2, buffer, rd, resized, state->vp, &quit, &lv_needs_refresh);
 	if (quit) {
 		return 0;
 	}
-	if (lv_needs_refresh) {
-		(void)log_view(state->cfg, logs, 1, state->width, 1, state->height - 2, &state->focused_entry);
+	/* The viewport is kept, only the visible lines are drawn again with the new styles */
+	lv_needs_refresh |= reloaded;
+	size_t next_entry = logs_get_next_entry(logs);
+	uint64_t start = metrics_now();
+	r = log_view(state->cfg, logs, state->vp, 1, state->width, 1, state->height - 2, lv_needs_refresh);
+	flush_ostream();
+	if (r > 0) {
+		uint64_t end = metrics_now();
+		histogram_record(&state->metrics.render_ns, end - start);
+		++state->metrics.frames;
+		struct logs_marker m;
+		while (logs_pop_marker(logs, next_entry, &m) == 0) {
+			if (viewport_following(state->vp)) {
+				histogram_record(&state->metrics.e2e_ns, end - m.write_ns);
+			} else {
+				++state->metrics.markers_unseen;
+			}
+		}
 	}
+	status_line(logs, &state->metrics, state->height, 1, state->width);
 	flush_ostream();
 	return 1;
 }
 
+static void term_dump_metrics(struct iface_state *state, int fd) {
+	status_dump(&state->metrics, fd);
+	return;
+}
+
 static void term_release(struct iface_state *state) {
 	restore_mode();
+	viewport_destroy(state->vp);
+	state->vp = NULL;
 	config_destroy(state->cfg);
+	state->cfg = NULL;
+	if (state->config_watch >= 0) {
+		close(state->config_watch);
+		state->config_watch = -1;
+	}
 	return;
 }
 
@@ -172,5 +300,6 @@ struct interface term = {
 	.init = term_init,
 	.refresh = term_refresh,
 	.release = term_release,
+	.dump_metrics = term_dump_metrics,
 };
 
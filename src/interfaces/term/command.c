@@ -1,10 +1,33 @@
 #include "command.h"
-#include "debug.h"
+#include "../../trace.h"
 #include <stdio.h>
 #include "key.h"
 
-void refresh_inputs(struct config *cfg, struct logs *lgs, size_t scol, size_t cols, size_t sline, size_t lines, const char *inputs, size_t inputs_size, _Bool resized, size_t *focused_entry, _Bool *quit, _Bool *lv_needs_refresh) {
-	(void)lgs;
+/* Jump to the first entry logged an hour before ([hours] < 0) or after the top of the view,
+ * archived entries included. Times are seconds in the day, results across midnight are ignored.
+ */
+static void jump_hours(struct config *cfg, struct logs *lgs, struct viewport *vp, int hours) {
+	static struct logs_record rec;
+	size_t entry;
+	size_t line;
+	viewport_top(vp, &entry, &line);
+	if (logs_read_entry(lgs, entry, &rec) != 0) {
+		return;
+	}
+	long time = (long)rec.entry.time + hours * 3600L;
+	size_t index;
+	if ((time < 0) || (logs_find_time(lgs, time, &index) != 0)
+			|| ((hours < 0) && (index >= entry)) || ((hours > 0) && (index <= entry))) {
+		if (hours > 0) {
+			viewport_end(vp);
+		}
+		return;
+	}
+	viewport_goto(vp, cfg, lgs, index);
+	return;
+}
+
+void refresh_inputs(struct config *cfg, struct logs *lgs, size_t scol, size_t cols, size_t sline, size_t lines, const char *inputs, size_t inputs_size, _Bool resized, struct viewport *vp, _Bool *quit, _Bool *lv_needs_refresh) {
 	*lv_needs_refresh = resized;
 	struct key k;
 	enum key_state ks = Start;
@@ -12,7 +35,7 @@ void refresh_inputs(struct config *cfg, struct logs *lgs, size_t scol, size_t co
 		int r = parse_key(inputs[i], &ks, &k);
 		if (r < 0) {
 			/* ??? parser is broken, just skip the inputs */
-debug("Unknown character at offset %zu in %.*s\n", i, (int)inputs_size, inputs);
+			TRACE(trace_key_error, i, inputs_size);
 			return;
 		}
 		if (r == 0) {
@@ -23,37 +46,42 @@ debug("Unknown character at offset %zu in %.*s\n", i, (int)inputs_size, inputs);
 			*quit = 1;
 			continue;
 		}
+		if (is_char(&k, '<') || is_char(&k, '>')) {
+			jump_hours(cfg, lgs, vp, is_char(&k, '<') ? -1 : 1);
+			*lv_needs_refresh = 1;
+			continue;
+		}
 		if (is_key(&k, &key_up)) {
-			--*focused_entry;
+			viewport_scroll(vp, cfg, lgs, -1);
 			*lv_needs_refresh = 1;
 			continue;
 		}
 		if (is_key(&k, &key_down)) {
-			++*focused_entry;
+			viewport_scroll(vp, cfg, lgs, 1);
 			*lv_needs_refresh = 1;
 			continue;
 		}
 		if (is_key(&k, &key_pup)) {
-			*focused_entry -= 20;
+			viewport_scroll_pages(vp, cfg, lgs, -1);
 			*lv_needs_refresh = 1;
 			continue;
 		}
 		if (is_key(&k, &key_pdown)) {
-			*focused_entry += 20;
+			viewport_scroll_pages(vp, cfg, lgs, 1);
 			*lv_needs_refresh = 1;
 			continue;
 		}
 		if (is_key(&k, &key_fpup)) {
-			*focused_entry = 0;
+			viewport_home(vp, cfg, lgs);
 			*lv_needs_refresh = 1;
 			continue;
 		}
 		if (is_key(&k, &key_fpdown)) {
-			*focused_entry = SIZE_MAX;
+			viewport_end(vp);
 			*lv_needs_refresh = 1;
 			continue;
 		}
-debug("unknown key [%u:%u]\n", k.c, k.m);
+		TRACE(trace_key_unknown, k.c, k.m);
 	}
 	return;
 }
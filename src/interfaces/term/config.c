@@ -1,12 +1,25 @@
 #include "config.h"
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-struct config *config_create(size_t max_profiles) {
-	struct config *cfg = malloc(sizeof(*cfg) + max_profiles * sizeof(struct profile));
+#define NO_PROFILE SIZE_MAX
+
+struct config *config_create(void) {
+	struct config *cfg = malloc(sizeof(*cfg));
 	if (cfg == NULL) {
 		return NULL;
 	}
+	cfg->profiles_count = 0;
+	cfg->profiles_capacity = 0;
+	cfg->profiles_src = NULL;
+	cfg->profiles = NULL;
+	cfg->unresolved_count = 0;
+	cfg->unresolved = NULL;
 	cfg->show_time = 1;
 	cfg->default_profile.has_foreground = 0;
 	cfg->default_profile.has_background = 0;
@@ -38,7 +51,15 @@ void config_destroy(struct config *cfg) {
 		return;
 	}
 
-	cfg->max_profiles = 0;
+	free(cfg->profiles_src);
+	free(cfg->profiles);
+	free(cfg->unresolved);
+	cfg->profiles_src = NULL;
+	cfg->profiles = NULL;
+	cfg->profiles_count = 0;
+	cfg->profiles_capacity = 0;
+	cfg->unresolved = NULL;
+	cfg->unresolved_count = 0;
 	cfg->show_time = 0;
 	cfg->default_profile.has_foreground = 0;
 	cfg->default_profile.has_background = 0;
@@ -66,50 +87,332 @@ void config_destroy(struct config *cfg) {
 	return;
 }
 
+static size_t bucket_of(const struct config *cfg, size_t src) {
+	return (src * 2654435761u) & (cfg->profiles_capacity - 1);
+}
+
+/* Returns the bucket of [src], or the empty one where it would be inserted */
+static size_t find_bucket(const struct config *cfg, size_t src) {
+	size_t b = bucket_of(cfg, src);
+	while ((cfg->profiles_src[b] != NO_PROFILE) && (cfg->profiles_src[b] != src)) {
+		b = (b + 1) & (cfg->profiles_capacity - 1);
+	}
+	return b;
+}
+
+struct profile *config_profile(struct config *cfg, size_t src) {
+	if ((cfg == NULL) || (cfg->profiles_count == 0) || (src == NO_PROFILE)) {
+		return NULL;
+	}
+	size_t b = find_bucket(cfg, src);
+	return (cfg->profiles_src[b] == src) ? &cfg->profiles[b] : NULL;
+}
+
+struct style *config_style(struct config *cfg, size_t src) {
+	struct profile *p = config_profile(cfg, src);
+	return ((p == NULL) || !p->style.listed) ? &cfg->default_profile : &p->style;
+}
+
+static int grow_profiles(struct config *cfg) {
+	size_t capacity = (cfg->profiles_capacity > 0) ? 2 * cfg->profiles_capacity : 16;
+	size_t *srcs = malloc(capacity * sizeof(*srcs));
+	struct profile *profiles = malloc(capacity * sizeof(*profiles));
+	if ((srcs == NULL) || (profiles == NULL)) {
+		free(srcs);
+		free(profiles);
+		return -1;
+	}
+	for (size_t b = 0; b < capacity; ++b) {
+		srcs[b] = NO_PROFILE;
+	}
+	struct config grown = *cfg;
+	grown.profiles_capacity = capacity;
+	grown.profiles_src = srcs;
+	grown.profiles = profiles;
+	for (size_t b = 0; b < cfg->profiles_capacity; ++b) {
+		if (cfg->profiles_src[b] != NO_PROFILE) {
+			size_t to = find_bucket(&grown, cfg->profiles_src[b]);
+			srcs[to] = cfg->profiles_src[b];
+			profiles[to] = cfg->profiles[b];
+		}
+	}
+	free(cfg->profiles_src);
+	free(cfg->profiles);
+	cfg->profiles_capacity = capacity;
+	cfg->profiles_src = srcs;
+	cfg->profiles = profiles;
+	return 0;
+}
+
+int config_set_profile(struct config *cfg, size_t src, const char *name, const struct style *style) {
+	if ((cfg == NULL) || (name == NULL) || (style == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if ((src == NO_PROFILE) || (name[0] == '\0')) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((2 * (cfg->profiles_count + 1) > cfg->profiles_capacity) && (grow_profiles(cfg) != 0)) {
+		return -1;
+	}
+	size_t b = find_bucket(cfg, src);
+	if (cfg->profiles_src[b] == NO_PROFILE) {
+		cfg->profiles_src[b] = src;
+		++cfg->profiles_count;
+	}
+	struct profile *p = &cfg->profiles[b];
+	strncpy(p->name, name, sizeof(p->name) - 1);
+	p->name[sizeof(p->name) - 1] = '\0';
+	p->style = *style;
+	p->style.listed = 1;
+	return 0;
+}
+
+#define CONFIG_MAGIC 0x47464357 /* "WCFG" */
+#define CONFIG_VERSION 1
+
+#define CONFIG_SHOW_TIME 1
+
+/* Style of a config file, without bitfields so that its layout does not depend on the compiler */
+struct file_style {
+	uint8_t flags; /* STYLE_* */
+	uint8_t foreground;
+	uint8_t background;
+	uint8_t reserved;
+};
+
+#define STYLE_FOREGROUND 0x01
+#define STYLE_BACKGROUND 0x02
+#define STYLE_ITALIC 0x04
+#define STYLE_UNDERLINE 0x08
+#define STYLE_BOLD 0x10
+#define STYLE_FAINT 0x20
+#define STYLE_LISTED 0x40
+#define STYLE_HIDE 0x80
+
+/* Config file: this header, then [profiles] records, each at an offset multiple of 4.
+ * The indexes of the speakers are not saved, they are looked up again by name when loaded.
+ * Integers are in host byte order.
+ */
+struct file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size; /* of the file */
+	uint32_t profiles;
+	uint32_t flags; /* CONFIG_* */
+	struct file_style default_profile;
+	struct file_style channels[16];
+};
+
+struct file_record {
+	uint16_t size; /* of the record, its name included, rounded up to a multiple of 4 */
+	uint8_t name_size; /* without terminating '\0', less than the size of profile names */
+	uint8_t reserved;
+	struct file_style style;
+	char name[];
+};
+
+static size_t record_size(size_t name_size) {
+	return ((sizeof(struct file_record) + name_size + 3) / 4) * 4;
+}
+
+static struct file_style to_file_style(const struct style *st) {
+	return (struct file_style){
+		.flags = (st->has_foreground ? STYLE_FOREGROUND : 0) | (st->has_background ? STYLE_BACKGROUND : 0)
+			| (st->italic ? STYLE_ITALIC : 0) | (st->underline ? STYLE_UNDERLINE : 0) | (st->bold ? STYLE_BOLD : 0)
+			| (st->faint ? STYLE_FAINT : 0) | (st->listed ? STYLE_LISTED : 0) | (st->hide ? STYLE_HIDE : 0),
+		.foreground = st->foreground,
+		.background = st->background,
+	};
+}
+
+static struct style from_file_style(const struct file_style *fs) {
+	return (struct style){
+		.has_foreground = !!(fs->flags & STYLE_FOREGROUND),
+		.has_background = !!(fs->flags & STYLE_BACKGROUND),
+		.italic = !!(fs->flags & STYLE_ITALIC),
+		.underline = !!(fs->flags & STYLE_UNDERLINE),
+		.bold = !!(fs->flags & STYLE_BOLD),
+		.faint = !!(fs->flags & STYLE_FAINT),
+		.listed = !!(fs->flags & STYLE_LISTED),
+		.hide = !!(fs->flags & STYLE_HIDE),
+		.foreground = fs->foreground,
+		.background = fs->background,
+	};
+}
+
+/* Checks the whole file in one pass, returns the offset of each record in [records] */
+static _Bool valid_config(const char *map, size_t size, uint32_t *records) {
+	const struct file_header *h = (const struct file_header *)map;
+	if ((size < sizeof(*h)) || (h->magic != CONFIG_MAGIC) || (h->version != CONFIG_VERSION) || (h->size != size)) {
+		return 0;
+	}
+	size_t offset = sizeof(*h);
+	for (size_t i = 0; i < h->profiles; ++i) {
+		if ((size - offset) < sizeof(struct file_record)) {
+			return 0;
+		}
+		const struct file_record *r = (const struct file_record *)(map + offset);
+		if ((r->name_size == 0) || (r->name_size >= sizeof(((struct profile *)NULL)->name)) || (r->size != record_size(r->name_size))
+				|| (r->size > (size - offset)) || (memchr(r->name, '\0', r->name_size) != NULL)) {
+			return 0;
+		}
+		records[i] = offset;
+		offset += r->size;
+	}
+	return offset == size;
+}
+
 struct config *config_load(int file, struct logs *logs) {
-	struct config cfg_;
-	ssize_t rd = read(file, &cfg_, sizeof(cfg_));
-	if ((rd < 0) || (((size_t)rd) < sizeof(cfg_))) {
+	struct stat st;
+	if ((fstat(file, &st) != 0) || ((size_t)st.st_size < sizeof(struct file_header)) || ((uint64_t)st.st_size > UINT32_MAX)) {
 		return NULL;
 	}
-	struct config *cfg = malloc(sizeof(*cfg) + cfg_.max_profiles * sizeof(struct profile));
-	if (cfg == NULL) {
+	size_t size = st.st_size;
+	const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0);
+	if (map == MAP_FAILED) {
 		return NULL;
 	}
-	*cfg = cfg_;
-	rd = read(file, cfg->profiles, cfg->max_profiles * sizeof(struct profile));
-	if ((rd < 0) || (((size_t)rd) < (cfg->max_profiles * sizeof(struct profile)))) {
+	const struct file_header *h = (const struct file_header *)map;
+	/* A record takes at least 12 bytes, this bounds the allocations before the file is checked */
+	size_t count = (h->profiles <= (size / record_size(1))) ? h->profiles : 0;
+	uint32_t *records = malloc(count * sizeof(*records));
+	struct profile *profiles = malloc(count * sizeof(*profiles));
+	const char **names = malloc(count * sizeof(*names));
+	size_t *indexes = malloc(count * sizeof(*indexes));
+	struct config *cfg = config_create();
+	int r = -1;
+	_Bool unresolved = 0;
+	if (((count == 0) || ((records != NULL) && (profiles != NULL) && (names != NULL) && (indexes != NULL))) && (cfg != NULL)
+			&& (count == h->profiles) && valid_config(map, size, records)) {
+		cfg->show_time = !!(h->flags & CONFIG_SHOW_TIME);
+		cfg->default_profile = from_file_style(&h->default_profile);
+		for (size_t i = 0; i < 16; ++i) {
+			cfg->channels[i] = from_file_style(&h->channels[i]);
+		}
+		/* Profiles are indexed at once, then stored at the index of their name */
+		for (size_t i = 0; i < count; ++i) {
+			const struct file_record *rec = (const struct file_record *)(map + records[i]);
+			memcpy(profiles[i].name, rec->name, rec->name_size);
+			profiles[i].name[rec->name_size] = '\0';
+			profiles[i].style = from_file_style(&rec->style);
+			names[i] = profiles[i].name;
+		}
+		r = logs_index_sources(logs, names, count, indexes);
+		unresolved = (r != 0) && (errno == EROFS);
+	}
+	munmap((void *)map, size);
+	if (unresolved) {
+		/* Read-only logs: the profiles of speakers they do not know yet are set once they are */
+		cfg->unresolved = profiles;
+		cfg->unresolved_count = count;
+		profiles = NULL;
+		r = (config_resolve(cfg, logs) < 0) ? -1 : 0;
+	}
+	for (size_t i = 0; !unresolved && (r == 0) && (i < count); ++i) {
+		r = config_set_profile(cfg, indexes[i], profiles[i].name, &profiles[i].style);
+	}
+	free(indexes);
+	free(names);
+	free(profiles);
+	free(records);
+	if (r != 0) {
+		config_destroy(cfg);
 		return NULL;
 	}
+	return cfg;
+}
+
+ssize_t config_resolve(struct config *cfg, struct logs *logs) {
+	if (cfg == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	ssize_t resolved = 0;
 	size_t i = 0;
-	while (i < cfg->max_profiles) {
-		size_t j;
-		if (cfg->profiles[i].style.listed) {
-			int r = logs_index_source(logs, cfg->profiles[i].name, &j);
-			if (r != 0) {
-				free(cfg);
-				return NULL;
-			}
-			if (j == i) {
-				++i;
-			} else {
-				struct profile prof = cfg->profiles[j];
-				cfg->profiles[j] = cfg->profiles[i];
-				cfg->profiles[i] = prof;
+	while (i < cfg->unresolved_count) {
+		struct profile *p = &cfg->unresolved[i];
+		size_t src;
+		if (logs_index_source(logs, p->name, &src) != 0) {
+			if (errno != EROFS) {
+				return -1;
 			}
+			++i;
+			continue;
+		}
+		if (config_set_profile(cfg, src, p->name, &p->style) != 0) {
+			return -1;
 		}
+		*p = cfg->unresolved[--cfg->unresolved_count];
+		++resolved;
 	}
-	return cfg;
+	return resolved;
+}
+
+/* Returns the size of the record */
+static size_t write_record(char *data, const struct profile *p) {
+	struct file_record *r = (struct file_record *)data;
+	size_t name_size = strlen(p->name);
+	r->size = record_size(name_size);
+	r->name_size = name_size;
+	r->style = to_file_style(&p->style);
+	memcpy(r->name, p->name, name_size);
+	return r->size;
 }
 
 int config_save(int file, const struct config *cfg) {
 	if (cfg == NULL) {
 		return -1;
 	}
-	ssize_t rd = write(file, cfg, sizeof(*cfg) + cfg->max_profiles * sizeof(struct profile));
-	if ((rd < 0) || (((size_t)rd) < (sizeof(*cfg) + cfg->max_profiles * sizeof(struct profile)))) {
+	size_t size = sizeof(struct file_header);
+	for (size_t b = 0; b < cfg->profiles_capacity; ++b) {
+		if (cfg->profiles_src[b] != NO_PROFILE) {
+			size += record_size(strlen(cfg->profiles[b].name));
+		}
+	}
+	for (size_t i = 0; i < cfg->unresolved_count; ++i) {
+		size += record_size(strlen(cfg->unresolved[i].name));
+	}
+	if (size > UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+	char *data = calloc(1, size);
+	if (data == NULL) {
 		return -1;
 	}
+	struct file_header *h = (struct file_header *)data;
+	h->magic = CONFIG_MAGIC;
+	h->version = CONFIG_VERSION;
+	h->size = size;
+	h->flags = cfg->show_time ? CONFIG_SHOW_TIME : 0;
+	h->default_profile = to_file_style(&cfg->default_profile);
+	for (size_t i = 0; i < 16; ++i) {
+		h->channels[i] = to_file_style(&cfg->channels[i]);
+	}
+	size_t offset = sizeof(*h);
+	for (size_t b = 0; b < cfg->profiles_capacity; ++b) {
+		if (cfg->profiles_src[b] != NO_PROFILE) {
+			offset += write_record(data + offset, &cfg->profiles[b]);
+			++h->profiles;
+		}
+	}
+	for (size_t i = 0; i < cfg->unresolved_count; ++i) {
+		offset += write_record(data + offset, &cfg->unresolved[i]);
+		++h->profiles;
+	}
+	for (offset = 0; offset < size; ) {
+		ssize_t wr = write(file, data + offset, size - offset);
+		if (wr < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			free(data);
+			return -1;
+		}
+		offset += wr;
+	}
+	free(data);
 	return 0;
 }
-
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <unistd.h>
 #include "../../log_engine.h"
 
 struct style {
@@ -23,20 +24,50 @@ struct profile {
 	struct style style;
 };
 
+/* Only a few speakers have a profile: profiles are stored in an open addressing table keyed by their index
+ * (see logs_index_source), which is kept at most half full, so that the style of an entry is found in O(1).
+ */
 struct config {
-	size_t max_profiles;
 	unsigned int show_time:1;
 	struct style default_profile;
 	struct style channels[16];
-	struct profile profiles[];
+	size_t profiles_count;
+	size_t profiles_capacity; /* a power of two, or 0 until a profile is set */
+	size_t *profiles_src; /* index of the speaker of each bucket, NO_PROFILE if empty */
+	struct profile *profiles;
+	size_t unresolved_count;
+	struct profile *unresolved; /* profiles of speakers unknown to read-only logs, kept by name (see config_resolve) */
 };
 
-struct config *config_create(size_t max_profiles);
+struct config *config_create(void);
+
+/* Returns the style of the entries of speaker [src]: the style of its profile, or the default one */
+struct style *config_style(struct config *cfg, size_t src);
+
+/* Returns the profile of speaker [src], NULL if it has none */
+struct profile *config_profile(struct config *cfg, size_t src);
+
+/* Sets the profile of speaker [src], named [name], and marks it as listed.
+ * [name] is truncated to the size of profile names, it must not be empty.
+ * Returns 0 on success, -1 otherwise (with errno set).
+ */
+int config_set_profile(struct config *cfg, size_t src, const char *name, const struct style *style);
 
 void config_destroy(struct config *cfg);
 
+/* Config files have a versioned layout of fixed width integers (see config.c), so that they are mapped
+ * and checked in one pass when loaded. The speakers of their profiles are indexed in [logs].
+ * Read-only logs cannot index new names: the profiles of speakers they do not know yet are kept unresolved.
+ * NULL is returned if the file is not a valid config file.
+ */
 struct config *config_load(int file, struct logs *logs);
 
+/* Look the unresolved profiles up again in [logs], setting those whose speaker is now known.
+ * Returns the number of profiles resolved, -1 on failure (with errno set).
+ */
+ssize_t config_resolve(struct config *cfg, struct logs *logs);
+
+/* Returns 0 on success, -1 otherwise (with errno set) */
 int config_save(int file, const struct config *cfg);
 
 #endif /* CONFIG_H */
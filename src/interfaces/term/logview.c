@@ -1,7 +1,8 @@
 #include "../../log_engine.h"
+#include "../../trace.h"
 #include "config.h"
-#include "debug.h"
 #include "logview.h"
+#include "viewport.h"
 #include "window_print.h"
 #include <stddef.h>
 #include <stdio.h>
@@ -71,8 +72,36 @@ static void dbg_style(int i) {
 	return;
 }
 
-int log_view(struct config *cfg, struct logs *lgs, size_t scol, size_t cols, size_t sline, size_t lines, size_t *entry_) {
-debug("START\n");
+/* Get the styles of an entry, returns 1 if the entry is to be displayed, 0 if hidden */
+static _Bool entry_styles(struct config *cfg, const struct entry *e, struct style **cst, struct style **st) {
+	if (e->chan >= (sizeof(cfg->channels) /  sizeof(cfg->channels[0]))) {
+		return 0;
+	}
+	*cst = cfg->channels + e->chan;
+	*st = config_style(cfg, e->src);
+	return !((*cst)->hide || (*st)->hide);
+}
+
+ssize_t log_entry_lines(struct config *cfg, struct logs *lgs, size_t index, size_t text_width) {
+	static struct logs_record rec;
+	struct style *cst;
+	struct style *st;
+	if (logs_read_entry(lgs, index, &rec) != 0) {
+		return -1;
+	}
+	if (!entry_styles(cfg, &rec.entry, &cst, &st)) {
+		return 0;
+	}
+	ssize_t tl = text_lines(0, 0, text_width, rec.text, rec.entry.text.size, 0, 0);
+	if (tl < 0) {
+		/* Not displayable, skip it */
+		return 0;
+	}
+	/* Even an empty message gets a line for its source */
+	return (tl > 0) ? tl : 1;
+}
+
+int log_view(struct config *cfg, struct logs *lgs, struct viewport *vp, size_t scol, size_t cols, size_t sline, size_t lines, _Bool force) {
 	size_t time_size = 0;
 	size_t name_size = 32;
 	if (cfg->show_time) {
@@ -83,106 +112,102 @@ debug("START\n");
 		return -1;
 	}
 	size_t text_width = cols - marge;
-	size_t first_line = sline + lines;
-	size_t next_entry = logs_get_next_entry(lgs);
-	size_t used_entries = logs_get_used_entries(lgs);
-	size_t entry = *entry_;
-debug("  entry: %zu\n", entry);
-debug("  first_line: %zu\n", first_line);
-debug("  text_width: %zu\n", text_width);
-debug("  next_entry: %zu\n", next_entry);
-debug("  used_entries: %zu\n", used_entries);
-	if (entry > next_entry) {
-		entry = next_entry;
-	}
-	size_t first_entry = next_entry - used_entries;
-	if (first_entry > entry) {
-		entry = first_entry;
-	}
-	*entry_ = entry;
-	size_t gap = next_entry - entry;
-	used_entries -= gap;
-debug("  used_entries: %zu\n", used_entries);
-	while (used_entries > 0) {
-		--entry;
-debug("  entry: %zu\n", entry);
-		--used_entries;
-debug("  used_entries: %zu\n", used_entries);
-		static char text[1024];
-		int r;
-		struct entry e;
-		r = logs_get_entry(lgs, entry, &e);
-		if (r != 0) {
-			return -1;
-		}
-		if (e.chan >= (sizeof(cfg->channels) /  sizeof(cfg->channels[0]))) {
-debug("  skipped: invalid channel\n");
-			continue;
-		}
-		struct style *cst = cfg->channels + e.chan;
+	int r = viewport_sync(vp, cfg, lgs, text_width, lines);
+	if (r < 0) {
+		return -1;
+	}
+	if ((r == 0) && !force) {
+		return 0;
+	}
+	size_t entry;
+	size_t skip;
+	viewport_top(vp, &entry, &skip);
+	size_t total = viewport_lines(vp);
+	size_t line = sline;
+	size_t end_line = sline + lines;
+	size_t first_entry;
+	size_t next_entry;
+	viewport_range(vp, &first_entry, &next_entry);
+	TRACE(trace_view_start, entry, total);
+	if (total < lines) {
+		/* Keep the newest lines at the bottom of the view */
+		clear_lines(line, scol, cols, lines - total);
+		line += lines - total;
+	}
+	while ((line < end_line) && (entry < next_entry)) {
+		static struct logs_record rec;
+		struct style *cst;
 		struct style *st;
-		if ((e.src >= cfg->max_profiles) || (!cfg->profiles[e.src].style.listed)) {
-			st = &cfg->default_profile;
-		} else {
-			st = &cfg->profiles[e.src].style;
-		}
-		if (cst->hide || st->hide) {
-debug("  skipped: hide\n");
+		size_t tl = viewport_entry_lines(vp, entry);
+		if (tl <= skip) {
+			skip = 0;
+			++entry;
 			continue;
 		}
-		static char name[67];
-		r = logs_name_source(lgs, e.src, name, sizeof(name));
-		if (r != 0) {
-			return -1;
-		}
-		size_t ts = (e.text.size > sizeof(text)) ? sizeof(text) : e.text.size;
-debug("  ts: %zu\n", ts);
-	       	r = logs_get_text(lgs, e.text.offset, ts, text);
+		r = logs_read_entry(lgs, entry, &rec);
 		if (r != 0) {
-			return -1;
+			/* Discarded since the viewport was synchronized */
+			skip = 0;
+			++entry;
+			continue;
 		}
-		ssize_t tl = text_lines(first_line, scol + marge, text_width, text, ts, 0, 0);
-debug("  tl: %zd\n", tl);
-		if (tl <= 0) {
-			return -1;
+		if (!entry_styles(cfg, &rec.entry, &cst, &st)) {
+			/* Configuration changed since the viewport was synchronized */
+			skip = 0;
+			++entry;
+			continue;
 		}
-		if ((sline + tl) > first_line) {
-			clear_lines(sline, scol, cols, first_line - sline);
-			return 0;
+		static char name[67];
+		strcpy(name, rec.source);
+		size_t ts = rec.entry.text.size;
+		size_t shown = tl - skip;
+		if (shown > (end_line - line)) {
+			shown = end_line - line;
 		}
-		first_line -= tl;
-debug("  first_line: %zu\n", first_line);
+		TRACE(trace_view_entry, entry, shown);
 		reset_style();
 		apply_style(cst);
 		apply_style(st);
 dbg_style(0);
-		text_lines(first_line, scol + marge, text_width, text, ts, 1, 0);
-dbg_style(1);
-		size_t nlen = strlen(name);
-		if ((nlen + 3) <= sizeof(name)) {
-			name[nlen] = ' ';
-			name[nlen+1] = ':';
-			name[nlen+2] = ' ';
-			nlen += 3;
+		if (ts > 0) {
+			text_window(line, scol + marge, text_width, skip, shown, rec.text, ts, 0);
+		} else {
+			clear_lines(line, scol + marge, text_width, 1);
 		}
-		text_lines(first_line, scol + time_size, name_size, name, nlen, 1, 1);
-		if (time_size > 0) {
-			char time[10];
-			unsigned int seconds = e.time % 60;
-			unsigned int minutes = (e.time / 60) % 60;
-			unsigned int hours = e.time / 3600;
-			r = sprintf(time, "%02u:%02u:%02u", hours, minutes, seconds);
-			if (r < 0) {
-				return -1;
+dbg_style(1);
+		if (skip == 0) {
+			size_t nlen = strlen(name);
+			if ((nlen + 3) <= sizeof(name)) {
+				name[nlen] = ' ';
+				name[nlen+1] = ':';
+				name[nlen+2] = ' ';
+				nlen += 3;
 			}
+			text_window(line, scol + time_size, name_size, 0, 1, name, nlen, 1);
+			if (time_size > 0) {
+				char time[10];
+				unsigned int seconds = rec.entry.time % 60;
+				unsigned int minutes = (rec.entry.time / 60) % 60;
+				unsigned int hours = rec.entry.time / 3600;
+				r = sprintf(time, "%02u:%02u:%02u", hours, minutes, seconds);
+				if (r < 0) {
+					return -1;
+				}
 dbg_style(2);
-			text_lines(first_line, scol, time_size, time, r, 1, 0);
-		}
+				text_lines(line, scol, time_size, time, r, 1, 0);
+			}
 dbg_style(3);
-		clear_lines(first_line + 1, scol, marge, tl - 1);
+			clear_lines(line + 1, scol, marge, shown - 1);
+		} else {
+dbg_style(3);
+			clear_lines(line, scol, marge, shown);
+		}
+		line += shown;
+		skip = 0;
+		++entry;
 	}
 dbg_style(4);
-	clear_lines(sline, scol, cols, first_line - sline);
-	return 0;
+	TRACE(trace_view_end, entry, line);
+	clear_lines(line, scol, cols, end_line - line);
+	return 1;
 }
-
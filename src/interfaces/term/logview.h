@@ -2,10 +2,21 @@
 #define LOGVIEW
 
 #include "config.h"
+#include "viewport.h"
 #include "../../log_engine.h"
 #include <stddef.h>
+#include <unistd.h>
 
-int log_view(struct config *cfg, struct logs *lgs, size_t scol, size_t cols, size_t sline, size_t lines, size_t *entry);
+/* Number of lines required to display an entry in a text area of [text_width] columns,
+ * 0 if the entry is hidden, -1 on failure.
+ */
+ssize_t log_entry_lines(struct config *cfg, struct logs *lgs, size_t index, size_t text_width);
+
+/* Display the part of the logs selected by the viewport,
+ * nothing is printed if neither the logs nor the viewport changed, unless [force] is set.
+ * Returns 1 if the view was printed, 0 if there was nothing to print, -1 on failure.
+ */
+int log_view(struct config *cfg, struct logs *lgs, struct viewport *vp, size_t scol, size_t cols, size_t sline, size_t lines, _Bool force);
 
 #endif /* LOGVIEW */
 
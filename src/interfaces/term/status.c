@@ -0,0 +1,76 @@
+#include "status.h"
+#include "window_print.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+static int format_size(char *buf, size_t size, uint64_t bytes) {
+	if (bytes < 10000) {
+		return snprintf(buf, size, "%" PRIu64 "B", bytes);
+	}
+	if (bytes < 10000000) {
+		return snprintf(buf, size, "%" PRIu64 "kB", bytes / 1000);
+	}
+	return snprintf(buf, size, "%" PRIu64 "MB", bytes / 1000000);
+}
+
+void status_line(struct logs *lgs, const struct term_metrics *tm, size_t line, size_t col, size_t width) {
+	const struct logs_metrics *m = logs_get_metrics(lgs);
+	if (m == NULL) {
+		return;
+	}
+	/* Up to 14 digits of megabytes, the unit and the '\0' */
+	char read[24];
+	char parse50[16];
+	char parse99[16];
+	char frame50[16];
+	char frame99[16];
+	char e2e50[16];
+	char e2e99[16];
+	char e2e999[16];
+	char text[256];
+	size_t ring_used;
+	size_t ring_size;
+	logs_get_ring_usage(lgs, &ring_used, &ring_size);
+	format_size(read, sizeof(read), m->bytes_read);
+	metrics_format_duration(parse50, sizeof(parse50), histogram_percentile(&m->parse_ns, 500));
+	metrics_format_duration(parse99, sizeof(parse99), histogram_percentile(&m->parse_ns, 990));
+	metrics_format_duration(frame50, sizeof(frame50), histogram_percentile(&tm->render_ns, 500));
+	metrics_format_duration(frame99, sizeof(frame99), histogram_percentile(&tm->render_ns, 990));
+	int w = snprintf(text, sizeof(text), "entries %zu/%zu ring %zu%% read %s dropped %" PRIu64 "/%" PRIu64 "/%" PRIu64 " evicted %" PRIu64 " | parse %s %s | frame %s %s",
+		logs_get_used_entries(lgs), logs_get_max_entries(lgs), (ring_size > 0) ? (ring_used * 100) / ring_size : 0, read,
+		m->dropped_parse, m->dropped_names, m->dropped_size, m->entries_evicted, parse50, parse99, frame50, frame99);
+	if (w < 0) {
+		return;
+	}
+	if ((tm->e2e_ns.count > 0) && ((size_t)w < sizeof(text))) {
+		metrics_format_duration(e2e50, sizeof(e2e50), histogram_percentile(&tm->e2e_ns, 500));
+		metrics_format_duration(e2e99, sizeof(e2e99), histogram_percentile(&tm->e2e_ns, 990));
+		metrics_format_duration(e2e999, sizeof(e2e999), histogram_percentile(&tm->e2e_ns, 999));
+		int x = snprintf(text + w, sizeof(text) - w, " | e2e %s %s %s", e2e50, e2e99, e2e999);
+		if (x > 0) {
+			w += x;
+		}
+	}
+	if ((size_t)w >= sizeof(text)) {
+		w = sizeof(text) - 1;
+	}
+	write_ostream("\x1b[0m\x1b[7m", 8);
+	if (text_window(line, col, width, 0, 1, text, w, 0) < 0) {
+		clear_lines(line, col, width, 1);
+	}
+	write_ostream("\x1b[0m", 4);
+	return;
+}
+
+void status_dump(const struct term_metrics *tm, int fd) {
+	uint64_t bytes;
+	uint64_t writes;
+	ostream_stats(&bytes, &writes);
+	metrics_dump_counter(fd, "term", "frames", tm->frames);
+	metrics_dump_counter(fd, "term", "bytes_written", bytes);
+	metrics_dump_counter(fd, "term", "writes", writes);
+	metrics_dump_counter(fd, "term", "markers_unseen", tm->markers_unseen);
+	metrics_dump_histogram(fd, "term", "render_ns", &tm->render_ns);
+	metrics_dump_histogram(fd, "term", "e2e_ns", &tm->e2e_ns);
+	return;
+}
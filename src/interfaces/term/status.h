@@ -0,0 +1,22 @@
+#ifndef STATUS_H
+#define STATUS_H
+
+#include "../../log_engine.h"
+#include "../../metrics.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct term_metrics {
+	uint64_t frames;
+	uint64_t markers_unseen; /* latency markers of entries displayed while not following new entries */
+	struct histogram render_ns;
+	struct histogram e2e_ns; /* from the write of a marked line to the log file to its display */
+};
+
+/* Display a one line summary of the engine and rendering metrics */
+void status_line(struct logs *lgs, const struct term_metrics *tm, size_t line, size_t col, size_t width);
+
+/* Write the rendering metrics to fd, one "term.<name> <value>" line per metric */
+void status_dump(const struct term_metrics *tm, int fd);
+
+#endif /* STATUS_H */
@@ -0,0 +1,438 @@
+#include "viewport.h"
+#include "logview.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The viewport accounts for a window [first, next) of at most [capacity] consecutive entries,
+ * read with logs_read_entry so that it may reach into the archive, down to logs_get_oldest_entry.
+ * While following, the window ends with the newest entry. Scrolling past either end of the window
+ * loads the entries beyond it, dropping entries at the other end once the window is full:
+ * a window which no longer reaches the newest entry is detached, and stops growing with new entries
+ * until it is scrolled back down to them.
+ *
+ * Entry [e] is accounted in slot e % capacity. Slots of entries out of the window count for 0 lines,
+ * making the sum of all slots the number of lines of the view.
+ *
+ * counts[s] is the number of lines of slot s,
+ * tree is a Fenwick tree over counts, tree[i] being the sum of counts[i - (i & -i)] to counts[i - 1].
+ */
+struct viewport {
+	size_t capacity;
+	size_t width;
+	size_t height;
+	size_t first;
+	size_t next;
+	size_t top_entry;
+	size_t top_line;
+	_Bool valid;
+	_Bool follow;
+	_Bool detached;
+	size_t *counts;
+	size_t *tree;
+	size_t data[];
+};
+
+struct viewport *viewport_create(size_t entries) {
+	if (entries == 0) {
+		return NULL;
+	}
+	struct viewport *vp = malloc(sizeof(*vp) + (2 * entries + 1) * sizeof(vp->data[0]));
+	if (vp == NULL) {
+		return NULL;
+	}
+	vp->capacity = entries;
+	vp->width = 0;
+	vp->height = 0;
+	vp->first = 0;
+	vp->next = 0;
+	vp->top_entry = 0;
+	vp->top_line = 0;
+	vp->valid = 0;
+	vp->follow = 1;
+	vp->detached = 0;
+	vp->counts = vp->data;
+	vp->tree = vp->data + entries;
+	return vp;
+}
+
+void viewport_destroy(struct viewport *vp) {
+	if (vp != NULL) {
+		vp->capacity = 0;
+		free(vp);
+	}
+	return;
+}
+
+void viewport_invalidate(struct viewport *vp) {
+	if (vp != NULL) {
+		vp->valid = 0;
+	}
+	return;
+}
+
+static void set_count(struct viewport *vp, size_t slot, size_t count) {
+	size_t delta = count - vp->counts[slot];
+	vp->counts[slot] = count;
+	for (size_t i = slot + 1; i <= vp->capacity; i += i & -i) {
+		vp->tree[i] += delta;
+	}
+	return;
+}
+
+/* Sum of the counts of slots 0 to slot - 1 */
+static size_t prefix(const struct viewport *vp, size_t slot) {
+	size_t sum = 0;
+	for (size_t i = slot; i > 0; i -= i & -i) {
+		sum += vp->tree[i];
+	}
+	return sum;
+}
+
+/* Find the slot holding the line [target] (counted from slot 0),
+ * *line is then set to the line number inside the slot.
+ */
+static size_t search(const struct viewport *vp, size_t target, size_t *line) {
+	size_t step = 1;
+	while ((step << 1) <= vp->capacity) {
+		step <<= 1;
+	}
+	size_t pos = 0;
+	while (step > 0) {
+		if (((pos + step) <= vp->capacity) && (vp->tree[pos + step] <= target)) {
+			pos += step;
+			target -= vp->tree[pos];
+		}
+		step >>= 1;
+	}
+	*line = target;
+	return pos;
+}
+
+static void reset(struct viewport *vp, size_t first, size_t width) {
+	memset(vp->data, 0, (2 * vp->capacity + 1) * sizeof(vp->data[0]));
+	vp->first = first;
+	vp->next = first;
+	vp->width = width;
+	vp->valid = 1;
+	vp->detached = 0;
+	return;
+}
+
+static _Bool full(const struct viewport *vp) {
+	return (vp->next - vp->first) >= vp->capacity;
+}
+
+static size_t load_count(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t entry) {
+	ssize_t tl = log_entry_lines(cfg, lgs, entry, vp->width);
+	return (tl > 0) ? tl : 0;
+}
+
+/* Add the entry preceding the window, returns its number of lines */
+static size_t add_first(struct viewport *vp, struct config *cfg, struct logs *lgs) {
+	--vp->first;
+	size_t count = load_count(vp, cfg, lgs, vp->first);
+	set_count(vp, vp->first % vp->capacity, count);
+	return count;
+}
+
+/* Add the entry following the window, returns its number of lines */
+static size_t add_last(struct viewport *vp, struct config *cfg, struct logs *lgs) {
+	size_t count = load_count(vp, cfg, lgs, vp->next);
+	set_count(vp, vp->next % vp->capacity, count);
+	++vp->next;
+	return count;
+}
+
+static void drop_first(struct viewport *vp) {
+	set_count(vp, vp->first % vp->capacity, 0);
+	++vp->first;
+	return;
+}
+
+static void drop_last(struct viewport *vp) {
+	--vp->next;
+	set_count(vp, vp->next % vp->capacity, 0);
+	vp->detached = 1;
+	return;
+}
+
+/* Load older entries in front of the window, until [lines] lines were added or the oldest entry is reached.
+ * Entries are dropped from the end of a full window, but not the top of the view.
+ */
+static void load_up(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t lines) {
+	size_t oldest = logs_get_oldest_entry(lgs);
+	size_t added = 0;
+	while ((added < lines) && (vp->first > oldest)) {
+		if (full(vp)) {
+			if ((vp->next - 1) <= vp->top_entry) {
+				break;
+			}
+			drop_last(vp);
+		}
+		added += add_first(vp, cfg, lgs);
+	}
+	return;
+}
+
+/* Load newer entries after the window, until [lines] lines were added or the newest entry is reached.
+ * Entries are dropped from the front of a full window, but not the top of the view.
+ */
+static void load_down(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t lines) {
+	size_t next = logs_get_next_entry(lgs);
+	size_t added = 0;
+	while ((added < lines) && (vp->next < next)) {
+		if (full(vp)) {
+			if (vp->first >= vp->top_entry) {
+				break;
+			}
+			drop_first(vp);
+		}
+		added += add_last(vp, cfg, lgs);
+	}
+	if (vp->next >= next) {
+		vp->detached = 0;
+	}
+	return;
+}
+
+size_t viewport_lines(const struct viewport *vp) {
+	if (vp == NULL) {
+		return 0;
+	}
+	return prefix(vp, vp->capacity);
+}
+
+void viewport_range(const struct viewport *vp, size_t *first, size_t *next) {
+	if ((vp == NULL) || (first == NULL) || (next == NULL)) {
+		return;
+	}
+	*first = vp->first;
+	*next = vp->next;
+	return;
+}
+
+size_t viewport_entry_lines(const struct viewport *vp, size_t entry) {
+	if ((vp == NULL) || (entry < vp->first) || (entry >= vp->next)) {
+		return 0;
+	}
+	return vp->counts[entry % vp->capacity];
+}
+
+static size_t position(const struct viewport *vp, size_t entry, size_t line) {
+	if (entry < vp->first) {
+		return 0;
+	}
+	if (entry >= vp->next) {
+		return viewport_lines(vp);
+	}
+	size_t s = vp->first % vp->capacity;
+	size_t t = entry % vp->capacity;
+	size_t pos;
+	if (t >= s) {
+		pos = prefix(vp, t) - prefix(vp, s);
+	} else {
+		pos = viewport_lines(vp) - prefix(vp, s) + prefix(vp, t);
+	}
+	if (line >= vp->counts[t]) {
+		line = (vp->counts[t] > 0) ? vp->counts[t] - 1 : 0;
+	}
+	return pos + line;
+}
+
+static void locate(const struct viewport *vp, size_t pos, size_t *entry, size_t *line) {
+	size_t total = viewport_lines(vp);
+	if (pos >= total) {
+		*entry = vp->next;
+		*line = 0;
+		return;
+	}
+	size_t s = vp->first % vp->capacity;
+	size_t target = prefix(vp, s) + pos;
+	if (target >= total) {
+		target -= total;
+	}
+	size_t k = search(vp, target, line);
+	*entry = vp->first + ((k >= s) ? k - s : vp->capacity - s + k);
+	return;
+}
+
+static size_t last_top(const struct viewport *vp) {
+	size_t total = viewport_lines(vp);
+	return (total > vp->height) ? total - vp->height : 0;
+}
+
+static size_t top_position(const struct viewport *vp) {
+	size_t max = last_top(vp);
+	if (vp->follow) {
+		return max;
+	}
+	size_t pos = position(vp, vp->top_entry, vp->top_line);
+	return (pos > max) ? max : pos;
+}
+
+int viewport_sync(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t width, size_t height) {
+	if ((vp == NULL) || (cfg == NULL) || (lgs == NULL)) {
+		return -1;
+	}
+	size_t first;
+	size_t next;
+	logs_get_range(lgs, &first, &next);
+	size_t oldest = logs_get_oldest_entry(lgs);
+	int changed = 0;
+	if (!vp->valid || (vp->width != width) || (vp->follow && vp->detached)
+			|| ((vp->first < oldest) && ((oldest - vp->first) >= vp->capacity))) {
+		/* Reload the window from the top of the view, or with the stored entries when following */
+		size_t start = first;
+		if (!vp->follow && (vp->top_entry < next)) {
+			start = (vp->top_entry > oldest) ? vp->top_entry : oldest;
+		}
+		reset(vp, start, width);
+		vp->detached = (start != first);
+		changed = 1;
+	}
+	if (vp->height != height) {
+		vp->height = height;
+		changed = 1;
+	}
+	while (vp->first < oldest) {
+		if (vp->first < vp->next) {
+			set_count(vp, vp->first % vp->capacity, 0);
+		}
+		++vp->first;
+		changed = 1;
+	}
+	if (vp->next < vp->first) {
+		vp->next = vp->first;
+	}
+	while (!vp->detached && (vp->next < next)) {
+		if (full(vp)) {
+			if (!vp->follow) {
+				/* Keep the window where the view was scrolled to */
+				vp->detached = 1;
+				break;
+			}
+			drop_first(vp);
+		}
+		add_last(vp, cfg, lgs);
+		changed = 1;
+	}
+	if (vp->detached) {
+		/* Not following: only the lines down to the bottom of the view are needed */
+		size_t below = viewport_lines(vp) - position(vp, vp->top_entry, vp->top_line);
+		size_t end = vp->next;
+		if (below < vp->height) {
+			load_down(vp, cfg, lgs, vp->height - below);
+		}
+		if (vp->next != end) {
+			changed = 1;
+		}
+	}
+	return changed;
+}
+
+void viewport_top(const struct viewport *vp, size_t *entry, size_t *line) {
+	if ((vp == NULL) || (entry == NULL) || (line == NULL)) {
+		return;
+	}
+	locate(vp, top_position(vp), entry, line);
+	return;
+}
+
+static void move_to(struct viewport *vp, size_t pos) {
+	size_t max = last_top(vp);
+	if ((pos >= max) && !vp->detached) {
+		vp->follow = 1;
+		return;
+	}
+	vp->follow = 0;
+	locate(vp, (pos > max) ? max : pos, &vp->top_entry, &vp->top_line);
+	return;
+}
+
+/* Hold the top of the view as an entry, so that the window can be extended around it */
+static void pin(struct viewport *vp) {
+	if (vp->follow) {
+		locate(vp, last_top(vp), &vp->top_entry, &vp->top_line);
+		vp->follow = 0;
+	}
+	return;
+}
+
+void viewport_scroll(struct viewport *vp, struct config *cfg, struct logs *lgs, ssize_t lines) {
+	if ((vp == NULL) || (cfg == NULL) || (lgs == NULL) || !vp->valid) {
+		return;
+	}
+	pin(vp);
+	size_t pos = top_position(vp);
+	if (lines < 0) {
+		size_t up = -(size_t)lines;
+		if (up > pos) {
+			load_up(vp, cfg, lgs, up - pos);
+			pos = top_position(vp);
+		}
+		pos = (up > pos) ? 0 : pos - up;
+	} else {
+		size_t end = pos + lines + vp->height;
+		size_t total = viewport_lines(vp);
+		if (end > total) {
+			load_down(vp, cfg, lgs, end - total);
+			pos = top_position(vp);
+		}
+		pos += lines;
+	}
+	move_to(vp, pos);
+	return;
+}
+
+void viewport_scroll_pages(struct viewport *vp, struct config *cfg, struct logs *lgs, ssize_t pages) {
+	if (vp == NULL) {
+		return;
+	}
+	viewport_scroll(vp, cfg, lgs, pages * (ssize_t)vp->height);
+	return;
+}
+
+void viewport_goto(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t entry) {
+	if ((vp == NULL) || (cfg == NULL) || (lgs == NULL) || !vp->valid) {
+		return;
+	}
+	size_t oldest = logs_get_oldest_entry(lgs);
+	size_t next = logs_get_next_entry(lgs);
+	if ((entry < oldest) || (entry >= next)) {
+		return;
+	}
+	vp->follow = 0;
+	vp->top_entry = entry;
+	vp->top_line = 0;
+	if ((entry < vp->first) || (entry >= vp->next)) {
+		/* Reload the window from the entry, rather than loading all the entries in between */
+		reset(vp, entry, vp->width);
+		vp->detached = 1;
+		load_down(vp, cfg, lgs, vp->height);
+	}
+	move_to(vp, position(vp, entry, 0));
+	return;
+}
+
+void viewport_home(struct viewport *vp, struct config *cfg, struct logs *lgs) {
+	if ((vp == NULL) || (lgs == NULL)) {
+		return;
+	}
+	viewport_goto(vp, cfg, lgs, logs_get_oldest_entry(lgs));
+	return;
+}
+
+void viewport_end(struct viewport *vp) {
+	if (vp == NULL) {
+		return;
+	}
+	vp->follow = 1;
+	return;
+}
+
+_Bool viewport_following(const struct viewport *vp) {
+	if (vp == NULL) {
+		return 0;
+	}
+	return vp->follow;
+}
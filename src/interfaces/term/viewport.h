@@ -0,0 +1,60 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "config.h"
+#include "../../log_engine.h"
+#include <stddef.h>
+#include <unistd.h>
+
+/* A viewport addresses the log view by wrapped lines rather than by entries.
+ * It keeps the number of wrapped lines of a window of entries in a prefix sum tree,
+ * so that a scroll position can be mapped to an (entry, line) pair in O(log n).
+ * The window follows the stored entries, and is moved into the archive when scrolled past them.
+ */
+struct viewport;
+
+/* Returns NULL if not enough memory for a viewport over a window of [entries] log entries */
+struct viewport *viewport_create(size_t entries);
+
+void viewport_destroy(struct viewport *vp);
+
+/* Forget all line counts, they are computed again on next synchronization */
+void viewport_invalidate(struct viewport *vp);
+
+/* Account for new and discarded entries, for a text area of [width] columns and [height] lines.
+ * Line counts are recomputed from scratch when [width] changes.
+ * Returns 1 if the view content may have changed, 0 if not, -1 on failure.
+ */
+int viewport_sync(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t width, size_t height);
+
+/* Total number of wrapped lines of the entries of the window */
+size_t viewport_lines(const struct viewport *vp);
+
+/* Entries of the window are within [*first, *next) */
+void viewport_range(const struct viewport *vp, size_t *first, size_t *next);
+
+/* Number of wrapped lines of an entry, 0 if it is hidden or out of the window */
+size_t viewport_entry_lines(const struct viewport *vp, size_t entry);
+
+/* Get the top of the view as an entry and a wrapped line inside this entry */
+void viewport_top(const struct viewport *vp, size_t *entry, size_t *line);
+
+/* Scroll by some lines (negative values scroll up), loading archived entries past the stored ones */
+void viewport_scroll(struct viewport *vp, struct config *cfg, struct logs *lgs, ssize_t lines);
+
+/* Scroll by some view heights (negative values scroll up) */
+void viewport_scroll_pages(struct viewport *vp, struct config *cfg, struct logs *lgs, ssize_t pages);
+
+/* Put entry [entry] at the top of the view, nothing is done if it is neither stored nor archived */
+void viewport_goto(struct viewport *vp, struct config *cfg, struct logs *lgs, size_t entry);
+
+/* Go to the oldest line, archived ones included */
+void viewport_home(struct viewport *vp, struct config *cfg, struct logs *lgs);
+
+/* Go to the newest line, and keep following new entries */
+void viewport_end(struct viewport *vp);
+
+/* Returns 1 if the view is following new entries */
+_Bool viewport_following(const struct viewport *vp);
+
+#endif /* VIEWPORT_H */
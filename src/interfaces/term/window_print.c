@@ -1,8 +1,9 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include "debug.h"
+#include "window_print.h"
 
 struct window {
 	size_t line;
@@ -32,12 +33,34 @@ static const char * const graph_del = "⌂";
 
 static char buf[256];
 static size_t bytes = 0;
+static uint64_t total_bytes = 0;
+static uint64_t total_writes = 0;
+static ostream_sink sink = NULL;
+static void *sink_ctx = NULL;
+
+void set_ostream_sink(ostream_sink s, void *ctx) {
+	flush_ostream();
+	sink = s;
+	sink_ctx = ctx;
+	return;
+}
+
+static void write_buf(size_t size) {
+	if (sink != NULL) {
+		sink(sink_ctx, buf, size);
+	} else {
+		(void)write(1, buf, size);
+	}
+	total_bytes += size;
+	++total_writes;
+	return;
+}
 
 void write_ostream(const char *text, size_t text_size) {
 	size_t rem = sizeof(buf) - bytes;
 	while (text_size > rem) {
 		memcpy(buf + bytes, text, rem);
-		(void)write(1, buf, sizeof(buf));
+		write_buf(sizeof(buf));
 		text_size -= rem;
 		text += rem;
 		rem = sizeof(buf);
@@ -49,11 +72,23 @@ void write_ostream(const char *text, size_t text_size) {
 }
 
 void flush_ostream(void) {
-	write(1, buf, bytes);
+	if (bytes > 0) {
+		write_buf(bytes);
+	}
 	bytes = 0;
 	return;
 }
 
+void ostream_stats(uint64_t *written_bytes, uint64_t *writes) {
+	if (written_bytes != NULL) {
+		*written_bytes = total_bytes;
+	}
+	if (writes != NULL) {
+		*writes = total_writes;
+	}
+	return;
+}
+
 /* Returns:
  * -1 if invalid character was found, or if ends up in non reset state for multibyte
  *  0 if the string is fully parsed
@@ -104,7 +139,7 @@ static int get_text_line(size_t width, const char **text, size_t *text_size, siz
 	return 0;
 }
 
-ssize_t text_lines(size_t line, size_t col, size_t width, const char *text, size_t text_size, _Bool print, _Bool ljust) {
+ssize_t text_window(size_t line, size_t col, size_t width, size_t skip, size_t height, const char *text, size_t text_size, _Bool ljust) {
 	if (width <= 0) {
 		return -1;
 	}
@@ -120,8 +155,9 @@ ssize_t text_lines(size_t line, size_t col, size_t width, const char *text, size
 	while (r == 2) {
 		const char *old = text;
 		r = get_text_line(width, &text, &text_size, &cols, force);
+		_Bool print = (lines >= skip) && ((lines - skip) < height);
 		if ((r >= 0) && (cols > 0) && print) {
-			int w = sprintf(header, "\x1b[%zu;%zuH", line + lines, col);
+			int w = sprintf(header, "\x1b[%zu;%zuH", line + lines - skip, col);
 			if (w < 0) {
 				return -1;
 			}
@@ -147,6 +183,10 @@ ssize_t text_lines(size_t line, size_t col, size_t width, const char *text, size
 	return -1;
 }
 
+ssize_t text_lines(size_t line, size_t col, size_t width, const char *text, size_t text_size, _Bool print, _Bool ljust) {
+	return text_window(line, col, width, 0, print ? SIZE_MAX : 0, text, text_size, ljust);
+}
+
 void clear_lines(size_t line, size_t col, size_t width, size_t height) {
 	if (width <= 0) {
 		return;
@@ -3,12 +3,19 @@
 
 #include <unistd.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Returns a negative value in case of an error, otherwise, returns the number of lines required for the print.
  * If print is set, also tries to print the provided text.
  */
 ssize_t text_lines(size_t line, size_t col, size_t width, const char *text, size_t text_size, _Bool print, _Bool ljust);
 
+/* Same as text_lines, but only prints the wrapped lines numbered from skip to skip + height - 1,
+ * the first of them being printed at the provided line.
+ * Returns the total number of lines required for the whole text.
+ */
+ssize_t text_window(size_t line, size_t col, size_t width, size_t skip, size_t height, const char *text, size_t text_size, _Bool ljust);
+
 /* Erase a rectangular area.
  */
 void clear_lines(size_t line, size_t col, size_t width, size_t height);
@@ -18,5 +25,15 @@ void write_ostream(const char *text, size_t text_size);
 
 void flush_ostream(void);
 
+/* Redirect the output stream, by default (or if sink is NULL) it is written to the standard output.
+ * The sink is called with ctx each time the stream buffer is written.
+ */
+typedef void (*ostream_sink)(void *ctx, const char *data, size_t size);
+
+void set_ostream_sink(ostream_sink sink, void *ctx);
+
+/* Total number of bytes written to the terminal, and number of write calls */
+void ostream_stats(uint64_t *written_bytes, uint64_t *writes);
+
 #endif /* WINDOW_PRINT */
 
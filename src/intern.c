@@ -0,0 +1,180 @@
+#include "intern.h"
+#include "metrics.h"
+#include <errno.h>
+#include <string.h>
+
+#define MAX_TEXT 255
+
+#define NO_SLOT -1
+
+/* A slot in use is in the chain of its bucket, a free one in the free chain */
+struct intern_slot {
+	uint32_t refs;
+	uint32_t hash;
+	int32_t next;
+	uint32_t size;
+	size_t origin;
+	char text[MAX_TEXT];
+};
+
+struct intern {
+	size_t slots;
+	size_t used;
+	int32_t free;
+	uint64_t added;
+	uint64_t refs;  /* references taken on existing slots: repeats stored once */
+	uint64_t full;  /* texts which could not be interned as all slots were in use */
+	uint64_t bytes_saved;
+	size_t buckets_offset;
+	struct intern_slot slot[];
+};
+
+uint32_t intern_hash(const char *text, size_t size) {
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < size; ++i) {
+		h = (h ^ (unsigned char)text[i]) * 16777619u;
+	}
+	return h;
+}
+
+static size_t buckets_offset(size_t slots) {
+	return sizeof(struct intern) + slots * sizeof(struct intern_slot);
+}
+
+size_t intern_required_size(size_t slots) {
+	return buckets_offset(slots) + slots * sizeof(int32_t);
+}
+
+size_t intern_alignment(void) {
+	return _Alignof(struct intern);
+}
+
+static int32_t *buckets(const struct intern *in) {
+	return (int32_t *)((char *)in + in->buckets_offset);
+}
+
+struct intern *intern_init(void *mem, size_t slots) {
+	if ((mem == NULL) || (slots == 0) || (slots > INT32_MAX)) {
+		return NULL;
+	}
+	struct intern *in = mem;
+	in->slots = slots;
+	in->used = 0;
+	in->added = 0;
+	in->refs = 0;
+	in->full = 0;
+	in->bytes_saved = 0;
+	in->buckets_offset = buckets_offset(slots);
+	for (size_t i = 0; i < slots; ++i) {
+		in->slot[i].refs = 0;
+		in->slot[i].next = (i + 1 < slots) ? (int32_t)(i + 1) : NO_SLOT;
+		in->slot[i].origin = SIZE_MAX;
+		buckets(in)[i] = NO_SLOT;
+	}
+	in->free = 0;
+	return in;
+}
+
+int intern_ref(struct intern *in, uint32_t hash, const char *text, size_t size, size_t *slot) {
+	if ((in == NULL) || (slot == NULL) || ((text == NULL) && (size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	for (int32_t i = buckets(in)[hash % in->slots]; i != NO_SLOT; i = in->slot[i].next) {
+		struct intern_slot *s = &in->slot[i];
+		if ((s->hash == hash) && (s->size == size) && (memcmp(s->text, text, size) == 0)) {
+			++s->refs;
+			++in->refs;
+			in->bytes_saved += size;
+			*slot = i;
+			return 0;
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
+int intern_add(struct intern *in, uint32_t hash, const char *text, size_t size, size_t origin, size_t *slot) {
+	if ((in == NULL) || (slot == NULL) || ((text == NULL) && (size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (size > MAX_TEXT) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (in->free == NO_SLOT) {
+		++in->full;
+		errno = ENOSPC;
+		return -1;
+	}
+	int32_t i = in->free;
+	struct intern_slot *s = &in->slot[i];
+	in->free = s->next;
+	s->refs = 1;
+	s->hash = hash;
+	s->size = size;
+	s->origin = origin;
+	memcpy(s->text, text, size);
+	int32_t *bucket = &buckets(in)[hash % in->slots];
+	s->next = *bucket;
+	*bucket = i;
+	++in->used;
+	++in->added;
+	*slot = i;
+	return 0;
+}
+
+void intern_unref(struct intern *in, size_t slot) {
+	if ((in == NULL) || (slot >= in->slots) || (in->slot[slot].refs == 0)) {
+		return;
+	}
+	struct intern_slot *s = &in->slot[slot];
+	if (--s->refs > 0) {
+		return;
+	}
+	int32_t *link = &buckets(in)[s->hash % in->slots];
+	while ((*link != NO_SLOT) && (*link != (int32_t)slot)) {
+		link = &in->slot[*link].next;
+	}
+	if (*link == (int32_t)slot) {
+		*link = s->next;
+	}
+	s->next = in->free;
+	in->free = slot;
+	--in->used;
+	return;
+}
+
+int intern_read(const struct intern *in, size_t slot, char *data, size_t size) {
+	if ((in == NULL) || ((data == NULL) && (size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	if ((slot >= in->slots) || (size > MAX_TEXT)) {
+		errno = EDOM;
+		return -1;
+	}
+	memcpy(data, in->slot[slot].text, size);
+	return 0;
+}
+
+size_t intern_origin(const struct intern *in, size_t slot) {
+	if ((in == NULL) || (slot >= in->slots)) {
+		return SIZE_MAX;
+	}
+	return in->slot[slot].origin;
+}
+
+void intern_dump_metrics(const struct intern *in, int fd) {
+	if (in == NULL) {
+		return;
+	}
+	metrics_dump_counter(fd, "intern", "slots", in->slots);
+	metrics_dump_counter(fd, "intern", "used", in->used);
+	metrics_dump_counter(fd, "intern", "added", in->added);
+	metrics_dump_counter(fd, "intern", "repeats", in->refs);
+	metrics_dump_counter(fd, "intern", "full", in->full);
+	metrics_dump_counter(fd, "intern", "bytes_saved", in->bytes_saved);
+	return;
+}
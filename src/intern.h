@@ -0,0 +1,48 @@
+#ifndef INTERN
+#define INTERN
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Table of interned texts: texts logged several times (eg. advertisements reposted every few minutes)
+ * are stored once in a slot, shared by all the entries logging them, which hold a reference on it.
+ * A slot is released once no entry references it anymore, and is then reused for another text.
+ * Each slot also records the entry which logged its text first, so that repeats can be linked to it.
+ *
+ * Like the text store, the table does not contain any pointer, so it can be moved or mapped elsewhere.
+ * It is modified by a single thread; a slot copied by a reader while it is reused may be corrupted,
+ * readers must check afterwards that the entry referencing it has not been discarded.
+ */
+struct intern;
+
+/* Hash of a text, as expected by the other functions */
+uint32_t intern_hash(const char *text, size_t size);
+
+/* Number of bytes and alignment of the memory needed by a table of provided number of slots */
+size_t intern_required_size(size_t slots);
+size_t intern_alignment(void);
+
+/* Build a table of provided number of slots in a memory block of intern_required_size(slots) bytes */
+struct intern *intern_init(void *mem, size_t slots);
+
+/* Find the slot of a text and add a reference to it, returns 0 on success, -1 if the text is not interned */
+int intern_ref(struct intern *in, uint32_t hash, const char *text, size_t size, size_t *slot);
+
+/* Intern a text first logged by entry [origin], with a single reference.
+ * Returns 0 on success, -1 if all slots are in use (ENOSPC) or the text is too long (EINVAL).
+ */
+int intern_add(struct intern *in, uint32_t hash, const char *text, size_t size, size_t origin, size_t *slot);
+
+/* Drop a reference to a slot, released with the last one */
+void intern_unref(struct intern *in, size_t slot);
+
+/* Copy [size] bytes of the text of a slot to data, returns 0 on success, -1 if there is no such slot */
+int intern_read(const struct intern *in, size_t slot, char *data, size_t size);
+
+/* Entry which logged the text of a slot first, SIZE_MAX if there is no such slot */
+size_t intern_origin(const struct intern *in, size_t slot);
+
+/* Writes the table counters to fd, one "intern.<name> <value>" line per metric */
+void intern_dump_metrics(const struct intern *in, int fd);
+
+#endif
@@ -1,59 +1,444 @@
 #include "log_engine.h"
+#include "archive.h"
+#include "intern.h"
+#include "bulk_parser.h"
 #include "entry_parser.h"
-#include "ringbuf.h"
+#include "textstore.h"
 #include "characters.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
-struct logs {
-	int logfile;
-	struct characters *chars;
-	struct ringbuffer *rb;
+#define MAX_MARKERS 1024
+
+/* Polling period of the ingestion thread once the end of the log file is reached,
+ * doubled at each empty read up to the maximum.
+ */
+#define INGEST_MIN_WAIT_NS 1000000u
+#define INGEST_MAX_WAIT_NS 32000000u
+
+#define LOGS_MAGIC 0x574c4f47u /* "WLOG" */
+#define LOGS_VERSION 7
+
+#define SNAPSHOT_MAGIC 0x574c534eu /* "WLSN" */
+#define SNAPSHOT_VERSION 2
+
+/* Alignment of the parts of the arena */
+#define ARENA_ALIGN 64
+
+/* Share of the text budget (bytes per slot) given to interned texts */
+#define INTERN_SHARE 4096
+
+/* Shorter texts are not worth interning */
+#define MIN_INTERNED 32
+
+/* First occurrences of texts remembered to detect repeats, by hash */
+#define RECENT_TEXTS 4096
+
+/* Flag of the text offsets of entries whose text is interned, the offset is then the slot */
+#define INTERNED_TEXT (((size_t)1) << TEXTSTORE_POSITION_BITS)
+
+/* End of the list of the characters online */
+#define NO_PRESENCE UINT32_MAX
+
+#define DAY_SECONDS 86400
+
+enum presence_state {
+	PRESENCE_UNKNOWN, /* no join or leave line seen */
+	PRESENCE_ONLINE,
+	PRESENCE_OFFLINE,
+};
+
+/* Presence of the character of the same index, see struct logs_presence */
+struct presence {
+	uint32_t since;
+	uint32_t until;
+	uint32_t last_duration;
+	uint32_t sessions;
+	uint64_t total;
+	uint32_t previous; /* in the online list, NO_PRESENCE for the first one */
+	uint32_t next;
+	uint8_t state; /* enum presence_state */
+};
+
+/* Everything readers need lives in a single arena, without any pointer,
+ * so that it can be mapped at any address by other processes (see logs_attach):
+ * the text store, the interned texts and the characters table follow the entries,
+ * at rb_offset, intern_offset (0 if the budget is too small to intern texts) and chars_offset,
+ * then the presence of each character at presence_offset.
+ * An entry whose text is interned holds INTERNED_TEXT | slot as text offset, and a reference on the slot.
+ *
+ * Entries [first_entry, next_entry) are stored, both only ever increase.
+ * They are written by the ingestion thread only, and read by any thread or process:
+ * first_entry is advanced before an evicted entry slot or its text is overwritten,
+ * and next_entry after a new entry is fully written, so that a reader copying an entry
+ * can detect it has been overwritten by checking first_entry again after the copy.
+ *
+ * names_seq is a sequence lock over the characters table: odd while it is being modified.
+ * Readers from other processes retry their lookups until it did not change during the lookup.
+ *
+ * Presences are updated by the ingestion thread as join and leave lines are logged, in O(1):
+ * characters online are doubly linked from online_first, the latest to join first.
+ * presence_seq is the sequence lock of the presences and of that list, for all readers.
+ *
+ * Markers are broadcast to all readers: marker_head is only written by the ingestion thread,
+ * each reader keeps its own tail, and loses the markers overwritten before it popped them.
+ */
+struct logs_arena {
+	uint32_t magic;
+	uint32_t version;
+	size_t size;
 	size_t max_entries;
-	size_t used_entries;
+	size_t first_entry;
 	size_t next_entry;
+	size_t names_seq;
+	size_t rb_size;
+	size_t rb_offset;
+	size_t intern_offset;
+	size_t chars_offset;
+	size_t presence_offset;
+	size_t presence_seq;
+	size_t online_first;
+	size_t online_count;
+	struct logs_metrics metrics;
+	size_t marker_head;
+	struct logs_marker markers[MAX_MARKERS];
+	struct entry entries[];
+};
+
+/* Process local part: the log file reader, the ingestion thread, and what depends on the mapping address.
+ * Characters are shared by the parser and the interfaces of the ingesting process, chars_lock serializes them.
+ * The ingestion thread holds ingest_lock while it reads and parses, so that snapshots see a consistent state.
+ */
+struct logs {
+	struct logs_arena *arena;
+	struct textstore *ts;
+	struct textstore_cache *text_cache; /* cold blocks decoded by this process */
+	struct intern *intern;
+	struct characters *chars;
+	struct presence *presence;
+	_Bool readonly;
+	char *shm_name; /* set if the arena is a shared memory object, which is unlinked on destroy if not readonly */
+	int shm_fd;     /* the process which created the object holds an exclusive lock on it as long as it runs */
+	int logfile;
+	char *path;     /* set by logs_follow */
+	struct archive *archive; /* set by logs_archive, evicted entries are appended to it by the ingestion thread */
+	pthread_mutex_t chars_lock;
+	pthread_mutex_t ingest_lock;
+	pthread_t thread;
+	_Bool started;
+	_Bool running;
+	_Bool stop;
+	_Bool notified;
+	int thread_errno;
+	int notify[2];
+	size_t marker_tail;
+	uint64_t markers_dropped;
 	size_t buf_cursor;
 	char buf[1024];
-	struct entry entries[];
+	struct recent_text {
+		uint32_t hash;
+		size_t entry;
+	} recent[RECENT_TEXTS];
 };
 
-struct logs *logs_create(int logfile, size_t names, size_t rb_size, size_t entries) {
-	if (entries == 0) {
-		return NULL;
+static size_t align_arena(size_t offset) {
+	return ((offset + ARENA_ALIGN - 1) / ARENA_ALIGN) * ARENA_ALIGN;
+}
+
+/* Slots of interned texts taken from the text budget, 0 if it is too small */
+static size_t intern_slots(size_t rb_size) {
+	size_t slots = rb_size / INTERN_SHARE;
+	if ((slots > 0) && ((intern_required_size(slots) + 256) > rb_size)) {
+		slots = 0;
+	}
+	return slots;
+}
+
+static size_t presence_start(size_t chars_offset, size_t names) {
+	return align_arena(chars_offset + characters_required_size(names, CHARACTERS_RBT));
+}
+
+/* Returns the size of the arena */
+static size_t arena_layout(size_t names, size_t rb_size, size_t entries, size_t *rb_offset, size_t *intern_offset, size_t *chars_offset) {
+	size_t slots = intern_slots(rb_size);
+	size_t intern_size = (slots > 0) ? intern_required_size(slots) : 0;
+	*rb_offset = align_arena(sizeof(struct logs_arena) + entries * sizeof(struct entry));
+	*intern_offset = align_arena(*rb_offset + textstore_required_size(rb_size - intern_size));
+	*chars_offset = align_arena(*intern_offset + intern_size);
+	if (slots == 0) {
+		*intern_offset = 0;
+	}
+	return align_arena(presence_start(*chars_offset, names) + names * sizeof(struct presence));
+}
+
+/* Returns 0 on success, -1 on failure, the magic number is left for the caller to set once the arena is ready */
+static int arena_init(struct logs_arena *arena, size_t size, size_t names, size_t rb_size, size_t entries) {
+	size_t rb_offset;
+	size_t intern_offset;
+	size_t chars_offset;
+	if ((arena_layout(names, rb_size, entries, &rb_offset, &intern_offset, &chars_offset) > size) || (textstore_alignment() > ARENA_ALIGN)
+			|| (intern_alignment() > ARENA_ALIGN) || (characters_alignment() > ARENA_ALIGN)) {
+		errno = EINVAL;
+		return -1;
+	}
+	arena->magic = 0;
+	arena->version = LOGS_VERSION;
+	arena->size = size;
+	arena->max_entries = entries;
+	arena->first_entry = 0;
+	arena->next_entry = 0;
+	arena->names_seq = 0;
+	arena->rb_size = rb_size;
+	arena->rb_offset = rb_offset;
+	arena->intern_offset = intern_offset;
+	arena->chars_offset = chars_offset;
+	arena->presence_offset = presence_start(chars_offset, names);
+	arena->presence_seq = 0;
+	arena->online_first = NO_PRESENCE;
+	arena->online_count = 0;
+	memset((char *)arena + arena->presence_offset, 0, names * sizeof(struct presence));
+	memset(&arena->metrics, 0, sizeof(arena->metrics));
+	histogram_reset(&arena->metrics.parse_ns);
+	histogram_reset(&arena->metrics.ingest_ns);
+	histogram_reset(&arena->metrics.read_bytes);
+	arena->marker_head = 0;
+	size_t slots = intern_slots(rb_size);
+	if (textstore_init((char *)arena + rb_offset, rb_size - ((slots > 0) ? intern_required_size(slots) : 0)) == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((slots > 0) && (intern_init((char *)arena + intern_offset, slots) == NULL)) {
+		errno = EINVAL;
+		return -1;
 	}
-	struct logs *res = malloc(sizeof(*res) + entries * sizeof(res->entries[0]));
+	if (characters_init((char *)arena + chars_offset, names, CHARACTERS_RBT) == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Build the process local handle of an arena */
+static struct logs *logs_handle(struct logs_arena *arena, int logfile, _Bool readonly) {
+	struct logs *res = malloc(sizeof(*res));
 	if (res == NULL) {
-		return res;
+		return NULL;
 	}
-	res->rb = ringbuffer_create(rb_size);
-	if (res->rb == NULL) {
+	if (pthread_mutex_init(&res->chars_lock, NULL) != 0) {
 		free(res);
 		return NULL;
 	}
-	res->chars = characters_create(names);
-	if (res->chars == NULL) {
-		ringbuffer_destroy(res->rb);
+	if (pthread_mutex_init(&res->ingest_lock, NULL) != 0) {
+		pthread_mutex_destroy(&res->chars_lock);
 		free(res);
 		return NULL;
 	}
+	res->text_cache = textstore_cache_create();
+	if (res->text_cache == NULL) {
+		pthread_mutex_destroy(&res->ingest_lock);
+		pthread_mutex_destroy(&res->chars_lock);
+		free(res);
+		return NULL;
+	}
+	res->arena = arena;
+	res->ts = (struct textstore *)((char *)arena + arena->rb_offset);
+	res->intern = (arena->intern_offset != 0) ? (struct intern *)((char *)arena + arena->intern_offset) : NULL;
+	res->chars = (struct characters *)((char *)arena + arena->chars_offset);
+	res->presence = (struct presence *)((char *)arena + arena->presence_offset);
+	res->readonly = readonly;
+	res->shm_name = NULL;
+	res->shm_fd = -1;
 	res->logfile = logfile;
-	res->used_entries = 0;
-	res->next_entry = 0;
+	res->path = NULL;
+	res->archive = NULL;
+	res->started = 0;
+	res->running = 0;
+	res->stop = 0;
+	res->notified = 0;
+	res->thread_errno = 0;
+	res->notify[0] = -1;
+	res->notify[1] = -1;
+	/* Readers only get the markers issued after they attached */
+	res->marker_tail = __atomic_load_n(&arena->marker_head, __ATOMIC_ACQUIRE);
+	res->markers_dropped = 0;
 	res->buf_cursor = 0;
-	res->max_entries = entries;
+	memset(res->recent, 0, sizeof(res->recent));
+	return res;
+}
+
+struct logs *logs_create(int logfile, size_t names, size_t rb_size, size_t entries) {
+	if ((entries == 0) || (rb_size == 0)) {
+		return NULL;
+	}
+	size_t rb_offset;
+	size_t intern_offset;
+	size_t chars_offset;
+	size_t size = arena_layout(names, rb_size, entries, &rb_offset, &intern_offset, &chars_offset);
+	struct logs_arena *arena = NULL;
+	if (posix_memalign((void **)&arena, ARENA_ALIGN, size) != 0) {
+		return NULL;
+	}
+	if (arena_init(arena, size, names, rb_size, entries) != 0) {
+		free(arena);
+		return NULL;
+	}
+	arena->magic = LOGS_MAGIC;
+	struct logs *res = logs_handle(arena, logfile, 0);
+	if (res == NULL) {
+		free(arena);
+		return NULL;
+	}
+	return res;
+}
+
+/* Returns 1 if nobody holds the lock of the process which created the shared memory object [fd] */
+static _Bool owner_gone(int fd) {
+	return flock(fd, LOCK_SH | LOCK_NB) == 0;
+}
+
+/* Returns 1 if the named shared memory object is left by a process which did not remove it */
+static _Bool stale_arena(const char *name) {
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return 0;
+	}
+	_Bool stale = owner_gone(fd);
+	close(fd);
+	return stale;
+}
+
+struct logs *logs_create_shared(const char *name, int logfile, size_t names, size_t rb_size, size_t entries) {
+	if (name == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+	if ((entries == 0) || (rb_size == 0)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	size_t rb_offset;
+	size_t intern_offset;
+	size_t chars_offset;
+	size_t size = arena_layout(names, rb_size, entries, &rb_offset, &intern_offset, &chars_offset);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if ((fd < 0) && (errno == EEXIST) && stale_arena(name)) {
+		(void)shm_unlink(name);
+		fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd < 0) {
+		return NULL;
+	}
+	struct logs_arena *arena = MAP_FAILED;
+	char *shm_name = strdup(name);
+	if ((shm_name != NULL) && (flock(fd, LOCK_EX | LOCK_NB) == 0) && (ftruncate(fd, size) == 0)) {
+		arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	int err = errno;
+	if (arena == MAP_FAILED) {
+		close(fd);
+		free(shm_name);
+		(void)shm_unlink(name);
+		errno = err;
+		return NULL;
+	}
+	struct logs *res = NULL;
+	if (arena_init(arena, size, names, rb_size, entries) == 0) {
+		res = logs_handle(arena, logfile, 0);
+	}
+	if (res == NULL) {
+		err = errno;
+		munmap(arena, size);
+		close(fd);
+		free(shm_name);
+		(void)shm_unlink(name);
+		errno = err;
+		return NULL;
+	}
+	res->shm_name = shm_name;
+	res->shm_fd = fd;
+	/* Readers may now use the arena */
+	__atomic_store_n(&arena->magic, LOGS_MAGIC, __ATOMIC_RELEASE);
+	return res;
+}
+
+struct logs *logs_attach(const char *name) {
+	if (name == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+	int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(struct logs_arena)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	size_t size = st.st_size;
+	struct logs_arena *arena = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (arena == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	if ((__atomic_load_n(&arena->magic, __ATOMIC_ACQUIRE) != LOGS_MAGIC) || (arena->version != LOGS_VERSION) || (arena->size != size)) {
+		munmap(arena, size);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	char *shm_name = strdup(name);
+	struct logs *res = (shm_name != NULL) ? logs_handle(arena, -1, 1) : NULL;
+	if (res == NULL) {
+		free(shm_name);
+		munmap(arena, size);
+		close(fd);
+		errno = ENOMEM;
+		return NULL;
+	}
+	res->shm_name = shm_name;
+	res->shm_fd = fd;
 	return res;
 }
 
 void logs_destroy(struct logs *logs) {
 	if (logs != NULL) {
-		if (logs->chars != NULL) {
-			characters_destroy(logs->chars);
-		}
-		if (logs->rb != NULL) {
-			ringbuffer_destroy(logs->rb);
+		(void)logs_stop(logs);
+		archive_close(logs->archive);
+		textstore_cache_destroy(logs->text_cache);
+		pthread_mutex_destroy(&logs->ingest_lock);
+		free(logs->path);
+		pthread_mutex_destroy(&logs->chars_lock);
+		if (logs->shm_name != NULL) {
+			munmap(logs->arena, logs->arena->size);
+			if (!logs->readonly) {
+				(void)shm_unlink(logs->shm_name);
+			}
+			close(logs->shm_fd);
+			free(logs->shm_name);
+		} else if (logs->arena != NULL) {
+			free(logs->arena);
 		}
 		memset(logs, 0, sizeof(*logs));
 		free(logs);
@@ -61,65 +446,774 @@ void logs_destroy(struct logs *logs) {
 	return;
 }
 
+/* Sequence locks, for a single writer at a time */
+static void seq_write_begin(size_t *seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	atomic_thread_fence(memory_order_release);
+	return;
+}
+
+static void seq_write_end(size_t *seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+/* Readers take a snapshot of the sequence, read, and retry if seq_read_valid returns 0 */
+static size_t seq_read_begin(const size_t *seq) {
+	size_t s;
+	while ((s = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+		sched_yield();
+	}
+	return s;
+}
+
+static _Bool seq_read_valid(const size_t *seq, size_t s) {
+	atomic_thread_fence(memory_order_acquire);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) == s;
+}
+
+/* Called with chars_lock held, around anything which may modify the characters table */
+static void names_write_begin(struct logs *lgs) {
+	seq_write_begin(&lgs->arena->names_seq);
+	return;
+}
+
+static void names_write_end(struct logs *lgs) {
+	seq_write_end(&lgs->arena->names_seq);
+	return;
+}
+
+/* Readers in other processes: take a snapshot of names_seq, do the lookup,
+ * and retry if names_read_valid returns 0.
+ */
+static size_t names_read_begin(const struct logs *lgs) {
+	return seq_read_begin(&lgs->arena->names_seq);
+}
+
+static _Bool names_read_valid(const struct logs *lgs, size_t seq) {
+	return seq_read_valid(&lgs->arena->names_seq, seq);
+}
+
+/* Append the entries [first, end) about to be evicted to the archive */
+static void archive_entries(struct logs *lgs, size_t first, size_t end) {
+	char text[256];
+	pthread_mutex_lock(&lgs->chars_lock);
+	for (size_t i = first; i < end; ++i) {
+		const struct entry *e = &lgs->arena->entries[i % lgs->arena->max_entries];
+		if (logs_get_text(lgs, e->text.offset, e->text.size, text) != 0) {
+			continue;
+		}
+		(void)archive_append(lgs->archive, i, e, text, characters_name(lgs->chars, e->src));
+	}
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return;
+}
+
+/* Discard the entries before [first] */
+static void evict(struct logs *lgs, size_t first) {
+	if (first == lgs->arena->first_entry) {
+		return;
+	}
+	if (lgs->archive != NULL) {
+		archive_entries(lgs, lgs->arena->first_entry, first);
+	}
+	size_t old_first = lgs->arena->first_entry;
+	lgs->arena->metrics.entries_evicted += first - old_first;
+	/* Publish the eviction before overwriting anything */
+	__atomic_store_n(&lgs->arena->first_entry, first, __ATOMIC_RELAXED);
+	atomic_thread_fence(memory_order_release);
+	for (size_t i = old_first; i < first; ++i) {
+		size_t offset = lgs->arena->entries[i % lgs->arena->max_entries].text.offset;
+		if (offset & INTERNED_TEXT) {
+			intern_unref(lgs->intern, offset & ~INTERNED_TEXT);
+		}
+	}
+	return;
+}
+
+/* Called by the text store before it drops the texts below [start]:
+ * entries are evicted up to the last one whose text is dropped, those with interned texts included.
+ */
+static void drop_texts(void *ctx, size_t start) {
+	struct logs *lgs = ctx;
+	size_t first = lgs->arena->first_entry;
+	for (size_t i = first; i < lgs->arena->next_entry; ++i) {
+		size_t offset = lgs->arena->entries[i % lgs->arena->max_entries].text.offset;
+		if (offset & INTERNED_TEXT) {
+			continue;
+		}
+		if (textstore_position(lgs->ts, offset) >= start) {
+			break;
+		}
+		first = i + 1;
+	}
+	evict(lgs, first);
+	return;
+}
+
+/* Store the text of entry [index] as an interned text if it repeats a retained one, and set its offset.
+ * Returns 0 if it is interned, -1 if it is to be stored.
+ */
+static int intern_text(struct logs *lgs, const char *text, size_t size, size_t index, size_t *offset) {
+	if ((lgs->intern == NULL) || (size < MIN_INTERNED)) {
+		return -1;
+	}
+	uint32_t hash = intern_hash(text, size);
+	size_t slot;
+	if (intern_ref(lgs->intern, hash, text, size, &slot) == 0) {
+		*offset = INTERNED_TEXT | slot;
+		return 0;
+	}
+	struct recent_text *r = &lgs->recent[hash % RECENT_TEXTS];
+	if ((r->hash == hash) && (r->entry >= lgs->arena->first_entry) && (r->entry < index)) {
+		/* Repeat of the first occurrence, which is still retained */
+		const struct entry *e = &lgs->arena->entries[r->entry % lgs->arena->max_entries];
+		char first[256];
+		if ((e->text.size == size) && (logs_get_text(lgs, e->text.offset, size, first) == 0) && (memcmp(first, text, size) == 0)
+				&& (intern_add(lgs->intern, hash, text, size, r->entry, &slot) == 0)) {
+			*offset = INTERNED_TEXT | slot;
+			return 0;
+		}
+	}
+	r->hash = hash;
+	r->entry = index;
+	return -1;
+}
+
+static void online_remove(struct logs *lgs, size_t src) {
+	struct presence *p = &lgs->presence[src];
+	if (p->previous == NO_PRESENCE) {
+		lgs->arena->online_first = p->next;
+	} else {
+		lgs->presence[p->previous].next = p->next;
+	}
+	if (p->next != NO_PRESENCE) {
+		lgs->presence[p->next].previous = p->previous;
+	}
+	--lgs->arena->online_count;
+	return;
+}
+
+static void online_push(struct logs *lgs, size_t src) {
+	struct presence *p = &lgs->presence[src];
+	p->previous = NO_PRESENCE;
+	p->next = lgs->arena->online_first;
+	if (p->next != NO_PRESENCE) {
+		lgs->presence[p->next].previous = src;
+	}
+	lgs->arena->online_first = src;
+	++lgs->arena->online_count;
+	return;
+}
+
+/* Called by the ingestion thread for each logged entry */
+static void track_presence(struct logs *lgs, const struct entry *entry) {
+	if (((entry->chan != chan_in) && (entry->chan != chan_out)) || (entry->src >= characters_max_names(lgs->chars))) {
+		return;
+	}
+	struct presence *p = &lgs->presence[entry->src];
+	seq_write_begin(&lgs->arena->presence_seq);
+	if (p->state == PRESENCE_ONLINE) {
+		online_remove(lgs, entry->src);
+	}
+	if (entry->chan == chan_in) {
+		/* Joining again without a leave line starts a new session, the previous one is lost */
+		p->since = entry->time;
+		p->state = PRESENCE_ONLINE;
+		online_push(lgs, entry->src);
+	} else {
+		p->last_duration = LOGS_NO_DURATION;
+		if (p->state == PRESENCE_ONLINE) {
+			/* Times are in the day, sessions are less than a day long */
+			p->last_duration = (entry->time + DAY_SECONDS - p->since) % DAY_SECONDS;
+			p->total += p->last_duration;
+			++p->sessions;
+		}
+		p->until = entry->time;
+		p->state = PRESENCE_OFFLINE;
+	}
+	seq_write_end(&lgs->arena->presence_seq);
+	return;
+}
+
 static void add_to_logs(struct logs *lgs, const char *text, const struct entry *entry) {
-	size_t start = ringbuffer_offset(lgs->rb);
-	size_t next_start = start + ringbuffer_written(lgs->rb);
-	size_t free_space = ringbuffer_size(lgs->rb) - ringbuffer_written(lgs->rb);
-	size_t to_be_erased = 0;
-	if (lgs->used_entries == lgs->max_entries) {
-		/* Clear oldest entry */
-		to_be_erased += lgs->entries[lgs->next_entry % lgs->max_entries].text.size;
-		--lgs->used_entries;
+	size_t next = lgs->arena->next_entry;
+	if ((next - lgs->arena->first_entry) == lgs->arena->max_entries) {
+		/* Clear oldest entry, its text is dropped along with older ones */
+		evict(lgs, lgs->arena->first_entry + 1);
+	}
+	size_t position;
+	if (intern_text(lgs, text + entry->text.offset, entry->text.size, next, &position) != 0) {
+		if (textstore_append(lgs->ts, text + entry->text.offset, entry->text.size, &position, drop_texts, lgs) != 0) {
+			++lgs->arena->metrics.dropped_size;
+			return;
+		}
+		/* Only the low bits are kept, below the interned flag */
+		position &= INTERNED_TEXT - 1;
+	}
+	lgs->arena->entries[next % lgs->arena->max_entries] = *entry;
+	lgs->arena->entries[next % lgs->arena->max_entries].text.offset = position;
+	track_presence(lgs, entry);
+	__atomic_store_n(&lgs->arena->next_entry, next + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+/* Returns 1 if the line is a latency marker, 0 otherwise */
+static _Bool read_marker(struct logs *lgs, const char *line, size_t size) {
+	size_t psize = sizeof(LOGS_MARKER_PREFIX) - 1;
+	if ((size <= psize) || (memcmp(line, LOGS_MARKER_PREFIX, psize) != 0)) {
+		return 0;
+	}
+	char text[64];
+	size -= psize;
+	if (size >= sizeof(text)) {
+		size = sizeof(text) - 1;
+	}
+	memcpy(text, line + psize, size);
+	text[size] = '\0';
+	struct logs_marker m;
+	if (sscanf(text, "%" SCNu64 " %" SCNu64, &m.seq, &m.write_ns) != 2) {
+		return 1;
+	}
+	m.ingest_ns = metrics_now();
+	m.entry = lgs->arena->next_entry;
+	++lgs->arena->metrics.markers;
+	histogram_record(&lgs->arena->metrics.ingest_ns, m.ingest_ns - m.write_ns);
+	size_t head = lgs->arena->marker_head;
+	/* Readers still holding the overwritten marker see marker_head >= head once they read any part of the new one */
+	atomic_thread_fence(memory_order_release);
+	lgs->arena->markers[head % MAX_MARKERS] = m;
+	__atomic_store_n(&lgs->arena->marker_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+int logs_pop_marker(struct logs *lgs, size_t before_entry, struct logs_marker *marker) {
+	if ((lgs == NULL) || (marker == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	while (1) {
+		size_t head = __atomic_load_n(&lgs->arena->marker_head, __ATOMIC_ACQUIRE);
+		if (lgs->marker_tail == head) {
+			errno = ENOENT;
+			return -1;
+		}
+		if ((head - lgs->marker_tail) > MAX_MARKERS) {
+			/* Not consumed fast enough */
+			lgs->markers_dropped += head - lgs->marker_tail - MAX_MARKERS;
+			lgs->marker_tail = head - MAX_MARKERS;
+		}
+		struct logs_marker m = lgs->arena->markers[lgs->marker_tail % MAX_MARKERS];
+		atomic_thread_fence(memory_order_acquire);
+		if ((__atomic_load_n(&lgs->arena->marker_head, __ATOMIC_RELAXED) - lgs->marker_tail) >= MAX_MARKERS) {
+			/* Overwritten while being copied */
+			continue;
+		}
+		if (m.entry >= before_entry) {
+			errno = ENOENT;
+			return -1;
+		}
+		*marker = m;
+		++lgs->marker_tail;
+		return 0;
+	}
+}
+
+/* Called at the end of the log file: if it has been truncated, or replaced by another one
+ * and everything has been read from the previous one, restart from the start of the new content.
+ * Returns 0 if so, 1 if there is still nothing to read, -1 on failure.
+ */
+static int check_file(struct logs *lgs) {
+	struct stat st;
+	if (fstat(lgs->logfile, &st) != 0) {
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		return 1;
+	}
+	off_t pos = lseek(lgs->logfile, 0, SEEK_CUR);
+	if (pos < 0) {
+		return -1;
+	}
+	if (pos > st.st_size) {
+		if (lseek(lgs->logfile, 0, SEEK_SET) < 0) {
+			return -1;
+		}
+		/* The partial line read belongs to the previous content */
+		lgs->buf_cursor = 0;
+		++lgs->arena->metrics.truncations;
+		return 0;
+	}
+	struct stat named;
+	if ((lgs->path == NULL) || (pos < st.st_size) || (stat(lgs->path, &named) != 0)) {
+		return 1;
+	}
+	if ((named.st_dev == st.st_dev) && (named.st_ino == st.st_ino)) {
+		return 1;
+	}
+	int fd = open(lgs->path, O_RDONLY);
+	if (fd < 0) {
+		/* Maybe not created yet */
+		return 1;
+	}
+	int r = dup2(fd, lgs->logfile);
+	close(fd);
+	if (r < 0) {
+		return -1;
+	}
+	lgs->buf_cursor = 0;
+	++lgs->arena->metrics.rotations;
+	return 0;
+}
+
+int logs_follow(struct logs *lgs, const char *path) {
+	if ((lgs == NULL) || (path == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if (lgs->started) {
+		errno = EBUSY;
+		return -1;
+	}
+	char *p = strdup(path);
+	if (p == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	free(lgs->path);
+	lgs->path = p;
+	return 0;
+}
+
+int logs_refresh(struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		errno = EROFS;
+		return -1;
+	}
+	ssize_t rd = read(lgs->logfile, lgs->buf + lgs->buf_cursor, sizeof(lgs->buf) - lgs->buf_cursor);
+	++lgs->arena->metrics.refreshes;
+	if (rd < 0) {
+		return -1;
+	}
+	TRACE(trace_refresh, rd, lgs->arena->next_entry);
+	if (rd == 0) {
+		return check_file(lgs);
+	}
+	lgs->arena->metrics.bytes_read += rd;
+	histogram_record(&lgs->arena->metrics.read_bytes, rd);
+	size_t bc = 0;
+	while (1) {
+		while ((rd > 0) && (lgs->buf[lgs->buf_cursor] != '\n')) {
+			++lgs->buf_cursor;
+			--rd;
+		}
+		if (rd <= 0) {
+			memmove(lgs->buf, lgs->buf + bc, lgs->buf_cursor - bc);
+			lgs->buf_cursor -= bc;
+			return 0;
+		} else {
+			if (read_marker(lgs, lgs->buf + bc, lgs->buf_cursor - bc)) {
+				++lgs->buf_cursor;
+				--rd;
+				bc = lgs->buf_cursor;
+				continue;
+			}
+			struct entry e;
+			uint64_t start = metrics_now();
+			pthread_mutex_lock(&lgs->chars_lock);
+			names_write_begin(lgs);
+			errno = 0;
+			int r = entry_parser(lgs->chars, lgs->buf + bc, lgs->buf_cursor - bc, &e);
+			int err = errno;
+			names_write_end(lgs);
+			pthread_mutex_unlock(&lgs->chars_lock);
+			histogram_record(&lgs->arena->metrics.parse_ns, metrics_now() - start);
+			++lgs->arena->metrics.lines_read;
+			if ((r == 0) && (e.text.size <= textstore_size(lgs->ts))) {
+				if ((e.text.size > 0) && (lgs->buf[bc + e.text.offset + e.text.size - 1] == '\r')) {
+					--e.text.size;
+				}
+				add_to_logs(lgs, lgs->buf + bc, &e);
+				++lgs->arena->metrics.entries_added;
+				TRACE(trace_entry_added, lgs->arena->next_entry - 1, e.text.size);
+			} else {
+				if (r == 0) {
+					err = EMSGSIZE;
+					++lgs->arena->metrics.dropped_size;
+				} else if (err == ENOSPC) {
+					++lgs->arena->metrics.dropped_names;
+				} else {
+					++lgs->arena->metrics.dropped_parse;
+				}
+				TRACE(trace_entry_dropped, lgs->buf_cursor - bc, err);
+			}
+			++lgs->buf_cursor;
+			--rd;
+			bc = lgs->buf_cursor;
+		}
+	}
+}
+
+/* Sources of the worker tables already bound in the logs table, index worker * names + source */
+struct import_ctx {
+	struct logs *lgs;
+	const char *text;
+	size_t names;
+	size_t *remap;
+};
+
+#define UNMAPPED ((size_t)-1)
+
+static int import_batch(void *ctx, const struct parsed_batch *batch) {
+	struct import_ctx *ic = ctx;
+	struct logs *lgs = ic->lgs;
+	size_t *remap = ic->remap + batch->worker * ic->names;
+	lgs->arena->metrics.lines_read += batch->lines;
+	lgs->arena->metrics.dropped_parse += batch->dropped_parse;
+	lgs->arena->metrics.dropped_names += batch->dropped_names;
+	for (size_t i = 0; i < batch->names_count; ++i) {
+		const struct parsed_name *n = &batch->names[i];
+		size_t src;
+		pthread_mutex_lock(&lgs->chars_lock);
+		names_write_begin(lgs);
+		int r = characters_hash(lgs->chars, n->name, &src);
+		names_write_end(lgs);
+		pthread_mutex_unlock(&lgs->chars_lock);
+		if ((r == 0) && (n->src < ic->names)) {
+			remap[n->src] = src;
+		}
+	}
+	for (size_t i = 0; i < batch->count; ++i) {
+		struct entry e = batch->items[i].entry;
+		const char *line = ic->text + batch->items[i].line;
+		/* Sources are listed in the batch of their first entry, unmapped ones could not be indexed */
+		if ((e.src >= ic->names) || (remap[e.src] == UNMAPPED)) {
+			++lgs->arena->metrics.dropped_names;
+			continue;
+		}
+		e.src = remap[e.src];
+		if (e.text.size > textstore_size(lgs->ts)) {
+			++lgs->arena->metrics.dropped_size;
+			continue;
+		}
+		if ((e.text.size > 0) && (line[e.text.offset + e.text.size - 1] == '\r')) {
+			--e.text.size;
+		}
+		add_to_logs(lgs, line, &e);
+		++lgs->arena->metrics.entries_added;
+	}
+	return 0;
+}
+
+int logs_import(struct logs *lgs, size_t threads) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if (lgs->started || (lgs->buf_cursor != 0)) {
+		errno = EBUSY;
+		return -1;
+	}
+	struct stat st;
+	if (fstat(lgs->logfile, &st) != 0) {
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode)) {
+		errno = ESPIPE;
+		return -1;
+	}
+	off_t pos = lseek(lgs->logfile, 0, SEEK_CUR);
+	if (pos < 0) {
+		return -1;
+	}
+	if (st.st_size <= pos) {
+		return 0;
+	}
+	size_t size = st.st_size;
+	char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, lgs->logfile, 0);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	(void)madvise(map, size, MADV_SEQUENTIAL);
+	/* A partial last line is left to logs_refresh */
+	size_t end = size;
+	while ((end > (size_t)pos) && (map[end - 1] != '\n')) {
+		--end;
+	}
+	struct import_ctx ic = {
+		.lgs = lgs,
+		.text = map + pos,
+		.names = characters_max_names(lgs->chars),
+		.remap = NULL,
+	};
+	if (threads == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0) ? cpus : 1;
+	}
+	int res = 0;
+	if (end > (size_t)pos) {
+		ic.remap = malloc(threads * ic.names * sizeof(ic.remap[0]));
+		if (ic.remap == NULL) {
+			munmap(map, size);
+			errno = ENOMEM;
+			return -1;
+		}
+		for (size_t i = 0; i < threads * ic.names; ++i) {
+			ic.remap[i] = UNMAPPED;
+		}
+		res = bulk_parse(map + pos, end - pos, threads, ic.names, import_batch, &ic);
+	}
+	int err = errno;
+	free(ic.remap);
+	munmap(map, size);
+	if (res != 0) {
+		errno = err;
+		return -1;
+	}
+	lgs->arena->metrics.bytes_read += end - pos;
+	if (lseek(lgs->logfile, end, SEEK_SET) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+/* The arena, preceded by this header, in host byte order */
+struct snapshot_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t arena_size;
+	uint64_t log_offset; /* first byte of the log file not parsed yet */
+	uint64_t log_dev;    /* identity of the log file */
+	uint64_t log_ino;
+	uint64_t line_start; /* last line parsed, [line_start, log_offset) */
+	uint64_t line_hash;
+	uint64_t checksum;   /* of the arena */
+};
+
+/* FNV-1a */
+static uint64_t checksum(const void *data, size_t size) {
+	const unsigned char *d = data;
+	uint64_t h = 0xcbf29ce484222325u;
+	for (size_t i = 0; i < size; ++i) {
+		h = (h ^ d[i]) * 0x100000001b3u;
+	}
+	return h;
+}
+
+static int full_write(int fd, const void *data, size_t size) {
+	const char *d = data;
+	while (size > 0) {
+		ssize_t w = write(fd, d, size);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		d += w;
+		size -= w;
+	}
+	return 0;
+}
+
+static int full_read(int fd, void *data, size_t size) {
+	char *d = data;
+	while (size > 0) {
+		ssize_t r = read(fd, d, size);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (r == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		d += r;
+		size -= r;
+	}
+	return 0;
+}
+
+/* Locate the line of the log file ending at [offset], returns -1 if it cannot be read */
+static int last_line(int fd, uint64_t offset, uint64_t *start, uint64_t *hash) {
+	char line[sizeof(((struct logs *)NULL)->buf)];
+	size_t size = (offset < sizeof(line)) ? offset : sizeof(line);
+	ssize_t r = pread(fd, line, size, offset - size);
+	if ((r < 0) || ((size_t)r != size)) {
+		return -1;
+	}
+	/* line[size - 1] is the end of the line */
+	size_t s = (size > 0) ? size - 1 : 0;
+	while ((s > 0) && (line[s - 1] != '\n')) {
+		--s;
+	}
+	*start = offset - size + s;
+	*hash = checksum(line + s, size - s);
+	return 0;
+}
+
+int logs_snapshot(struct logs *lgs, const char *path) {
+	if ((lgs == NULL) || (path == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		errno = EROFS;
+		return -1;
+	}
+	size_t size = lgs->arena->size;
+	char *copy = malloc(size);
+	size_t tsize = strlen(path) + sizeof(".tmp");
+	char *tmp = malloc(tsize);
+	if ((copy == NULL) || (tmp == NULL)) {
+		free(tmp);
+		free(copy);
+		errno = ENOMEM;
+		return -1;
+	}
+	struct snapshot_header h = {
+		.magic = SNAPSHOT_MAGIC,
+		.version = SNAPSHOT_VERSION,
+		.arena_size = size,
+	};
+	struct stat log;
+	/* Ingestion only pauses during the copy */
+	pthread_mutex_lock(&lgs->ingest_lock);
+	pthread_mutex_lock(&lgs->chars_lock);
+	memcpy(copy, lgs->arena, size);
+	off_t pos = lseek(lgs->logfile, 0, SEEK_CUR);
+	int r = -1;
+	if ((pos >= 0) && (fstat(lgs->logfile, &log) == 0)) {
+		h.log_offset = pos - lgs->buf_cursor;
+		r = last_line(lgs->logfile, h.log_offset, &h.line_start, &h.line_hash);
 	}
-	while ((free_space + to_be_erased) < entry->text.size) {
-		to_be_erased += lgs->entries[(lgs->next_entry - lgs->used_entries) % lgs->max_entries].text.size;
-		--lgs->used_entries;
+	pthread_mutex_unlock(&lgs->chars_lock);
+	pthread_mutex_unlock(&lgs->ingest_lock);
+	int res = -1;
+	int fd = -1;
+	if (r == 0) {
+		h.log_dev = log.st_dev;
+		h.log_ino = log.st_ino;
+		h.checksum = checksum(copy, size);
+		snprintf(tmp, tsize, "%s.tmp", path);
+		fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if ((fd >= 0) && (full_write(fd, &h, sizeof(h)) == 0) && (full_write(fd, copy, size) == 0) && (fsync(fd) == 0)) {
+			res = 0;
+		}
 	}
-	ringbuffer_erase(lgs->rb, start, to_be_erased);
-	(void)ringbuffer_write(lgs->rb, next_start, text + entry->text.offset, entry->text.size);
-	lgs->entries[lgs->next_entry % lgs->max_entries] = *entry;
-	lgs->entries[lgs->next_entry % lgs->max_entries].text.offset = next_start;
-	++lgs->next_entry;
-	++lgs->used_entries;
-	return;
+	int err = errno;
+	if (fd >= 0) {
+		close(fd);
+		/* Either the previous snapshot or the new one, never a partial one */
+		if ((res == 0) && (rename(tmp, path) != 0)) {
+			err = errno;
+			res = -1;
+		}
+		if (res != 0) {
+			unlink(tmp);
+		}
+	}
+	free(tmp);
+	free(copy);
+	errno = err;
+	return res;
 }
 
-int logs_refresh(struct logs *lgs) {
-	if (lgs == NULL) {
+int logs_restore(struct logs *lgs, const char *path) {
+	if ((lgs == NULL) || (path == NULL)) {
 		errno = EFAULT;
 		return -1;
 	}
-	ssize_t rd = read(lgs->logfile, lgs->buf + lgs->buf_cursor, sizeof(lgs->buf) - lgs->buf_cursor);
-	if (rd < 0) {
+	if (lgs->readonly) {
+		errno = EROFS;
 		return -1;
 	}
-        if (rd == 0) {
-		return 1;
+	if (lgs->started || (lgs->buf_cursor != 0)) {
+		errno = EBUSY;
+		return -1;
 	}
-	size_t bc = 0;
-	while (1) {
-		while ((rd > 0) && (lgs->buf[lgs->buf_cursor] != '\n')) {
-			++lgs->buf_cursor;
-			--rd;
-		}
-		if (rd <= 0) {
-			memmove(lgs->buf, lgs->buf + bc, lgs->buf_cursor - bc);
-			lgs->buf_cursor -= bc;
-			return 0;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct logs_arena *arena = lgs->arena;
+	struct snapshot_header h;
+	struct stat st;
+	struct stat log;
+	if ((full_read(fd, &h, sizeof(h)) != 0) || (fstat(fd, &st) != 0) || (fstat(lgs->logfile, &log) != 0)) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+	if ((h.magic != SNAPSHOT_MAGIC) || (h.version != SNAPSHOT_VERSION) || (h.arena_size != arena->size)
+			|| ((uint64_t)st.st_size != (sizeof(h) + h.arena_size))) {
+		/* Not a snapshot, or of an engine of another size */
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	size_t names = characters_max_names(lgs->chars);
+	size_t rb_size = arena->rb_size;
+	size_t max_entries = arena->max_entries;
+	size_t rb_offset = arena->rb_offset;
+	size_t intern_offset = arena->intern_offset;
+	size_t chars_offset = arena->chars_offset;
+	size_t presence_offset = arena->presence_offset;
+	uint32_t magic = arena->magic;
+	int r = full_read(fd, arena, h.arena_size);
+	int err = errno;
+	close(fd);
+	/* Positions start over with the restored store */
+	textstore_cache_clear(lgs->text_cache);
+	memset(lgs->recent, 0, sizeof(lgs->recent));
+	if ((r == 0) && ((checksum(arena, h.arena_size) != h.checksum) || (arena->magic != magic) || (arena->version != LOGS_VERSION)
+			|| (arena->max_entries != max_entries) || (arena->rb_offset != rb_offset) || (arena->intern_offset != intern_offset)
+			|| (arena->chars_offset != chars_offset) || (arena->presence_offset != presence_offset))) {
+		r = -1;
+		err = EINVAL;
+	}
+	uint64_t offset = h.log_offset;
+	uint64_t start;
+	uint64_t hash;
+	if ((r == 0) && ((h.log_offset > (uint64_t)log.st_size) || (last_line(lgs->logfile, h.log_offset, &start, &hash) != 0)
+			|| (start != h.line_start) || (hash != h.line_hash))) {
+		/* Not the content the snapshot was taken on, it is all new */
+		offset = 0;
+		if ((log.st_dev == h.log_dev) && (log.st_ino == h.log_ino)) {
+			++arena->metrics.truncations;
 		} else {
-			struct entry e;
-			int r = entry_parser(lgs->chars, lgs->buf + bc, lgs->buf_cursor - bc, &e);
-			if ((r == 0) && (e.text.size <= ringbuffer_size(lgs->rb))) {
-				if ((e.text.size > 0) && (lgs->buf[bc + e.text.offset + e.text.size - 1] == '\r')) {
-					--e.text.size;
-				}
-				add_to_logs(lgs, lgs->buf + bc, &e);
-			}
-			++lgs->buf_cursor;
-			--rd;
-			bc = lgs->buf_cursor;
+			++arena->metrics.rotations;
 		}
 	}
+	if ((r == 0) && (lseek(lgs->logfile, offset, SEEK_SET) < 0)) {
+		r = -1;
+		err = errno;
+	}
+	if (r != 0) {
+		/* Back to an empty engine */
+		(void)arena_init(arena, arena->size, names, rb_size, max_entries);
+		arena->magic = magic;
+		errno = err;
+		return -1;
+	}
+	/* Markers were taken with another clock */
+	lgs->marker_tail = arena->marker_head;
+	return 0;
 }
 
 int logs_get_text(const struct logs *lgs, size_t start, size_t size, char *data) {
@@ -127,7 +1221,17 @@ int logs_get_text(const struct logs *lgs, size_t start, size_t size, char *data)
 		errno = EFAULT;
 		return -1;
 	}
-	return ringbuffer_read(lgs->rb, start, data, size);
+	if (start & INTERNED_TEXT) {
+		return intern_read(lgs->intern, start & ~INTERNED_TEXT, data, size);
+	}
+	return textstore_read(lgs->ts, lgs->text_cache, start, size, data);
+}
+
+size_t logs_get_repeat(const struct logs *lgs, const struct entry *entry) {
+	if ((lgs == NULL) || (entry == NULL) || !(entry->text.offset & INTERNED_TEXT)) {
+		return LOGS_NO_REPEAT;
+	}
+	return intern_origin(lgs->intern, entry->text.offset & ~INTERNED_TEXT);
 }
 
 int logs_get_entry(const struct logs *lgs, size_t index, struct entry *entry) {
@@ -139,24 +1243,186 @@ int logs_get_entry(const struct logs *lgs, size_t index, struct entry *entry) {
 		errno = EFAULT;
 		return -1;
 	}
-	if (index >= lgs->next_entry) {
+	if (index >= __atomic_load_n(&lgs->arena->next_entry, __ATOMIC_ACQUIRE)) {
+		errno = EDOM;
+		return -1;
+	}
+	if (__atomic_load_n(&lgs->arena->first_entry, __ATOMIC_ACQUIRE) > index) {
 		errno = EDOM;
 		return -1;
 	}
-	if ((lgs->next_entry - lgs->used_entries) > index) {
+	*entry = lgs->arena->entries[index % lgs->arena->max_entries];
+	return logs_check_entry(lgs, index);
+}
+
+int logs_check_entry(const struct logs *lgs, size_t index) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	/* Order the reads of the entry before the check */
+	atomic_thread_fence(memory_order_acquire);
+	if (__atomic_load_n(&lgs->arena->first_entry, __ATOMIC_RELAXED) > index) {
 		errno = EDOM;
 		return -1;
 	}
-	*entry = lgs->entries[index % lgs->max_entries];
 	return 0;
 }
 
+int logs_get_entries(const struct logs *lgs, size_t first, size_t count, struct logs_run runs[2]) {
+	if ((lgs == NULL) || (runs == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	size_t stored;
+	size_t next;
+	logs_get_range(lgs, &stored, &next);
+	size_t end = (count < (SIZE_MAX - first)) ? first + count : SIZE_MAX;
+	if (end > next) {
+		end = next;
+	}
+	if (first < stored) {
+		first = stored;
+	}
+	if (first >= end) {
+		return 0;
+	}
+	size_t max = lgs->arena->max_entries;
+	size_t pos = first % max;
+	size_t n = end - first;
+	size_t head = (n < (max - pos)) ? n : max - pos;
+	runs[0] = (struct logs_run){ .first = first, .count = head, .entries = &lgs->arena->entries[pos] };
+	if (head == n) {
+		return 1;
+	}
+	runs[1] = (struct logs_run){ .first = first + head, .count = n - head, .entries = &lgs->arena->entries[0] };
+	return 2;
+}
+
+void logs_get_range(const struct logs *lgs, size_t *first, size_t *next) {
+	if ((lgs == NULL) || (first == NULL) || (next == NULL)) {
+		return;
+	}
+	size_t f = __atomic_load_n(&lgs->arena->first_entry, __ATOMIC_ACQUIRE);
+	size_t n = __atomic_load_n(&lgs->arena->next_entry, __ATOMIC_ACQUIRE);
+	if ((n - f) > lgs->arena->max_entries) {
+		/* Entries have been evicted between both reads */
+		f = n - lgs->arena->max_entries;
+	}
+	*first = f;
+	*next = n;
+	return;
+}
+
+int logs_archive(struct logs *lgs, const char *dir) {
+	if ((lgs == NULL) || (dir == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly || lgs->started || (lgs->archive != NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct logs_arena *arena = lgs->arena;
+	if (arena->first_entry != arena->next_entry) {
+		/* Restored from a snapshot: what was archived after it is archived again as the logs are read */
+		lgs->archive = archive_open(dir, arena->first_entry);
+		return (lgs->archive == NULL) ? -1 : 0;
+	}
+	/* A fresh engine continues the archive, its entries are numbered after the archived ones */
+	lgs->archive = archive_open(dir, ARCHIVE_CONTINUE);
+	if (lgs->archive == NULL) {
+		return -1;
+	}
+	size_t first;
+	size_t next;
+	archive_range(lgs->archive, &first, &next);
+	if (next > arena->next_entry) {
+		__atomic_store_n(&arena->first_entry, next, __ATOMIC_RELAXED);
+		__atomic_store_n(&arena->next_entry, next, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+int logs_read_entry(struct logs *lgs, size_t index, struct logs_record *rec) {
+	if ((lgs == NULL) || (rec == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if ((logs_get_entry(lgs, index, &rec->entry) == 0)
+			&& (logs_get_text(lgs, rec->entry.text.offset, rec->entry.text.size, rec->text) == 0)) {
+		if (logs_name_source(lgs, rec->entry.src, rec->source, sizeof(rec->source)) != 0) {
+			rec->source[0] = '\0';
+		}
+		rec->repeat_of = logs_get_repeat(lgs, &rec->entry);
+		if (logs_check_entry(lgs, index) == 0) {
+			return 0;
+		}
+	}
+	rec->repeat_of = LOGS_NO_REPEAT;
+	/* Evicted entries are archived before the eviction is published */
+	if ((lgs->archive != NULL) && (index < logs_get_next_entry(lgs))
+			&& (archive_read(lgs->archive, index, &rec->entry, rec->text, rec->source, sizeof(rec->source)) == 0)) {
+		return 0;
+	}
+	errno = EDOM;
+	return -1;
+}
+
+size_t logs_get_oldest_entry(struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return 0;
+	}
+	size_t first;
+	size_t next;
+	logs_get_range(lgs, &first, &next);
+	if (lgs->archive != NULL) {
+		size_t archived;
+		size_t end;
+		archive_range(lgs->archive, &archived, &end);
+		if ((archived < end) && (archived < first)) {
+			first = archived;
+		}
+	}
+	return first;
+}
+
+int logs_find_time(struct logs *lgs, unsigned int time, size_t *index) {
+	if ((lgs == NULL) || (index == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if ((lgs->archive != NULL) && (archive_find_time(lgs->archive, time, index) == 0)) {
+		return 0;
+	}
+	size_t first;
+	size_t next;
+	logs_get_range(lgs, &first, &next);
+	struct logs_run runs[2];
+	int nruns = logs_get_entries(lgs, first, next - first, runs);
+	/* Entries overwritten during the scan only make the result approximate */
+	for (int r = 0; r < nruns; ++r) {
+		for (size_t i = 0; i < runs[r].count; ++i) {
+			if (runs[r].entries[i].time >= time) {
+				*index = runs[r].first + i;
+				return 0;
+			}
+		}
+	}
+	errno = ENOENT;
+	return -1;
+}
+
 size_t logs_get_used_entries(const struct logs *lgs) {
 	if (lgs == NULL) {
 		errno = EFAULT;
 		return -1;
 	}
-	return lgs->used_entries;
+	size_t first;
+	size_t next;
+	logs_get_range(lgs, &first, &next);
+	return next - first;
 }
 
 size_t logs_get_next_entry(const struct logs *lgs) {
@@ -164,7 +1430,65 @@ size_t logs_get_next_entry(const struct logs *lgs) {
 		errno = EFAULT;
 		return -1;
 	}
-	return lgs->next_entry;
+	return __atomic_load_n(&lgs->arena->next_entry, __ATOMIC_ACQUIRE);
+}
+
+size_t logs_get_max_entries(const struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return 0;
+	}
+	return lgs->arena->max_entries;
+}
+
+const struct logs_metrics *logs_get_metrics(const struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return NULL;
+	}
+	return &lgs->arena->metrics;
+}
+
+void logs_get_ring_usage(const struct logs *lgs, size_t *used, size_t *size) {
+	if ((lgs == NULL) || (used == NULL) || (size == NULL)) {
+		return;
+	}
+	textstore_usage(lgs->ts, used, size);
+	return;
+}
+
+void logs_dump_metrics(const struct logs *lgs, int fd) {
+	if (lgs == NULL) {
+		return;
+	}
+	const struct logs_metrics *m = &lgs->arena->metrics;
+	metrics_dump_counter(fd, "logs", "refreshes", m->refreshes);
+	metrics_dump_counter(fd, "logs", "bytes_read", m->bytes_read);
+	metrics_dump_counter(fd, "logs", "lines_read", m->lines_read);
+	metrics_dump_counter(fd, "logs", "entries_added", m->entries_added);
+	metrics_dump_counter(fd, "logs", "dropped_parse", m->dropped_parse);
+	metrics_dump_counter(fd, "logs", "dropped_names", m->dropped_names);
+	metrics_dump_counter(fd, "logs", "dropped_size", m->dropped_size);
+	metrics_dump_counter(fd, "logs", "entries_evicted", m->entries_evicted);
+	metrics_dump_counter(fd, "logs", "entries_used", logs_get_used_entries(lgs));
+	metrics_dump_counter(fd, "logs", "entries_max", lgs->arena->max_entries);
+	metrics_dump_counter(fd, "logs", "online", __atomic_load_n(&lgs->arena->online_count, __ATOMIC_RELAXED));
+	size_t ring_used;
+	size_t ring_size;
+	textstore_usage(lgs->ts, &ring_used, &ring_size);
+	metrics_dump_counter(fd, "logs", "ring_used", ring_used);
+	metrics_dump_counter(fd, "logs", "ring_size", ring_size);
+	metrics_dump_counter(fd, "logs", "markers", m->markers);
+	metrics_dump_counter(fd, "logs", "truncations", m->truncations);
+	metrics_dump_counter(fd, "logs", "rotations", m->rotations);
+	metrics_dump_counter(fd, "logs", "markers_dropped", lgs->markers_dropped);
+	metrics_dump_histogram(fd, "logs", "parse_ns", &m->parse_ns);
+	metrics_dump_histogram(fd, "logs", "ingest_ns", &m->ingest_ns);
+	metrics_dump_histogram(fd, "logs", "read_bytes", &m->read_bytes);
+	textstore_dump_metrics(lgs->ts, lgs->text_cache, fd);
+	intern_dump_metrics(lgs->intern, fd);
+	archive_dump_metrics(lgs->archive, fd);
+	return;
 }
 
 int logs_index_source(struct logs *lgs, const char *name, size_t *index) {
@@ -172,7 +1496,46 @@ int logs_index_source(struct logs *lgs, const char *name, size_t *index) {
 		errno = EFAULT;
 		return -1;
 	}
-	return characters_hash(lgs->chars, name, index);
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			r = characters_find(lgs->chars, name, index);
+		} while (!names_read_valid(lgs, seq));
+		if ((r != 0) && (errno == ENOENT)) {
+			/* Only the ingestor can make it known */
+			errno = EROFS;
+		}
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	names_write_begin(lgs);
+	r = characters_hash(lgs->chars, name, index);
+	names_write_end(lgs);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
+}
+
+int logs_index_sources(struct logs *lgs, const char *const *names, size_t count, size_t *indexes) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		for (size_t i = 0; i < count; ++i) {
+			if (logs_index_source(lgs, names[i], &indexes[i]) != 0) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	names_write_begin(lgs);
+	int r = characters_hash_all(lgs->chars, names, count, indexes);
+	names_write_end(lgs);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
 }
 
 int logs_deindex_source(struct logs *lgs, size_t index) {
@@ -180,7 +1543,27 @@ int logs_deindex_source(struct logs *lgs, size_t index) {
 		errno = EFAULT;
 		return -1;
 	}
-	return characters_unhash(lgs->chars, index);
+	if (lgs->readonly) {
+		errno = EROFS;
+		return -1;
+	}
+	/* The presence of the character is forgotten along with it, the ingestion thread is paused meanwhile */
+	pthread_mutex_lock(&lgs->ingest_lock);
+	pthread_mutex_lock(&lgs->chars_lock);
+	names_write_begin(lgs);
+	int r = characters_unhash(lgs->chars, index);
+	names_write_end(lgs);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	if ((r == 0) && (index < characters_max_names(lgs->chars))) {
+		seq_write_begin(&lgs->arena->presence_seq);
+		if (lgs->presence[index].state == PRESENCE_ONLINE) {
+			online_remove(lgs, index);
+		}
+		memset(&lgs->presence[index], 0, sizeof(lgs->presence[index]));
+		seq_write_end(&lgs->arena->presence_seq);
+	}
+	pthread_mutex_unlock(&lgs->ingest_lock);
+	return r;
 }
 
 int logs_name_source(struct logs *lgs, size_t index, char *name, size_t max_name_size) {
@@ -188,7 +1571,45 @@ int logs_name_source(struct logs *lgs, size_t index, char *name, size_t max_name
 		errno = EFAULT;
 		return -1;
 	}
-	return characters_get_name(lgs->chars, index, name, max_name_size);
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			r = characters_get_name(lgs->chars, index, name, max_name_size);
+		} while (!names_read_valid(lgs, seq));
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	r = characters_get_name(lgs->chars, index, name, max_name_size);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
+}
+
+static void name_sources(struct logs *lgs, const struct entry *entries, size_t count, const char **names) {
+	for (size_t i = 0; i < count; ++i) {
+		names[i] = characters_name(lgs->chars, entries[i].src);
+	}
+	return;
+}
+
+int logs_name_sources(struct logs *lgs, const struct entry *entries, size_t count, const char **names) {
+	if ((lgs == NULL) || ((count > 0) && ((entries == NULL) || (names == NULL)))) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			name_sources(lgs, entries, count, names);
+		} while (!names_read_valid(lgs, seq));
+		return 0;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	name_sources(lgs, entries, count, names);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return 0;
 }
 
 int logs_name_complete(struct logs *lgs, const char *name, size_t *level, size_t *index) {
@@ -196,14 +1617,312 @@ int logs_name_complete(struct logs *lgs, const char *name, size_t *level, size_t
 		errno = EFAULT;
 		return -1;
 	}
-	return characters_complete(lgs->chars, name, level, index);
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			r = characters_complete(lgs->chars, name, level, index);
+		} while (!names_read_valid(lgs, seq));
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	r = characters_complete(lgs->chars, name, level, index);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
 }
 
 int logs_name_next_complete(struct logs *lgs, size_t level, size_t *index) {
+	if ((lgs == NULL) || (index == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		size_t current = *index;
+		do {
+			seq = names_read_begin(lgs);
+			*index = current;
+			r = characters_next_complete(lgs->chars, level, index);
+		} while (!names_read_valid(lgs, seq));
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	r = characters_next_complete(lgs->chars, level, index);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
+}
+
+int logs_name_complete_all(struct logs *lgs, const char *name, size_t *indexes, size_t max, size_t *count) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			r = characters_complete_all(lgs->chars, name, indexes, max, count);
+		} while (!names_read_valid(lgs, seq));
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	r = characters_complete_all(lgs->chars, name, indexes, max, count);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
+}
+
+int logs_name_suggest(struct logs *lgs, const char *text, size_t *indexes, size_t max, size_t *count) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	int r;
+	if (lgs->readonly) {
+		size_t seq;
+		do {
+			seq = names_read_begin(lgs);
+			r = characters_suggest(lgs->chars, text, indexes, max, count);
+		} while ((r == 0) && !names_read_valid(lgs, seq));
+		return r;
+	}
+	pthread_mutex_lock(&lgs->chars_lock);
+	r = characters_suggest(lgs->chars, text, indexes, max, count);
+	pthread_mutex_unlock(&lgs->chars_lock);
+	return r;
+}
+
+/* Copy the presence record of [src], to be validated against presence_seq by the caller */
+static void get_presence(const struct logs *lgs, size_t src, struct logs_presence *presence) {
+	const struct presence *p = &lgs->presence[src];
+	*presence = (struct logs_presence){
+		.src = src,
+		.online = (p->state == PRESENCE_ONLINE),
+		.since = p->since,
+		.until = p->until,
+		.last_duration = p->last_duration,
+		.sessions = p->sessions,
+		.total = p->total,
+	};
+	return;
+}
+
+int logs_get_presence(const struct logs *lgs, size_t src, struct logs_presence *presence) {
+	if ((lgs == NULL) || (presence == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (src >= characters_max_names(lgs->chars)) {
+		errno = EINVAL;
+		return -1;
+	}
+	size_t seq;
+	_Bool known;
+	do {
+		seq = seq_read_begin(&lgs->arena->presence_seq);
+		known = (lgs->presence[src].state != PRESENCE_UNKNOWN);
+		get_presence(lgs, src, presence);
+	} while (!seq_read_valid(&lgs->arena->presence_seq, seq));
+	if (!known) {
+		errno = ENOENT;
+		return -1;
+	}
+	return 0;
+}
+
+int logs_get_online(const struct logs *lgs, struct logs_presence *presences, size_t max, size_t *count) {
+	if ((lgs == NULL) || ((presences == NULL) && (max > 0)) || (count == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	size_t names = characters_max_names(lgs->chars);
+	size_t seq;
+	do {
+		seq = seq_read_begin(&lgs->arena->presence_seq);
+		*count = __atomic_load_n(&lgs->arena->online_count, __ATOMIC_RELAXED);
+		size_t src = __atomic_load_n(&lgs->arena->online_first, __ATOMIC_RELAXED);
+		/* Bounded, so that it terminates even if the list is being modified */
+		for (size_t i = 0; (i < max) && (i < names) && (src < names); ++i) {
+			get_presence(lgs, src, &presences[i]);
+			src = lgs->presence[src].next;
+		}
+	} while (!seq_read_valid(&lgs->arena->presence_seq, seq));
+	return 0;
+}
+
+/* Wake up the consumer, unless a wake up is already pending */
+static void notify(struct logs *lgs) {
+	if (!__atomic_exchange_n(&lgs->notified, 1, __ATOMIC_ACQ_REL)) {
+		char c = 0;
+		(void)write(lgs->notify[1], &c, 1);
+	}
+	return;
+}
+
+static void backoff(uint64_t *wait) {
+	struct timespec ts = {
+		.tv_sec = 0,
+		.tv_nsec = *wait,
+	};
+	nanosleep(&ts, NULL);
+	if (*wait < INGEST_MAX_WAIT_NS) {
+		*wait *= 2;
+	}
+	return;
+}
+
+static void *ingest(void *arg) {
+	struct logs *lgs = arg;
+	uint64_t wait = INGEST_MIN_WAIT_NS;
+	while (!__atomic_load_n(&lgs->stop, __ATOMIC_ACQUIRE)) {
+		size_t next = lgs->arena->next_entry;
+		pthread_mutex_lock(&lgs->ingest_lock);
+		int r = logs_refresh(lgs);
+		pthread_mutex_unlock(&lgs->ingest_lock);
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			lgs->thread_errno = errno;
+			break;
+		}
+		if (lgs->arena->next_entry != next) {
+			notify(lgs);
+		}
+		if (r == 1) {
+			backoff(&wait);
+		} else {
+			wait = INGEST_MIN_WAIT_NS;
+		}
+	}
+	__atomic_store_n(&lgs->running, 0, __ATOMIC_RELEASE);
+	notify(lgs);
+	return NULL;
+}
+
+/* Thread of the readers attached to another process arena, waiting for entries to be published */
+static void *watch(void *arg) {
+	struct logs *lgs = arg;
+	uint64_t wait = INGEST_MIN_WAIT_NS;
+	size_t next = __atomic_load_n(&lgs->arena->next_entry, __ATOMIC_ACQUIRE);
+	while (!__atomic_load_n(&lgs->stop, __ATOMIC_ACQUIRE)) {
+		size_t n = __atomic_load_n(&lgs->arena->next_entry, __ATOMIC_ACQUIRE);
+		if (n != next) {
+			next = n;
+			notify(lgs);
+			wait = INGEST_MIN_WAIT_NS;
+			continue;
+		}
+		if ((wait >= INGEST_MAX_WAIT_NS) && owner_gone(lgs->shm_fd)) {
+			/* Nothing will be published anymore */
+			lgs->thread_errno = ESRCH;
+			break;
+		}
+		backoff(&wait);
+	}
+	__atomic_store_n(&lgs->running, 0, __ATOMIC_RELEASE);
+	notify(lgs);
+	return NULL;
+}
+
+int logs_start(struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (lgs->started) {
+		errno = EALREADY;
+		return -1;
+	}
+	if (pipe(lgs->notify) != 0) {
+		return -1;
+	}
+	(void)fcntl(lgs->notify[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(lgs->notify[1], F_SETFL, O_NONBLOCK);
+	lgs->stop = 0;
+	lgs->notified = 0;
+	lgs->thread_errno = 0;
+	lgs->running = 1;
+	/* Signals are for the interfaces, do not let the ingestion thread catch them */
+	sigset_t all;
+	sigset_t old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	int r = pthread_create(&lgs->thread, NULL, lgs->readonly ? watch : ingest, lgs);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (r != 0) {
+		close(lgs->notify[0]);
+		close(lgs->notify[1]);
+		lgs->notify[0] = -1;
+		lgs->notify[1] = -1;
+		lgs->running = 0;
+		errno = r;
+		return -1;
+	}
+	lgs->started = 1;
+	return 0;
+}
+
+int logs_stop(struct logs *lgs) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (!lgs->started) {
+		return 0;
+	}
+	__atomic_store_n(&lgs->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(lgs->thread, NULL);
+	lgs->started = 0;
+	close(lgs->notify[0]);
+	close(lgs->notify[1]);
+	lgs->notify[0] = -1;
+	lgs->notify[1] = -1;
+	if (lgs->thread_errno != 0) {
+		errno = lgs->thread_errno;
+		return -1;
+	}
+	return 0;
+}
+
+_Bool logs_running(const struct logs *lgs) {
+	if (lgs == NULL) {
+		return 0;
+	}
+	return __atomic_load_n(&lgs->running, __ATOMIC_ACQUIRE);
+}
+
+int logs_notify_fd(const struct logs *lgs) {
 	if (lgs == NULL) {
 		errno = EFAULT;
 		return -1;
 	}
-	return characters_next_complete(lgs->chars, level, index);
+	return lgs->notify[0];
+}
+
+void logs_notify_clear(struct logs *lgs) {
+	if ((lgs == NULL) || (lgs->notify[0] < 0)) {
+		return;
+	}
+	/* Clear the flag first, so that entries published while draining wake up the consumer again */
+	__atomic_store_n(&lgs->notified, 0, __ATOMIC_RELEASE);
+	char buf[16];
+	while (read(lgs->notify[0], buf, sizeof(buf)) > 0) {
+	}
+	return;
 }
 
+int logs_wait(struct logs *lgs, int timeout_ms) {
+	if (lgs == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	struct pollfd pfd = { .fd = lgs->notify[0], .events = POLLIN };
+	int r = poll(&pfd, 1, timeout_ms);
+	if (r > 0) {
+		logs_notify_clear(lgs);
+	}
+	return (r > 0) ? 1 : r;
+}
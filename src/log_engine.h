@@ -2,30 +2,142 @@
 #define LOG_ENTRY
 
 #include "entry.h"
+#include "metrics.h"
 #include <stddef.h>
+#include <stdint.h>
 
 struct logs;
 
+/* Counters about the ingestion of the log file.
+ * When the ingestion thread runs, they are updated concurrently and may be slightly inconsistent with each other.
+ */
+struct logs_metrics {
+	uint64_t refreshes;       /* calls to logs_refresh */
+	uint64_t bytes_read;
+	uint64_t lines_read;
+	uint64_t entries_added;
+	uint64_t dropped_parse;   /* lines which could not be parsed */
+	uint64_t dropped_names;   /* lines whose source could not be indexed (characters table is full) */
+	uint64_t dropped_size;    /* messages larger than the ring buffer */
+	uint64_t entries_evicted; /* entries discarded to make room for newer ones */
+	uint64_t markers;         /* latency markers read */
+	uint64_t truncations;     /* log file truncated, read again from its start */
+	uint64_t rotations;       /* log file replaced by a new one (see logs_follow) */
+	struct histogram parse_ns;
+	struct histogram ingest_ns;  /* from the write of a marked line (see logs_pop_marker) to its parsing */
+	struct histogram read_bytes; /* bytes read by each logs_refresh reading something */
+};
+
 /* Create a new log engine with:
  * - logfile: opened descriptor on a stream containing the logs issued by Wakfu
  * - names: maximum number of supported players
- * - rb_size: maximum number of bytes to be logged
+ * - rb_size: memory budget of the texts, the recent ones are kept raw and older ones compressed (see textstore.h)
  * - entries: maximum number of logged entries (older entries are automatically discarded when full)
  *
  * Returns NULL on failure
  */
 struct logs *logs_create(int logfile, size_t names, size_t rb_size, size_t entries);
 
+/* Same as logs_create, but the entries, their text and the characters table live in
+ * the shared memory object [name] (see shm_open), created for this purpose, so that other processes can attach to it.
+ * An object with the same name is only replaced if the process which created it is gone (it holds a lock on it).
+ * The object is removed by logs_destroy.
+ *
+ * Returns NULL on failure
+ */
+struct logs *logs_create_shared(const char *name, int logfile, size_t names, size_t rb_size, size_t entries);
+
+/* Map read-only the logs shared by another process with logs_create_shared.
+ * All reading functions are available, logs_start then waits for the other process to publish entries.
+ * Functions which modify the logs fail with EROFS, and logs_index_source only finds already known names.
+ * Each attached process gets the latency markers issued after it attached.
+ *
+ * Returns NULL on failure
+ */
+struct logs *logs_attach(const char *name);
+
 void logs_destroy(struct logs *logs);
 
 /* Read the log file to update the entries.
  * Returns 0 on success with updates, 1 if nothing has been updated, or -1 on failure.
+ * Must not be called while the ingestion thread runs.
  */
 int logs_refresh(struct logs *lgs);
 
-/* Returns the text from the indicated buffer, usually start is e->offset, and size e->size where e is an entry */
+/* Import the content of the log file up to its last complete line, from its current position,
+ * with [threads] parsing threads (0 for one per online CPU). The file must be a regular file,
+ * read so far only by logs_import (or positioned by logs_restore). Entries are added in file order,
+ * as logs_refresh would add them, and logs_refresh then follows the log file from where the import stopped.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_import(struct logs *lgs, size_t threads);
+
+/* Follow the log file by name: once the end of the file is reached, if [path] names another file
+ * (eg. the game replaced the log file), that one is opened on the descriptor given to logs_create
+ * (see dup2), and read from its start. Must be called before logs_start.
+ * Truncations of the log file are detected even without logs_follow.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_follow(struct logs *lgs, const char *path);
+
+/* Save the whole state of the engine (entries, their text, the characters table, the metrics,
+ * and the position reached in the log file) to the file [path].
+ * The file is replaced atomically, the ingestion thread is only paused while the state is copied.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_snapshot(struct logs *lgs, const char *path);
+
+/* Restore a state saved by logs_snapshot, on an engine just created with the same sizes,
+ * before it is started or anything is imported.
+ * If the log file still holds, at the same position, the last line read when the snapshot was taken,
+ * ingestion resumes after it. Otherwise the log file has been truncated or replaced meanwhile:
+ * the restored entries are kept, and the log file is read from its start.
+ * Returns 0 on success, -1 on failure (the engine is then left empty), for instance
+ * EINVAL if the file is not a snapshot of an engine of the same sizes.
+ */
+int logs_restore(struct logs *lgs, const char *path);
+
+/* Start a thread calling logs_refresh in loop, polling the log file once its end is reached
+ * (with logs_attach, polling the arena until the process which created it is gone).
+ * From then on, the other functions may be called from another thread (a single consumer for markers),
+ * entries being published as soon as they are parsed, without ever blocking the ingestion.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_start(struct logs *lgs);
+
+/* Stop the ingestion thread, returns -1 if it stopped on a read failure (errno is then set), 0 otherwise */
+int logs_stop(struct logs *lgs);
+
+/* Returns 1 while the ingestion thread runs, 0 once it stopped (eg. on a read failure) */
+_Bool logs_running(const struct logs *lgs);
+
+/* Descriptor which becomes readable when entries are published or the ingestion thread stops,
+ * to be waited with select/poll, or -1 if the thread is not started.
+ * Call logs_notify_clear before reading the entries to be woken up again for later ones.
+ */
+int logs_notify_fd(const struct logs *lgs);
+
+void logs_notify_clear(struct logs *lgs);
+
+/* Wait at most [timeout_ms] milliseconds for entries to be published (see logs_notify_fd), and clear the notification.
+ * Returns 1 if woken up, 0 on timeout, -1 on failure (eg. EINTR when interrupted by a signal).
+ */
+int logs_wait(struct logs *lgs, int timeout_ms);
+
+/* Returns the text from the indicated buffer, usually start is e->offset, and size e->size where e is an entry.
+ * Returns 0 on success, -1 if the text has been dropped (older texts may have to be decompressed first).
+ */
 int logs_get_text(const struct logs *lgs, size_t start, size_t size, char *data);
 
+#define LOGS_NO_REPEAT SIZE_MAX
+
+/* Texts logged again while their first occurrence is retained are stored once (interned),
+ * returns the index of the entry which logged the text of [entry] first if it is such a repeat
+ * (that entry may have been discarded since), LOGS_NO_REPEAT otherwise.
+ * Like its text, check that the entry has not been discarded after calling this.
+ */
+size_t logs_get_repeat(const struct logs *lgs, const struct entry *entry);
+
 /* Get the corresponding entry, returns 0 on success, -1 on failure.
  * Failure includes the following cases:
  * - next_entry - used_entries > index: in this case, the entry has been discarded since,
@@ -33,18 +145,112 @@ int logs_get_text(const struct logs *lgs, size_t start, size_t size, char *data)
  */
 int logs_get_entry(const struct logs *lgs, size_t index, struct entry *entry);
 
+/* Check that an entry is still stored, returns 0 if so, -1 if it has been discarded.
+ * Its text may be overwritten by newer entries as soon as it is discarded,
+ * so call this after copying the text to know whether the copy is reliable.
+ */
+int logs_check_entry(const struct logs *lgs, size_t index);
+
+/* Consecutive entries, stored contiguously by the engine */
+struct logs_run {
+	size_t first; /* index of entries[0] */
+	size_t count;
+	const struct entry *entries;
+};
+
+/* Borrow the stored entries among [first, first + count) without copying them.
+ * They are split in at most 2 runs, where the ring of entries wraps: returns the number of runs set, -1 on failure.
+ * Borrowed entries may be overwritten by newer ones at any time: once they have been used
+ * (and their text copied), those older than the first stored entry (see logs_get_range) must be discarded.
+ */
+int logs_get_entries(const struct logs *lgs, size_t first, size_t count, struct logs_run runs[2]);
+
+/* Get the stored entries [*first, *next) */
+void logs_get_range(const struct logs *lgs, size_t *first, size_t *next);
+
+/* Keep the entries evicted from now on in the archive of directory [dir] (see archive.h),
+ * so that logs_read_entry can still read them. Must be called before logs_start or logs_import,
+ * after logs_restore: segments of entries a restored state does not have yet are removed.
+ * Without a restored state (no snapshot, or a snapshot not matching the log file), the archive is kept whole,
+ * and the entries logged from now on are numbered after the archived ones.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_archive(struct logs *lgs, const char *dir);
+
+/* An entry copied with its text and the name of its source, entry.text.offset is meaningless */
+struct logs_record {
+	struct entry entry;
+	size_t repeat_of; /* see logs_get_repeat, LOGS_NO_REPEAT for archived entries */
+	char text[256];
+	char source[64];
+};
+
+/* Read entry [index] from the stored entries, or else from the archive.
+ * Returns 0 on success, -1 if the entry is neither stored nor archived (EDOM).
+ */
+int logs_read_entry(struct logs *lgs, size_t index, struct logs_record *rec);
+
+/* Get the first entry which can be read with logs_read_entry, archived ones included
+ * (there may be holes in the archive, where entries were evicted while no archive was open)
+ */
+size_t logs_get_oldest_entry(struct logs *lgs);
+
+/* Find the first entry, archived ones included, logged at or after [time] (seconds in the day).
+ * Returns 0 on success, -1 if there is none.
+ */
+int logs_find_time(struct logs *lgs, unsigned int time, size_t *index);
+
 /* Get the number of currently stored entries */
 size_t logs_get_used_entries(const struct logs *lgs);
 
 /* Get the next entry number to be issued after refresh */
 size_t logs_get_next_entry(const struct logs *lgs);
 
+/* Get the maximum number of entries which can be stored at once */
+size_t logs_get_max_entries(const struct logs *lgs);
+
+/* Get the ingestion counters */
+const struct logs_metrics *logs_get_metrics(const struct logs *lgs);
+
+/* Get the number of bytes used in the text store, and its budget */
+void logs_get_ring_usage(const struct logs *lgs, size_t *used, size_t *size);
+
+/* Write all counters and histograms to fd, one "logs.<name> <value>" line per metric,
+ * including logs.markers_dropped, the number of latency markers overwritten before this process popped them,
+ * and the archive.<name> metrics if an archive is open.
+ */
+void logs_dump_metrics(const struct logs *lgs, int fd);
+
+/* Latency markers are lines "#wlog-mark <seq> <ns>" inserted in the log file (eg. by wreplay),
+ * where ns is the CLOCK_MONOTONIC time in nanoseconds at which the line following the marker was written.
+ * They are not logged as entries, but queued so that consumers can measure the latency to display.
+ */
+#define LOGS_MARKER_PREFIX "#wlog-mark "
+
+struct logs_marker {
+	uint64_t seq;
+	uint64_t write_ns;  /* when the marked line was written to the log file */
+	uint64_t ingest_ns; /* when the marked line was read */
+	size_t entry;       /* index the marked line got, or would have got if it was dropped */
+};
+
+/* Pop the oldest pending marker if its entry is lower than [before_entry],
+ * returns 0 on success, -1 if there is no such marker.
+ */
+int logs_pop_marker(struct logs *lgs, size_t before_entry, struct logs_marker *marker);
+
 /* Indexes provided source, either name is already known and its index returned,
  * either name is not yet known and this makes it known and its index returned.
  * Returns 0 on success, -1 on failure.
  */
 int logs_index_source(struct logs *lgs, const char *name, size_t *index);
 
+/* Index [count] names at once (eg. those of a configuration), and set their indexes.
+ * Before the first entry is logged, this builds the names table at once instead of name by name.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_index_sources(struct logs *lgs, const char *const *names, size_t count, size_t *indexes);
+
 /* When too many characters are present, it is possible to remove some from the database.
  * Note that this will not remove corresponding entries.
  * Such entries will just be "orphaned" (no known player), or bound to a new player
@@ -55,6 +261,12 @@ int logs_deindex_source(struct logs *lgs, size_t index);
 /* Get the explicit name of a player provided its index */
 int logs_name_source(struct logs *lgs, size_t index, char *name, size_t max_name_size);
 
+/* Borrow the names of the sources of [count] entries: names[i] is the name of entries[i].src, NULL if unknown.
+ * Names are NUL terminated and stay in place until their source is deindexed.
+ * Returns 0 on success, -1 on failure.
+ */
+int logs_name_sources(struct logs *lgs, const struct entry *entries, size_t count, const char **names);
+
 /* Provided a prefix of a player find the first matching player,
  * returns 0 if found, -1 on error.
  * Level is the size of the provided name, it is used for later calls to log_name_next_complete,
@@ -67,5 +279,43 @@ int logs_name_complete(struct logs *lgs, const char *name, size_t *level, size_t
  */
 int logs_name_next_complete(struct logs *lgs, size_t level, size_t *index);
 
+/* Provided a prefix of a player get all the matching players at once, in order:
+ * sets *count to their number, at most max, and their indexes in indexes.
+ * Returns 0 on success (even if none matches), -1 on error.
+ */
+int logs_name_complete_all(struct logs *lgs, const char *name, size_t *indexes, size_t max, size_t *count);
+
+/* Provided a typed text get the players it most likely designates, best first: those whose name starts with it
+ * regardless of case and accents, then those whose name is close to it (eg. with a typo).
+ * Sets *count to their number, at most max, and their indexes in indexes.
+ * Returns 0 on success (even if none matches), -1 on error.
+ */
+int logs_name_suggest(struct logs *lgs, const char *text, size_t *indexes, size_t max, size_t *count);
+
+#define LOGS_NO_DURATION UINT32_MAX
+
+/* Presence of a character, tracked from its join and leave lines (chan_in and chan_out entries) as they are logged,
+ * so that it remains known once these entries are discarded. Times are seconds in the day, as those of entries.
+ */
+struct logs_presence {
+	size_t src;
+	_Bool online;
+	unsigned int since;         /* join time of its current, or last, session */
+	unsigned int until;         /* leave time of its last session */
+	unsigned int last_duration; /* of its last session, LOGS_NO_DURATION if its join was not seen */
+	unsigned int sessions;      /* completed sessions whose join was seen */
+	uint64_t total;             /* total duration of these sessions */
+};
+
+/* Get the presence of player [src], in O(1).
+ * Returns 0 on success, -1 on failure (ENOENT if it never joined nor left since it was indexed).
+ */
+int logs_get_presence(const struct logs *lgs, size_t src, struct logs_presence *presence);
+
+/* Get the players online, the latest to join first: sets *count to their number,
+ * and the presence of the [max] first ones in presences. Returns 0 on success, -1 on failure.
+ */
+int logs_get_online(const struct logs *lgs, struct logs_presence *presences, size_t max, size_t *count);
+
 #endif /* LOG_ENGINE */
 
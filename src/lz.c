@@ -0,0 +1,169 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+
+/* The last bytes of a block are always literals, so that matches never need to look past the end */
+#define LAST_LITERALS 5
+
+#define MAX_OFFSET 65535
+
+#define HASH_BITS 12
+
+/* Token: literals count in the high nibble, match length - MIN_MATCH in the low nibble,
+ * a nibble of 15 being followed by bytes added to it, up to the first one lower than 255.
+ * The last sequence only has literals.
+ */
+#define NIBBLE_MAX 15
+
+static uint32_t read32(const char *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static size_t hash(uint32_t v) {
+	return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t lz_bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+static char *put_length(char *o, size_t n) {
+	while (n >= 255) {
+		*o++ = (char)255;
+		n -= 255;
+	}
+	*o++ = (char)n;
+	return o;
+}
+
+/* Emit [nlit] literals followed, unless [last], by a match of [mlen] bytes [offset] bytes back.
+ * Returns the new output position, NULL if there is not enough room.
+ */
+static char *sequence(char *o, const char *oend, const char *lit, size_t nlit, size_t offset, size_t mlen, _Bool last) {
+	size_t need = 1 + nlit + nlit / 255 + 1;
+	if (!last) {
+		need += 2 + mlen / 255 + 1;
+	}
+	if (need > (size_t)(oend - o)) {
+		return NULL;
+	}
+	unsigned char *token = (unsigned char *)o++;
+	*token = ((nlit >= NIBBLE_MAX) ? NIBBLE_MAX : nlit) << 4;
+	if (nlit >= NIBBLE_MAX) {
+		o = put_length(o, nlit - NIBBLE_MAX);
+	}
+	memcpy(o, lit, nlit);
+	o += nlit;
+	if (last) {
+		return o;
+	}
+	o[0] = (char)(offset & 0xff);
+	o[1] = (char)(offset >> 8);
+	o += 2;
+	mlen -= MIN_MATCH;
+	*token |= (mlen >= NIBBLE_MAX) ? NIBBLE_MAX : mlen;
+	if (mlen >= NIBBLE_MAX) {
+		o = put_length(o, mlen - NIBBLE_MAX);
+	}
+	return o;
+}
+
+size_t lz_compress(const char *src, size_t size, char *dst, size_t capacity) {
+	uint32_t table[1u << HASH_BITS];
+	memset(table, 0, sizeof(table));
+	const char *ip = src;
+	const char *anchor = src;
+	const char *end = src + size;
+	char *o = dst;
+	const char *oend = dst + capacity;
+	if (size >= (MIN_MATCH + LAST_LITERALS)) {
+		const char *limit = end - LAST_LITERALS;
+		while ((ip + MIN_MATCH) <= limit) {
+			uint32_t v = read32(ip);
+			size_t h = hash(v);
+			const char *ref = src + table[h];
+			table[h] = ip - src;
+			if ((ref >= ip) || ((ip - ref) > MAX_OFFSET) || (read32(ref) != v)) {
+				++ip;
+				continue;
+			}
+			const char *m = ip + MIN_MATCH;
+			const char *r = ref + MIN_MATCH;
+			while ((m < limit) && (*m == *r)) {
+				++m;
+				++r;
+			}
+			o = sequence(o, oend, anchor, ip - anchor, ip - ref, m - ip, 0);
+			if (o == NULL) {
+				return 0;
+			}
+			ip = m;
+			anchor = ip;
+		}
+	}
+	o = sequence(o, oend, anchor, end - anchor, 0, 0, 1);
+	return (o == NULL) ? 0 : (size_t)(o - dst);
+}
+
+/* Returns -1 if the length runs past the end of the block */
+static int get_length(const unsigned char **ip, const unsigned char *iend, size_t *n) {
+	unsigned char b;
+	do {
+		if (*ip == iend) {
+			return -1;
+		}
+		b = *(*ip)++;
+		*n += b;
+	} while (b == 255);
+	return 0;
+}
+
+ssize_t lz_decompress(const char *src, size_t size, char *dst, size_t capacity) {
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *iend = ip + size;
+	char *o = dst;
+	const char *oend = dst + capacity;
+	while (ip < iend) {
+		unsigned int token = *ip++;
+		size_t nlit = token >> 4;
+		if ((nlit == NIBBLE_MAX) && (get_length(&ip, iend, &nlit) != 0)) {
+			return -1;
+		}
+		if ((nlit > (size_t)(iend - ip)) || (nlit > (size_t)(oend - o))) {
+			return -1;
+		}
+		memcpy(o, ip, nlit);
+		o += nlit;
+		ip += nlit;
+		if (ip == iend) {
+			break;
+		}
+		if ((iend - ip) < 2) {
+			return -1;
+		}
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if ((offset == 0) || (offset > (size_t)(o - dst))) {
+			return -1;
+		}
+		size_t mlen = token & NIBBLE_MAX;
+		if ((mlen == NIBBLE_MAX) && (get_length(&ip, iend, &mlen) != 0)) {
+			return -1;
+		}
+		mlen += MIN_MATCH;
+		if (mlen > (size_t)(oend - o)) {
+			return -1;
+		}
+		/* Byte by byte, the match may overlap what it produces */
+		const char *r = o - offset;
+		for (size_t i = 0; i < mlen; ++i) {
+			o[i] = r[i];
+		}
+		o += mlen;
+	}
+	return o - dst;
+}
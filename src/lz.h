@@ -0,0 +1,25 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Byte oriented LZ77 compression of independent blocks, in the spirit of LZ4:
+ * a block is a sequence of (literals, back reference) pairs, favouring decoding speed over ratio.
+ * Back references reach at most 64KB back, within the same block.
+ */
+
+/* Maximum compressed size of a block of [size] bytes */
+size_t lz_bound(size_t size);
+
+/* Compress [size] bytes from src to dst, of [capacity] bytes.
+ * Returns the compressed size, 0 if it does not fit in capacity.
+ */
+size_t lz_compress(const char *src, size_t size, char *dst, size_t capacity);
+
+/* Decompress a block of [size] bytes from src to dst, of [capacity] bytes.
+ * Returns the decompressed size, -1 if the block is corrupted or does not fit in capacity.
+ */
+ssize_t lz_decompress(const char *src, size_t size, char *dst, size_t capacity);
+
+#endif /* LZ_H */
@@ -0,0 +1,112 @@
+#include "metrics.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SUB_COUNT (1u << HISTOGRAM_SUB_BITS)
+
+void histogram_reset(struct histogram *h) {
+	if (h == NULL) {
+		return;
+	}
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+	return;
+}
+
+static size_t bucket_index(uint64_t value) {
+	if (value < SUB_COUNT) {
+		return value;
+	}
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+	return ((shift + 1) << HISTOGRAM_SUB_BITS) + ((value >> shift) - SUB_COUNT);
+}
+
+/* Greatest value falling in a bucket */
+static uint64_t bucket_value(size_t index) {
+	if (index < SUB_COUNT) {
+		return index;
+	}
+	unsigned int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+	uint64_t base = (uint64_t)(SUB_COUNT + (index & (SUB_COUNT - 1))) << shift;
+	return base + ((UINT64_C(1) << shift) - 1);
+}
+
+void histogram_record(struct histogram *h, uint64_t value) {
+	if (h == NULL) {
+		return;
+	}
+	++h->buckets[bucket_index(value)];
+	++h->count;
+	h->sum += value;
+	if (value < h->min) {
+		h->min = value;
+	}
+	if (value > h->max) {
+		h->max = value;
+	}
+	return;
+}
+
+uint64_t histogram_percentile(const struct histogram *h, unsigned int per_mille) {
+	if ((h == NULL) || (h->count == 0)) {
+		return 0;
+	}
+	if (per_mille > 1000) {
+		per_mille = 1000;
+	}
+	uint64_t rank = (h->count * per_mille + 999) / 1000;
+	if (rank == 0) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			uint64_t v = bucket_value(i);
+			return (v > h->max) ? h->max : v;
+		}
+	}
+	return h->max;
+}
+
+uint64_t metrics_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+void metrics_dump_counter(int fd, const char *prefix, const char *name, uint64_t value) {
+	dprintf(fd, "%s.%s %" PRIu64 "\n", prefix, name, value);
+	return;
+}
+
+void metrics_dump_histogram(int fd, const char *prefix, const char *name, const struct histogram *h) {
+	dprintf(fd, "%s.%s.count %" PRIu64 "\n", prefix, name, h->count);
+	if (h->count == 0) {
+		return;
+	}
+	dprintf(fd, "%s.%s.min %" PRIu64 "\n", prefix, name, h->min);
+	dprintf(fd, "%s.%s.mean %" PRIu64 "\n", prefix, name, h->sum / h->count);
+	dprintf(fd, "%s.%s.p50 %" PRIu64 "\n", prefix, name, histogram_percentile(h, 500));
+	dprintf(fd, "%s.%s.p90 %" PRIu64 "\n", prefix, name, histogram_percentile(h, 900));
+	dprintf(fd, "%s.%s.p99 %" PRIu64 "\n", prefix, name, histogram_percentile(h, 990));
+	dprintf(fd, "%s.%s.p999 %" PRIu64 "\n", prefix, name, histogram_percentile(h, 999));
+	dprintf(fd, "%s.%s.max %" PRIu64 "\n", prefix, name, h->max);
+	return;
+}
+
+int metrics_format_duration(char *buf, size_t size, uint64_t ns) {
+	if (ns < 1000) {
+		return snprintf(buf, size, "%" PRIu64 "ns", ns);
+	}
+	if (ns < 1000000) {
+		return snprintf(buf, size, "%" PRIu64 ".%" PRIu64 "us", ns / 1000, (ns % 1000) / 100);
+	}
+	if (ns < 1000000000) {
+		return snprintf(buf, size, "%" PRIu64 ".%" PRIu64 "ms", ns / 1000000, (ns % 1000000) / 100000);
+	}
+	return snprintf(buf, size, "%" PRIu64 ".%" PRIu64 "s", ns / 1000000000, (ns % 1000000000) / 100000000);
+}
@@ -0,0 +1,42 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Log-linear histogram (HDR style): values below 2^HISTOGRAM_SUB_BITS are exact,
+ * greater values are bucketed with a relative precision of 2^-HISTOGRAM_SUB_BITS.
+ * Recording is O(1) and does not allocate.
+ */
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+void histogram_reset(struct histogram *h);
+
+void histogram_record(struct histogram *h, uint64_t value);
+
+/* Returns the smallest bucketed value such that at least per_mille/1000 of the recorded values are lower or equal,
+ * 0 if nothing was recorded.
+ */
+uint64_t histogram_percentile(const struct histogram *h, unsigned int per_mille);
+
+/* Monotonic time in nanoseconds */
+uint64_t metrics_now(void);
+
+/* Machine readable dumps, one "name value" line per metric */
+void metrics_dump_counter(int fd, const char *prefix, const char *name, uint64_t value);
+
+void metrics_dump_histogram(int fd, const char *prefix, const char *name, const struct histogram *h);
+
+/* Human readable duration, such as "12.5us", returns the number of written characters (as snprintf) */
+int metrics_format_duration(char *buf, size_t size, uint64_t ns);
+
+#endif /* METRICS_H */
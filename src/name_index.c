@@ -0,0 +1,320 @@
+#include "name_index.h"
+#include "rbt.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FOLDED_SIZE 64
+
+/* Trigrams indexed per name, those of longer names are ignored past it */
+#define NAME_TRIGRAMS 24
+
+/* Padding of the folded names for their first and last trigrams */
+#define BOUNDARY 1
+
+#define NO_POSTING UINT32_MAX
+
+/* The slot follows the folded name in the key, so that names folding alike have distinct keys */
+struct folded_name {
+	char key[FOLDED_SIZE + 4];
+	uint8_t trigrams;
+};
+
+/* Postings of slot s are s * NAME_TRIGRAMS + i, chained per bucket of their trigram */
+struct posting {
+	uint32_t trigram;
+	uint32_t previous; /* NO_POSTING for the first one of the bucket */
+	uint32_t next;
+};
+
+struct name_index {
+	size_t names;
+	size_t buckets;
+	size_t folded_offset;
+	size_t rbt_offset;
+	size_t postings_offset;
+	size_t buckets_offset;
+};
+
+/* Base letters of U+00C0 to U+00FF, NULL for the symbols kept as they are */
+static const char *const latin1[64] = {
+	"a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+	"d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "ss",
+	"a", "a", "a", "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",
+	"d", "n", "o", "o", "o", "o", "o", NULL, "o", "u", "u", "u", "u", "y", "th", "y",
+};
+
+size_t name_fold(const char *name, char *folded, size_t size) {
+	if ((folded == NULL) || (size == 0)) {
+		return 0;
+	}
+	size_t out = 0;
+	for (const unsigned char *c = (const unsigned char *)name; (name != NULL) && (*c != '\0'); ++c) {
+		const char *base = NULL;
+		if ((c[0] == 0xc3) && (c[1] >= 0x80) && (c[1] <= 0xbf)) {
+			base = latin1[c[1] - 0x80];
+		} else if ((c[0] == 0xc5) && ((c[1] == 0x92) || (c[1] == 0x93))) {
+			base = "oe";
+		}
+		if (base != NULL) {
+			size_t len = strlen(base);
+			if (out + len >= size) {
+				break;
+			}
+			memcpy(folded + out, base, len);
+			out += len;
+			++c;
+			continue;
+		}
+		if (out + 1 >= size) {
+			break;
+		}
+		folded[out++] = ((*c >= 'A') && (*c <= 'Z')) ? (char)(*c - 'A' + 'a') : (char)*c;
+	}
+	folded[out] = '\0';
+	return out;
+}
+
+static size_t align_up(size_t offset, size_t alignment) {
+	return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+static size_t buckets_for(size_t names) {
+	return (names > 0) ? 2 * names : 1;
+}
+
+static size_t layout(size_t names, struct name_index *l) {
+	l->names = names;
+	l->buckets = buckets_for(names);
+	l->folded_offset = align_up(sizeof(struct name_index), _Alignof(struct folded_name));
+	l->rbt_offset = align_up(l->folded_offset + names * sizeof(struct folded_name), rbt_alignment());
+	l->postings_offset = align_up(l->rbt_offset + rbt_required_size(names), _Alignof(struct posting));
+	l->buckets_offset = align_up(l->postings_offset + names * NAME_TRIGRAMS * sizeof(struct posting), _Alignof(uint32_t));
+	return l->buckets_offset + l->buckets * sizeof(uint32_t);
+}
+
+size_t name_index_required_size(size_t names) {
+	struct name_index l;
+	return layout(names, &l);
+}
+
+size_t name_index_alignment(void) {
+	size_t alignment = _Alignof(struct name_index);
+	alignment = (_Alignof(struct folded_name) > alignment) ? _Alignof(struct folded_name) : alignment;
+	alignment = (rbt_alignment() > alignment) ? rbt_alignment() : alignment;
+	alignment = (_Alignof(struct posting) > alignment) ? _Alignof(struct posting) : alignment;
+	return alignment;
+}
+
+static struct folded_name *folded(const struct name_index *idx) {
+	return (struct folded_name *)((char *)idx + idx->folded_offset);
+}
+
+static struct rbt *index_rbt(const struct name_index *idx) {
+	return (struct rbt *)((char *)idx + idx->rbt_offset);
+}
+
+static struct posting *postings(const struct name_index *idx) {
+	return (struct posting *)((char *)idx + idx->postings_offset);
+}
+
+static uint32_t *buckets(const struct name_index *idx) {
+	return (uint32_t *)((char *)idx + idx->buckets_offset);
+}
+
+struct name_index *name_index_init(void *mem, size_t names) {
+	if ((mem == NULL) || (((uintptr_t)mem % name_index_alignment()) != 0) || (names > UINT32_MAX / NAME_TRIGRAMS)) {
+		return NULL;
+	}
+	struct name_index *idx = mem;
+	layout(names, idx);
+	memset(folded(idx), 0, names * sizeof(struct folded_name));
+	void *data = index_rbt(idx);
+	size_t data_size = rbt_required_size(names);
+	if (rbt_init_empty(&data, &data_size, sizeof(folded(idx)[0].key), sizeof(folded(idx)[0]), folded(idx)[0].key, names) != index_rbt(idx)) {
+		return NULL;
+	}
+	for (size_t i = 0; i < idx->buckets; ++i) {
+		buckets(idx)[i] = NO_POSTING;
+	}
+	return idx;
+}
+
+/* Deduplicated trigrams of a folded name, padded with a boundary at its start, and at its end if [end] */
+static size_t trigrams(const char *name, size_t size, _Bool end, uint32_t *trigram, size_t max) {
+	size_t count = 0;
+	size_t padded = size + 1 + end;
+	for (size_t i = 0; (i + 3 <= padded) && (count < max); ++i) {
+		uint32_t t = 0;
+		for (size_t j = i; j < i + 3; ++j) {
+			unsigned char c = ((j == 0) || (j == size + 1)) ? BOUNDARY : (unsigned char)name[j - 1];
+			t = (t << 8) | c;
+		}
+		size_t k = 0;
+		while ((k < count) && (trigram[k] != t)) {
+			++k;
+		}
+		if (k == count) {
+			trigram[count++] = t;
+		}
+	}
+	return count;
+}
+
+static size_t bucket_of(const struct name_index *idx, uint32_t trigram) {
+	return (trigram * 2654435761u) % idx->buckets;
+}
+
+int name_index_add(struct name_index *idx, size_t slot, const char *name) {
+	if ((idx == NULL) || (name == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (slot >= idx->names) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct folded_name *f = &folded(idx)[slot];
+	char key[sizeof(f->key)];
+	memset(key, 0, sizeof(key));
+	size_t size = name_fold(name, key, FOLDED_SIZE);
+	for (size_t i = 0; i < 4; ++i) {
+		key[FOLDED_SIZE + i] = (char)(slot >> (8 * (3 - i)));
+	}
+	memcpy(f->key, key, sizeof(key));
+	size_t hash = slot;
+	if (!rbt_bind_key(index_rbt(idx), key, &hash) || (hash != slot)) {
+		errno = EEXIST;
+		return -1;
+	}
+	uint32_t trigram[NAME_TRIGRAMS];
+	f->trigrams = trigrams(key, size, 1, trigram, NAME_TRIGRAMS);
+	for (size_t i = 0; i < f->trigrams; ++i) {
+		uint32_t p = slot * NAME_TRIGRAMS + i;
+		uint32_t *head = &buckets(idx)[bucket_of(idx, trigram[i])];
+		postings(idx)[p] = (struct posting){
+			.trigram = trigram[i],
+			.previous = NO_POSTING,
+			.next = *head,
+		};
+		if (*head != NO_POSTING) {
+			postings(idx)[*head].previous = p;
+		}
+		*head = p;
+	}
+	return 0;
+}
+
+int name_index_remove(struct name_index *idx, size_t slot) {
+	if (idx == NULL) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (!rbt_unbind(index_rbt(idx), slot)) {
+		errno = ENOENT;
+		return -1;
+	}
+	struct folded_name *f = &folded(idx)[slot];
+	for (size_t i = 0; i < f->trigrams; ++i) {
+		const struct posting *p = &postings(idx)[slot * NAME_TRIGRAMS + i];
+		if (p->previous == NO_POSTING) {
+			buckets(idx)[bucket_of(idx, p->trigram)] = p->next;
+		} else {
+			postings(idx)[p->previous].next = p->next;
+		}
+		if (p->next != NO_POSTING) {
+			postings(idx)[p->next].previous = p->previous;
+		}
+	}
+	f->trigrams = 0;
+	return 0;
+}
+
+/* Prefix matches are marked in the scores so that they are not ranked again */
+#define PREFIX_MATCH UINT8_MAX
+
+struct candidate {
+	const char *key;
+	size_t slot;
+	unsigned similarity;
+};
+
+static int compare_candidates(const void *a, const void *b) {
+	const struct candidate *ca = a;
+	const struct candidate *cb = b;
+	if (ca->similarity != cb->similarity) {
+		return (ca->similarity > cb->similarity) ? -1 : 1;
+	}
+	return memcmp(ca->key, cb->key, FOLDED_SIZE + 4);
+}
+
+int name_index_suggest(const struct name_index *idx, const char *text, size_t *slots, size_t max, size_t *count) {
+	if ((idx == NULL) || (text == NULL) || ((slots == NULL) && (max > 0)) || (count == NULL)) {
+		errno = EFAULT;
+		return -1;
+	}
+	*count = 0;
+	char key[FOLDED_SIZE];
+	size_t size = name_fold(text, key, sizeof(key));
+	uint8_t *scores = calloc(idx->names, sizeof(*scores));
+	if (scores == NULL) {
+		return -1;
+	}
+	size_t first;
+	size_t last;
+	if (rbt_get_prefix_range(index_rbt(idx), key, size, &first, &last)) {
+		for (size_t s = first; (*count < max) && (s < idx->names); ) {
+			slots[(*count)++] = s;
+			scores[s] = PREFIX_MATCH;
+			if ((s == last) || !rbt_get_next_hash(index_rbt(idx), s, &s)) {
+				break;
+			}
+		}
+	}
+	/* The text is typed from the start of the name, its end is not the one of the name */
+	uint32_t trigram[FOLDED_SIZE];
+	size_t typed = trigrams(key, size, 0, trigram, FOLDED_SIZE);
+	size_t postings_count = idx->names * NAME_TRIGRAMS;
+	size_t candidates = 0;
+	for (size_t i = 0; (i < typed) && (*count < max); ++i) {
+		uint32_t p = buckets(idx)[bucket_of(idx, trigram[i])];
+		for (size_t steps = 0; (p < postings_count) && (steps < postings_count); ++steps) {
+			const struct posting *post = &postings(idx)[p];
+			size_t s = p / NAME_TRIGRAMS;
+			if ((post->trigram == trigram[i]) && (scores[s] < NAME_TRIGRAMS)) {
+				candidates += (scores[s] == 0);
+				++scores[s];
+			}
+			p = post->next;
+		}
+	}
+	struct candidate *c = (candidates > 0) ? malloc(candidates * sizeof(*c)) : NULL;
+	if ((candidates > 0) && (c == NULL)) {
+		free(scores);
+		return -1;
+	}
+	size_t ranked = 0;
+	for (size_t s = 0; (s < idx->names) && (ranked < candidates); ++s) {
+		if ((scores[s] == 0) || (scores[s] == PREFIX_MATCH)) {
+			continue;
+		}
+		if ((scores[s] >= 2) && (2 * (size_t)scores[s] >= typed)) {
+			/* Dice coefficient of the trigrams of the text and the name */
+			c[ranked++] = (struct candidate){
+				.key = folded(idx)[s].key,
+				.slot = s,
+				.similarity = (512u * scores[s]) / (typed + folded(idx)[s].trigrams),
+			};
+		}
+	}
+	if (ranked > 0) {
+		qsort(c, ranked, sizeof(*c), compare_candidates);
+	}
+	for (size_t i = 0; (i < ranked) && (*count < max); ++i) {
+		slots[(*count)++] = c[i].slot;
+	}
+	free(c);
+	free(scores);
+	return 0;
+}
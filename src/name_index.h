@@ -0,0 +1,43 @@
+#ifndef NAME_INDEX
+#define NAME_INDEX
+
+#include <stddef.h>
+
+/* Secondary index of the names of a characters table, for completion while typing:
+ * names are folded (case and accents removed, so that "elo" finds "Éloïse"), and sorted on
+ * their folded form for prefix completion, while their trigrams are indexed for fuzzy matching (typos).
+ *
+ * Names are identified by the slot (hash) they have in the characters table.
+ * Like the table, the index does not contain any pointer, so it can be moved or mapped elsewhere.
+ */
+struct name_index;
+
+/* Fold a name: ASCII letters are lowered, and the Latin-1 letters (and œ) are replaced by their base letters.
+ * Other bytes are kept. Writes at most size - 1 bytes to folded, and a final NUL. Returns the folded size.
+ */
+size_t name_fold(const char *name, char *folded, size_t size);
+
+/* Number of bytes and alignment of the memory needed by an index of provided number of slots */
+size_t name_index_required_size(size_t names);
+size_t name_index_alignment(void);
+
+/* Build an empty index of provided number of slots in a memory block of name_index_required_size(names) bytes
+ * aligned on name_index_alignment(), returns NULL on failure.
+ */
+struct name_index *name_index_init(void *mem, size_t names);
+
+/* Index the name of a slot, which must not be indexed already, returns 0 on success, -1 on failure */
+int name_index_add(struct name_index *idx, size_t slot, const char *name);
+
+/* Remove the name of a slot from the index, returns 0 on success, -1 if it is not indexed */
+int name_index_remove(struct name_index *idx, size_t slot);
+
+/* Rank the indexed names matching a typed text, and set the *count best slots (at most max) in slots:
+ * first the names whose folded form starts with the folded text, in order, then the names sharing
+ * at least two and half of the trigrams of the text (as typed, with a typo), most similar first.
+ * It only reads the index, and terminates even if it is modified meanwhile, the result must then be discarded.
+ * Returns 0 on success (even if none matches), -1 on failure.
+ */
+int name_index_suggest(const struct name_index *idx, const char *text, size_t *slots, size_t max, size_t *count);
+
+#endif
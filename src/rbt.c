@@ -1,9 +1,39 @@
+#include "rbt.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 const size_t not_a_hash = SIZE_MAX;
 
+/* Nodes are linked by slot indexes of RBT_INDEX_BITS bits (16 or 32, build with make RBT_INDEX_BITS=16
+ * for tables of at most 32767 keys), so that several nodes fit in a cache line.
+ * The top bit of the parent link holds the colour of the node, the greatest index means no node.
+ */
+#ifndef RBT_INDEX_BITS
+#define RBT_INDEX_BITS 32
+#endif
+
+#if RBT_INDEX_BITS == 32
+typedef uint32_t link_t;
+#elif RBT_INDEX_BITS == 16
+typedef uint16_t link_t;
+#else
+#error "RBT_INDEX_BITS must be 16 or 32"
+#endif
+
+#define BLACK ((link_t)1 << (RBT_INDEX_BITS - 1))
+#define NO_LINK ((link_t)(BLACK - 1))
+
+/* The first RBT_PREFIX bytes of each key are copied in its node, so that most comparisons
+ * are resolved without reading the keys array (0 disables it).
+ * By default they fill the node up to 32 bytes (16 bytes with 16 bits links).
+ */
+#ifndef RBT_PREFIX
+#define RBT_PREFIX (RBT_INDEX_BITS - 5 * (RBT_INDEX_BITS / 8))
+#endif
+
 /* We have two kind of nodes:
  * - free nodes which are red and whose parent is not a node.
  * - used nodes which do not verify this property.
@@ -17,17 +47,20 @@ const size_t not_a_hash = SIZE_MAX;
  * of black nodes. Leaves count as black nodes.
  */
 struct node {
-	size_t parent;
-	size_t child[2];
-	size_t previous;
-	size_t next;
-	_Bool is_black;
+	link_t parent; /* and colour */
+	link_t child[2];
+	link_t previous;
+	link_t next;
+#if RBT_PREFIX > 0
+	unsigned char prefix[RBT_PREFIX];
+#endif
 };
 
+/* No pointer is stored, so that a tree can be mapped at different addresses (eg. in shared memory) */
 struct rbt {
 	size_t key_size;
 	size_t cell_size;
-	const char *first_key;
+	ptrdiff_t first_key; /* relative to the tree */
 	size_t max_slots;
 	size_t first_free;
 	size_t black_depth;
@@ -37,14 +70,68 @@ struct rbt {
 	struct node slots[];
 };
 
-#if 0
-#include <stdio.h>
-#include <stdlib.h>
-static _Bool debug_rbt(const struct rbt *rbt) {
+static inline size_t from_link(link_t link) {
+	return (link == NO_LINK) ? not_a_hash : link;
+}
+
+static inline link_t to_link(size_t hash) {
+	return (hash == not_a_hash) ? NO_LINK : (link_t)hash;
+}
+
+static inline size_t parent_of(const struct rbt *rbt, size_t node) {
+	return from_link(rbt->slots[node].parent & (link_t)~BLACK);
+}
+
+static inline void set_parent(struct rbt *rbt, size_t node, size_t parent) {
+	rbt->slots[node].parent = (rbt->slots[node].parent & BLACK) | to_link(parent);
+	return;
+}
+
+static inline _Bool is_black(const struct rbt *rbt, size_t node) {
+	return (rbt->slots[node].parent & BLACK) != 0;
+}
+
+static inline void set_black(struct rbt *rbt, size_t node, _Bool black) {
+	rbt->slots[node].parent = (rbt->slots[node].parent & (link_t)~BLACK) | (black ? BLACK : 0);
+	return;
+}
+
+static inline size_t child_of(const struct rbt *rbt, size_t node, _Bool greater) {
+	return from_link(rbt->slots[node].child[greater]);
+}
+
+static inline void set_child(struct rbt *rbt, size_t node, _Bool greater, size_t child) {
+	rbt->slots[node].child[greater] = to_link(child);
+	return;
+}
+
+static inline size_t previous_of(const struct rbt *rbt, size_t node) {
+	return from_link(rbt->slots[node].previous);
+}
+
+static inline void set_previous(struct rbt *rbt, size_t node, size_t previous) {
+	rbt->slots[node].previous = to_link(previous);
+	return;
+}
+
+static inline size_t next_of(const struct rbt *rbt, size_t node) {
+	return from_link(rbt->slots[node].next);
+}
+
+static inline void set_next(struct rbt *rbt, size_t node, size_t next) {
+	rbt->slots[node].next = to_link(next);
+	return;
+}
+
+static inline const char *key_of(const struct rbt *rbt, size_t node) {
+	return (const char *)rbt + rbt->first_key + node * rbt->cell_size;
+}
+
+_Bool rbt_check(const struct rbt *rbt) {
 	if (rbt == NULL) {
 		return 0;
 	}
-	if (rbt->max_slots > not_a_hash) {
+	if (rbt->max_slots > NO_LINK) {
 		return 0;
 	}
 	size_t remaining_slots = rbt->max_slots;
@@ -55,52 +142,49 @@ static _Bool debug_rbt(const struct rbt *rbt) {
 	int dir; /* 0: from parent, 1: from lesser, 2: from greater */
 
 	if (rbt->key_size > rbt->cell_size) {
-		dprintf(2, "Key size is greater than cell size\n");
+		dprintf(2, "rbt: Key size is greater than cell size\n");
 		return 0;
 	}
 
 	/* Check free list */
-	dprintf(2, "\nChecking free list\n");
 	dir = 1;
 	prev = not_a_hash;
 	current = rbt->first_free;
 	while (current != not_a_hash) {
-		dprintf(2, " %zu", current);
 		if (remaining_slots <= 0) {
-			dprintf(2, "\nInvalid: cycling\n");
+			dprintf(2, "rbt: Invalid: cycling\n");
 			return 0;
 		}
 		if (current >= rbt->max_slots) {
-			dprintf(2, "\nInvalid: geq than bound of %zu\n", rbt->max_slots);
+			dprintf(2, "rbt: Invalid: geq than bound of %zu\n", rbt->max_slots);
 			return 0;
 		}
-		if (rbt->slots[current].child[0] != not_a_hash) {
-			dprintf(2, "\nInvalid: child[0] is %zu\n", rbt->slots[current].child[0]);
+		if (child_of(rbt, current, 0) != not_a_hash) {
+			dprintf(2, "rbt: Invalid: child[0] is %zu\n", child_of(rbt, current, 0));
 			return 0;
 		}
-		if (rbt->slots[current].child[1] != not_a_hash) {
-			dprintf(2, "\nInvalid: child[1] is %zu\n", rbt->slots[current].child[1]);
+		if (child_of(rbt, current, 1) != not_a_hash) {
+			dprintf(2, "rbt: Invalid: child[1] is %zu\n", child_of(rbt, current, 1));
 			return 0;
 		}
-		if (rbt->slots[current].previous != prev) {
-			dprintf(2, "\nInvalid: previous is %zu\n", rbt->slots[current].previous);
+		if (previous_of(rbt, current) != prev) {
+			dprintf(2, "rbt: Invalid: previous is %zu\n", previous_of(rbt, current));
 			return 0;
 		}
-		if (rbt->slots[current].parent != not_a_hash) {
-			dprintf(2, "\nInvalid: has %zu as a parent\n", rbt->slots[current].parent);
+		if (parent_of(rbt, current) != not_a_hash) {
+			dprintf(2, "rbt: Invalid: has %zu as a parent\n", parent_of(rbt, current));
 			return 0;
 		}
-		if (rbt->slots[current].is_black) {
-			dprintf(2, "\nInvalid: is not red\n");
+		if (is_black(rbt, current)) {
+			dprintf(2, "rbt: Invalid: is not red\n");
 			return 0;
 		}
 		--remaining_slots;
 		prev = current;
-		current = rbt->slots[current].next;
+		current = next_of(rbt, current);
 	}
 
 	/* Check the nodes */
-	dprintf(2, "\nChecking the nodes\n");
 	dir = 0;
 	prev = not_a_hash;
 	current = rbt->root;
@@ -109,43 +193,42 @@ static _Bool debug_rbt(const struct rbt *rbt) {
 	size_t xprev = not_a_hash;
 	size_t xnext = rbt->least;
 	while (current != not_a_hash) {
-		dprintf(2, "%zu:%c(%d,%c)", current, rbt->slots[current].is_black ? 'N' : 'R', dir, parent_was_black ? 'N' : 'R');
 		if (current >= rbt->max_slots) {
-			dprintf(2, "\nInvalid: geq than bound of %zu\n", rbt->max_slots);
+			dprintf(2, "rbt: Invalid: geq than bound of %zu\n", rbt->max_slots);
 			return 0;
 		}
 		switch (dir) {
 			case 0: {
-				if (rbt->slots[current].parent != prev) {
-					dprintf(2, "\nInvalid: double link broken (parent is %zu, expecting %zu)\n", rbt->slots[current].parent, prev);
+				if (parent_of(rbt, current) != prev) {
+					dprintf(2, "rbt: Invalid: double link broken (parent is %zu, expecting %zu)\n", parent_of(rbt, current), prev);
 					return 0;
 				}
-				if (rbt->slots[current].is_black) {
+				if (is_black(rbt, current)) {
 					++black_depth;
 				} else {
 					if (!parent_was_black) {
-						dprintf(2, "\nInvalid: two red consecutive nodes\n");
+						dprintf(2, "rbt: Invalid: two red consecutive nodes\n");
 						return 0;
 					}
 				}
-				parent_was_black = rbt->slots[current].is_black;
+				parent_was_black = is_black(rbt, current);
 				if (remaining_slots <= 0) {
-					dprintf(2, "\nInvalid: cycling\n");
+					dprintf(2, "rbt: Invalid: cycling\n");
 					return 0;
 				}
 				--remaining_slots;
 				prev = current;
-				current = rbt->slots[current].child[0];
+				current = child_of(rbt, current, 0);
 				if (current != not_a_hash) {
-					if (rbt->slots[prev].child[1] == current) {
-						dprintf(2, "\nInvalid: two children are the same\n");
+					if (child_of(rbt, prev, 1) == current) {
+						dprintf(2, "rbt: Invalid: two children are the same\n");
 						return 0;
 					}
 					dir = 0;
 					continue;
 				}
 				if (black_depth != rbt->black_depth) {
-					dprintf(2, "\nInvalid: Unbalanced tree (%zu, expected %zu)\n", black_depth, rbt->black_depth);
+					dprintf(2, "rbt: Invalid: Unbalanced tree (%zu, expected %zu)\n", black_depth, rbt->black_depth);
 					return 0;
 				}
 				dir = 1;
@@ -154,25 +237,35 @@ static _Bool debug_rbt(const struct rbt *rbt) {
 				continue;
 			}
 			case 1: {
-				parent_was_black = rbt->slots[current].is_black;
+				parent_was_black = is_black(rbt, current);
 				if (xnext != current) {
-					dprintf(2, "\nIncorrectly doubly linked at %zu (expected %zu)\n", current, xnext);
+					dprintf(2, "rbt: Incorrectly doubly linked at %zu (expected %zu)\n", current, xnext);
+					return 0;
+				}
+				if (xprev != previous_of(rbt, current)) {
+					dprintf(2, "rbt: Incorrectly doubly linked at %zu (prev is %zu, expected %zu)\n", current, previous_of(rbt, current), xprev);
 					return 0;
 				}
-				if (xprev != rbt->slots[current].previous) {
-					dprintf(2, "\nIncorrectly doubly linked at %zu (prev is %zu, expected %zu)\n", current, rbt->slots[current].previous, xprev);
+				if ((xprev != not_a_hash) && (memcmp(key_of(rbt, xprev), key_of(rbt, current), rbt->key_size) >= 0)) {
+					dprintf(2, "rbt: Invalid: key of %zu is not greater than the one of %zu\n", current, xprev);
 					return 0;
 				}
+#if RBT_PREFIX > 0
+				if (memcmp(rbt->slots[current].prefix, key_of(rbt, current), (rbt->key_size < RBT_PREFIX) ? rbt->key_size : RBT_PREFIX) != 0) {
+					dprintf(2, "rbt: Invalid: prefix of %zu differs from its key\n", current);
+					return 0;
+				}
+#endif
 				xprev = current;
-				xnext = rbt->slots[current].next;
+				xnext = next_of(rbt, current);
 				prev = current;
-				current = rbt->slots[current].child[1];
+				current = child_of(rbt, current, 1);
 				if (current != not_a_hash) {
 					dir = 0;
 					continue;
 				}
 				if (black_depth != rbt->black_depth) {
-					dprintf(2, "\nInvalid: Unbalanced tree (%zu)\n", black_depth);
+					dprintf(2, "rbt: Invalid: Unbalanced tree (%zu)\n", black_depth);
 					return 0;
 				}
 				dir = 2;
@@ -181,36 +274,37 @@ static _Bool debug_rbt(const struct rbt *rbt) {
 				continue;
 			}
 			case 2: {
-				parent_was_black = rbt->slots[current].is_black;
-				if (rbt->slots[current].is_black) {
+				parent_was_black = is_black(rbt, current);
+				if (is_black(rbt, current)) {
 					--black_depth;
 				}
 				prev = current;
-				current = rbt->slots[current].parent;
+				current = parent_of(rbt, current);
 				if (current != not_a_hash) {
-					dir = (rbt->slots[current].child[0] == prev) ? 1 : 2;
+					dir = (child_of(rbt, current, 0) == prev) ? 1 : 2;
 				}
 				continue;
 			}
 		}
 	}
 	if (xnext != not_a_hash) {
-		dprintf(2, "\nUnfinished list\n");
+		dprintf(2, "rbt: Unfinished list\n");
 		return 0;
 	}
 	if (xprev != rbt->greatest) {
-		dprintf(2, "\nNot ending with greatest\n");
+		dprintf(2, "rbt: Not ending with greatest\n");
 		return 0;
 	}
 	/* Check no leak */
 	if (remaining_slots > 0) {
-		dprintf(2, "\nNodes are leaking\n");
+		dprintf(2, "rbt: Nodes are leaking\n");
 		return 0;
 	}
-	dprintf(2, "\nRBT fully checked\n");
 	return 1;
 }
-#define DEBUG_RBT(rbt) do { if (!debug_rbt(rbt)) { exit(-1); } } while (0)
+/* Build with make RBT_DEBUG=1 to check the whole tree after each modification (very slow) */
+#ifdef RBT_DEBUG
+#define DEBUG_RBT(rbt) do { if (!rbt_check(rbt)) { exit(-1); } } while (0)
 #else
 #define DEBUG_RBT(rbt)
 #endif
@@ -223,11 +317,15 @@ size_t rbt_required_size(size_t keys) {
 	return sizeof(struct rbt) + keys * sizeof(struct node);
 }
 
+size_t rbt_max_keys(void) {
+	return NO_LINK;
+}
+
 struct rbt *rbt_init_empty(void **data, size_t *data_size, size_t key_size, size_t cell_size, void *first_key, size_t keys) {
 	if ((data == NULL) || (*data == NULL) || (data_size == NULL)) {
 		return NULL;
 	}
-	if (key_size > cell_size) {
+	if ((key_size > cell_size) || (keys > rbt_max_keys())) {
 		return NULL;
 	}
 	size_t rbt_align = rbt_alignment();
@@ -247,7 +345,7 @@ struct rbt *rbt_init_empty(void **data, size_t *data_size, size_t key_size, size
 
 	rbt->key_size = key_size;
 	rbt->cell_size = cell_size;
-	rbt->first_key = first_key;
+	rbt->first_key = (const char *)first_key - (const char *)rbt;
 	rbt->max_slots = keys;
 	rbt->first_free = 0;
 	rbt->black_depth = 0;
@@ -255,16 +353,15 @@ struct rbt *rbt_init_empty(void **data, size_t *data_size, size_t key_size, size
 	rbt->least = not_a_hash;
 	rbt->greatest = not_a_hash;
 	for (size_t i = 0; i < keys; ++i) {
-		rbt->slots[i].parent = not_a_hash;
-		rbt->slots[i].is_black = 0;
-		rbt->slots[i].child[0] = not_a_hash;
-		rbt->slots[i].child[1] = not_a_hash;
-		rbt->slots[i].previous = i - 1;
-		rbt->slots[i].next = i + 1;
+		rbt->slots[i].parent = NO_LINK;
+		set_child(rbt, i, 0, not_a_hash);
+		set_child(rbt, i, 1, not_a_hash);
+		set_previous(rbt, i, i - 1);
+		set_next(rbt, i, i + 1);
 	}
 	if (keys > 0) {
-		rbt->slots[0].previous = not_a_hash;
-		rbt->slots[keys - 1].next = not_a_hash;
+		set_previous(rbt, 0, not_a_hash);
+		set_next(rbt, keys - 1, not_a_hash);
 	}
 	return rbt;
 }
@@ -273,54 +370,90 @@ _Bool rbt_get_free(const struct rbt *rbt, size_t *hash) {
 	if (rbt == NULL) {
 		return 0;
 	}
+	if (rbt->first_free == not_a_hash) {
+		return 0;
+	}
 	if (hash != NULL) {
 		*hash = rbt->first_free;
 	}
 	return 1;
 }
 
+/* Compare the first [size] bytes of [key] to those of the key of [node], from the prefix in the node first */
+static inline int compare_key(const struct rbt *rbt, const void *key, size_t size, size_t node) {
+#if RBT_PREFIX > 0
+	size_t prefix = (size < RBT_PREFIX) ? size : RBT_PREFIX;
+	int c = memcmp(key, rbt->slots[node].prefix, prefix);
+	if ((c != 0) || (prefix == size)) {
+		return c;
+	}
+	return memcmp((const char *)key + prefix, key_of(rbt, node) + prefix, size - prefix);
+#else
+	return memcmp(key, key_of(rbt, node), size);
+#endif
+}
+
 /* Auxiliary function, assuming rbt is a valid tree, parent is not NULL */
 static int find_rbt_node(const struct rbt *rbt, const void *key, size_t *node_or_parent) {
 	size_t index = rbt->root;
 	*node_or_parent = not_a_hash;
 	int c = -1;
 	while (index != not_a_hash) {
-		c = memcmp(key, rbt->first_key + index * rbt->cell_size, rbt->key_size);
+		c = compare_key(rbt, key, rbt->key_size, index);
 		*node_or_parent = index;
 		if (c == 0) {
 			return 0;
 		}
-		index = rbt->slots[index].child[(c < 0) ? 0 : 1];
+		index = child_of(rbt, index, c > 0);
 	}
 	return c;
 }
 
+/* Least node whose key is greater than [key] on their first [size] bytes (or equal, unless [strict]),
+ * not_a_hash if there is none.
+ * At most max_slots slots are visited, so that it terminates even if the tree is modified meanwhile.
+ */
+static size_t find_bound(const struct rbt *rbt, const void *key, size_t size, _Bool strict) {
+	size_t bound = not_a_hash;
+	size_t index = rbt->root;
+	for (size_t steps = 0; (index < rbt->max_slots) && (steps < rbt->max_slots); ++steps) {
+		int c = compare_key(rbt, key, size, index);
+		if ((c < 0) || ((c == 0) && !strict)) {
+			bound = index;
+			index = child_of(rbt, index, 0);
+		} else {
+			index = child_of(rbt, index, 1);
+		}
+	}
+	return bound;
+}
+
 static size_t get_parent(const struct rbt *rbt, size_t node, _Bool *node_greater, size_t *brother) {
-	size_t parent = rbt->slots[node].parent;
+	size_t parent = parent_of(rbt, node);
 	if (parent != not_a_hash) {
-		*node_greater = (rbt->slots[parent].child[0] != node);
-		*brother = rbt->slots[parent].child[!*node_greater];
+		*node_greater = (child_of(rbt, parent, 0) != node);
+		*brother = child_of(rbt, parent, !*node_greater);
 	}
 	return parent;
 }
 
 static void rotate(struct rbt *rbt, size_t node, _Bool swap_with_greater) {
-	size_t parent = rbt->slots[node].parent;
-	size_t sub = rbt->slots[node].child[swap_with_greater];
-	size_t subsub = rbt->slots[sub].child[!swap_with_greater];
+	size_t parent = parent_of(rbt, node);
+	size_t sub = child_of(rbt, node, swap_with_greater);
+	size_t subsub = child_of(rbt, sub, !swap_with_greater);
 	if (subsub != not_a_hash) {
-		rbt->slots[subsub].parent = node;
+		set_parent(rbt, subsub, node);
 	}
-	rbt->slots[node].child[swap_with_greater] = subsub;
+	set_child(rbt, node, swap_with_greater, subsub);
 	if (parent != not_a_hash) {
-		size_t lesser = rbt->slots[parent].child[0];
-		rbt->slots[parent].child[lesser != node] = sub;
+		size_t lesser = child_of(rbt, parent, 0);
+		set_child(rbt, parent, lesser != node, sub);
 	} else {
 		rbt->root = sub;
 	}
-	rbt->slots[sub].parent = parent;
-	rbt->slots[node].parent = sub;
-	rbt->slots[sub].child[!swap_with_greater] = node;
+	set_parent(rbt, sub, parent);
+	set_parent(rbt, node, sub);
+	set_child(rbt, sub, !swap_with_greater, node);
 	return;
 }
 
@@ -341,12 +474,12 @@ loop:
 	size_t brother;
 	size_t parent = get_parent(rbt, node, &node_greater, &brother);
 	if (parent == not_a_hash) {
-		rbt->slots[node].is_black = 1;
+		set_black(rbt, node, 1);
 		++rbt->black_depth;
 		return;
 	}
 	/* Check if parent is black */
-	if (rbt->slots[parent].is_black) {
+	if (is_black(rbt, parent)) {
 		return;
 	}
 	/* Check if parent at root */
@@ -354,27 +487,27 @@ loop:
 	size_t uncle;
 	size_t gparent = get_parent(rbt, parent, &parent_greater, &uncle);
 	if (gparent == not_a_hash) {
-		rbt->slots[parent].is_black = 1;
+		set_black(rbt, parent, 1);
 		return;
 	}
 	/* Check if uncle is red */
-	if ((uncle != not_a_hash) && !rbt->slots[uncle].is_black) {
-		rbt->slots[parent].is_black = 1;
-		rbt->slots[uncle].is_black = 1;
-		rbt->slots[gparent].is_black = 0;
+	if ((uncle != not_a_hash) && !is_black(rbt, uncle)) {
+		set_black(rbt, parent, 1);
+		set_black(rbt, uncle, 1);
+		set_black(rbt, gparent, 0);
 		node = gparent;
 		goto loop;
 	}
 	/* Rotate if required */
 	if (node_greater != parent_greater) {
 		rotate(rbt, parent, node_greater);
-		rbt->slots[node].parent = gparent;
-		rbt->slots[gparent].child[parent_greater] = node;
+		set_parent(rbt, node, gparent);
+		set_child(rbt, gparent, parent_greater, node);
 		parent = node;
 	}
 	rotate(rbt, gparent, parent_greater);
-	rbt->slots[gparent].is_black = 0;
-	rbt->slots[parent].is_black = 1;
+	set_black(rbt, gparent, 0);
+	set_black(rbt, parent, 1);
 	return;
 }
 
@@ -386,8 +519,8 @@ loop:
 static void deletion_repair_rbt(struct rbt *rbt, size_t node) {
 loop:
 	/* Check if node is red */
-	if (!rbt->slots[node].is_black) {
-		rbt->slots[node].is_black = 1;
+	if (!is_black(rbt, node)) {
+		set_black(rbt, node, 1);
 		return;
 	}
 	/* Check if at root */
@@ -401,35 +534,35 @@ loop:
 	/* Check if brother is red */
 	size_t nephew;
 	size_t grand_nephew;
-	if (!rbt->slots[brother].is_black) {
-		rbt->slots[brother].is_black = 1;
-		nephew = rbt->slots[brother].child[node_greater];
-		grand_nephew = rbt->slots[nephew].child[node_greater];
-		if ((grand_nephew != not_a_hash) && !rbt->slots[grand_nephew].is_black) {
+	if (!is_black(rbt, brother)) {
+		set_black(rbt, brother, 1);
+		nephew = child_of(rbt, brother, node_greater);
+		grand_nephew = child_of(rbt, nephew, node_greater);
+		if ((grand_nephew != not_a_hash) && !is_black(rbt, grand_nephew)) {
 			rotate(rbt, nephew, node_greater);
 			nephew = grand_nephew;
 		} else {
-			rbt->slots[parent].is_black = 0;
+			set_black(rbt, parent, 0);
 		}
 		rotate(rbt, parent, !node_greater);
 		rotate(rbt, parent, !node_greater);
 		return;
 	}
 	/* Look at nephew */
-	nephew = rbt->slots[brother].child[node_greater];
-	if ((nephew != not_a_hash) && !rbt->slots[nephew].is_black) {
-		rbt->slots[nephew].is_black = rbt->slots[parent].is_black;
-		rbt->slots[parent].is_black = 1;
+	nephew = child_of(rbt, brother, node_greater);
+	if ((nephew != not_a_hash) && !is_black(rbt, nephew)) {
+		set_black(rbt, nephew, is_black(rbt, parent));
+		set_black(rbt, parent, 1);
 		rotate(rbt, brother, node_greater);
 		brother = nephew;
 	} else {
-		size_t xnephew = rbt->slots[brother].child[!node_greater];
-		if ((xnephew == not_a_hash) || rbt->slots[xnephew].is_black) {
-			rbt->slots[brother].is_black = 0;
+		size_t xnephew = child_of(rbt, brother, !node_greater);
+		if ((xnephew == not_a_hash) || is_black(rbt, xnephew)) {
+			set_black(rbt, brother, 0);
 			node = parent;
 			goto loop;
 		}
-		rbt->slots[xnephew].is_black = rbt->slots[parent].is_black;
+		set_black(rbt, xnephew, is_black(rbt, parent));
 	}
 	rotate(rbt, parent, !node_greater);
 	return;
@@ -442,13 +575,8 @@ _Bool rbt_is_free_hash(const struct rbt *rbt, size_t hash) {
 	if (hash >= rbt->max_slots) {
 		return 0;
 	}
-	if (rbt->slots[hash].is_black) {
-		return 0;
-	}
-	if (rbt->slots[hash].parent != not_a_hash) {
-		return 0;
-	}
-	return 1;
+	/* Red, without a parent */
+	return rbt->slots[hash].parent == NO_LINK;
 }
 
 _Bool rbt_is_bound_hash(const struct rbt *rbt, size_t hash) {
@@ -458,13 +586,7 @@ _Bool rbt_is_bound_hash(const struct rbt *rbt, size_t hash) {
 	if (hash >= rbt->max_slots) {
 		return 0;
 	}
-	if (rbt->slots[hash].parent != not_a_hash) {
-		return 1;
-	}
-	if (rbt->slots[hash].is_black) {
-		return 1;
-	}
-	return 0;
+	return rbt->slots[hash].parent != NO_LINK;
 }
 
 _Bool rbt_get_least(const struct rbt *rbt, size_t *hash) {
@@ -505,16 +627,63 @@ _Bool rbt_get_hash(const struct rbt *rbt, const void *key, size_t *hash) {
 	return 1;
 }
 
+_Bool rbt_lower_bound(const struct rbt *rbt, const void *key, size_t *hash) {
+	if ((rbt == NULL) || (key == NULL)) {
+		return 0;
+	}
+	size_t bound = find_bound(rbt, key, rbt->key_size, 0);
+	if (bound == not_a_hash) {
+		return 0;
+	}
+	if (hash != NULL) {
+		*hash = bound;
+	}
+	return 1;
+}
+
+_Bool rbt_upper_bound(const struct rbt *rbt, const void *key, size_t *hash) {
+	if ((rbt == NULL) || (key == NULL)) {
+		return 0;
+	}
+	size_t bound = find_bound(rbt, key, rbt->key_size, 1);
+	if (bound == not_a_hash) {
+		return 0;
+	}
+	if (hash != NULL) {
+		*hash = bound;
+	}
+	return 1;
+}
+
+_Bool rbt_get_prefix_range(const struct rbt *rbt, const void *prefix, size_t size, size_t *first, size_t *last) {
+	if ((rbt == NULL) || ((prefix == NULL) && (size > 0)) || (size > rbt->key_size)) {
+		return 0;
+	}
+	size_t least = find_bound(rbt, prefix, size, 0);
+	if ((least == not_a_hash) || (compare_key(rbt, prefix, size, least) != 0)) {
+		return 0;
+	}
+	/* The greatest one precedes the least key greater than the prefix */
+	size_t after = find_bound(rbt, prefix, size, 1);
+	if (first != NULL) {
+		*first = least;
+	}
+	if (last != NULL) {
+		*last = (after == not_a_hash) ? rbt->greatest : previous_of(rbt, after);
+	}
+	return 1;
+}
+
 _Bool rbt_get_next_hash(const struct rbt *rbt, size_t hash, size_t *next) {
 	_Bool valid = rbt_is_bound_hash(rbt, hash);
 	if (!valid) {
 		return 0;
 	}
-	if (rbt->slots[hash].next == not_a_hash) {
+	if (next_of(rbt, hash) == not_a_hash) {
 		return 0;
 	}
 	if (next != NULL) {
-		*next = rbt->slots[hash].next;
+		*next = next_of(rbt, hash);
 	}
 	return 1;
 }
@@ -524,11 +693,11 @@ _Bool rbt_get_previous_hash(const struct rbt *rbt, size_t hash, size_t *previous
 	if (!valid) {
 		return 0;
 	}
-	if (rbt->slots[hash].previous == not_a_hash) {
+	if (previous_of(rbt, hash) == not_a_hash) {
 		return 0;
 	}
 	if (previous != NULL) {
-		*previous = rbt->slots[hash].previous;
+		*previous = previous_of(rbt, hash);
 	}
 	return 1;
 }
@@ -548,46 +717,50 @@ _Bool rbt_bind_key(struct rbt *rbt, const void *key, size_t *hash) {
 		return 0;
 	}
 
-	size_t prev = rbt->slots[*hash].previous;
-	size_t next = rbt->slots[*hash].next;
+	size_t prev = previous_of(rbt, *hash);
+	size_t next = next_of(rbt, *hash);
 	if (prev == not_a_hash) {
 		rbt->first_free = next;
 	} else {
-		rbt->slots[prev].next = next;
+		set_next(rbt, prev, next);
 	}
 	if (next != not_a_hash) {
-		rbt->slots[next].previous = prev;
+		set_previous(rbt, next, prev);
 	}
 
-	rbt->slots[*hash].parent = node_or_parent;
-	rbt->slots[*hash].child[0] = not_a_hash;
-	rbt->slots[*hash].child[1] = not_a_hash;
-	rbt->slots[*hash].is_black = 0;
+	/* A red node, the parent link is set below */
+	rbt->slots[*hash].parent = NO_LINK;
+	set_child(rbt, *hash, 0, not_a_hash);
+	set_child(rbt, *hash, 1, not_a_hash);
+#if RBT_PREFIX > 0
+	memcpy(rbt->slots[*hash].prefix, key, (rbt->key_size < RBT_PREFIX) ? rbt->key_size : RBT_PREFIX);
+#endif
 	if (node_or_parent != not_a_hash) {
+		set_parent(rbt, *hash, node_or_parent);
 		if (r > 0) {
-			rbt->slots[*hash].previous = node_or_parent;
-			rbt->slots[*hash].next = rbt->slots[node_or_parent].next;
-			if (rbt->slots[*hash].next != not_a_hash) {
-				rbt->slots[rbt->slots[*hash].next].previous = *hash;
+			set_previous(rbt, *hash, node_or_parent);
+			set_next(rbt, *hash, next_of(rbt, node_or_parent));
+			if (next_of(rbt, *hash) != not_a_hash) {
+				set_previous(rbt, next_of(rbt, *hash), *hash);
 			} else {
 				rbt->greatest = *hash;
 			}
-			rbt->slots[node_or_parent].next = *hash;
-			rbt->slots[node_or_parent].child[1] = *hash;
+			set_next(rbt, node_or_parent, *hash);
+			set_child(rbt, node_or_parent, 1, *hash);
 		} else {
-			rbt->slots[*hash].next = node_or_parent;
-			rbt->slots[*hash].previous = rbt->slots[node_or_parent].previous;
-			if (rbt->slots[*hash].previous != not_a_hash) {
-				rbt->slots[rbt->slots[*hash].previous].next = *hash;
+			set_next(rbt, *hash, node_or_parent);
+			set_previous(rbt, *hash, previous_of(rbt, node_or_parent));
+			if (previous_of(rbt, *hash) != not_a_hash) {
+				set_next(rbt, previous_of(rbt, *hash), *hash);
 			} else {
 				rbt->least = *hash;
 			}
-			rbt->slots[node_or_parent].previous = *hash;
-			rbt->slots[node_or_parent].child[0] = *hash;
+			set_previous(rbt, node_or_parent, *hash);
+			set_child(rbt, node_or_parent, 0, *hash);
 		}
 	} else {
-		rbt->slots[*hash].previous = not_a_hash;
-		rbt->slots[*hash].next = not_a_hash;
+		set_previous(rbt, *hash, not_a_hash);
+		set_next(rbt, *hash, not_a_hash);
 		rbt->root = *hash;
 		rbt->least = *hash;
 		rbt->greatest = *hash;
@@ -605,84 +778,215 @@ _Bool rbt_unbind(struct rbt *rbt, size_t hash) {
 	}
 	size_t aux;
 	size_t tmp;
-	aux = rbt->slots[hash].next;
+	aux = next_of(rbt, hash);
 	if (aux == not_a_hash) {
-		rbt->greatest = rbt->slots[hash].previous;
+		rbt->greatest = previous_of(rbt, hash);
 	} else {
-		rbt->slots[aux].previous = rbt->slots[hash].previous;
+		set_previous(rbt, aux, previous_of(rbt, hash));
 	}
-	aux = rbt->slots[hash].previous;
+	aux = previous_of(rbt, hash);
 	if (aux == not_a_hash) {
-		rbt->least = rbt->slots[hash].next;
+		rbt->least = next_of(rbt, hash);
 	} else {
-		rbt->slots[aux].next = rbt->slots[hash].next;
+		set_next(rbt, aux, next_of(rbt, hash));
 	}
-	if (rbt->slots[hash].child[0] != not_a_hash) {
+	/* A node with a lesser child always has a previous one, testing it keeps the indexes below in range */
+	if ((child_of(rbt, hash, 0) != not_a_hash) && (aux != not_a_hash)) {
+		/* Swap the positions in the tree with the previous node */
 		struct node n = rbt->slots[aux];
 		rbt->slots[aux] = rbt->slots[hash];
 		rbt->slots[hash] = n;
+#if RBT_PREFIX > 0
+		/* The prefixes stay with their keys */
+		memcpy(rbt->slots[hash].prefix, rbt->slots[aux].prefix, RBT_PREFIX);
+		memcpy(rbt->slots[aux].prefix, n.prefix, RBT_PREFIX);
+#endif
 		rbt->slots[aux].next = n.next;
 		rbt->slots[aux].previous = n.previous;
-		tmp = rbt->slots[aux].parent;
+		tmp = parent_of(rbt, aux);
 		if (tmp != not_a_hash) {
-			if (rbt->slots[tmp].child[0] == hash) {
-				rbt->slots[tmp].child[0] = aux;
+			if (child_of(rbt, tmp, 0) == hash) {
+				set_child(rbt, tmp, 0, aux);
 			} else {
-				rbt->slots[tmp].child[1] = aux;
+				set_child(rbt, tmp, 1, aux);
 			}
 		} else {
 			rbt->root = aux;
 		}
-		tmp = rbt->slots[aux].child[1];
+		tmp = child_of(rbt, aux, 1);
 		if (tmp != not_a_hash) {
-			rbt->slots[tmp].parent = aux;
+			set_parent(rbt, tmp, aux);
 		}
-		tmp = rbt->slots[hash].child[0];
+		tmp = child_of(rbt, hash, 0);
 		if (tmp != not_a_hash) {
-			rbt->slots[tmp].parent = hash;
+			set_parent(rbt, tmp, hash);
 		}
-		tmp = rbt->slots[aux].child[0];
+		tmp = child_of(rbt, aux, 0);
 		if (tmp != aux) {
-			rbt->slots[tmp].parent = aux;
-			rbt->slots[rbt->slots[hash].parent].child[1] = hash;
+			set_parent(rbt, tmp, aux);
+			set_child(rbt, parent_of(rbt, hash), 1, hash);
 		} else {
-			rbt->slots[aux].child[0] = hash;
-			rbt->slots[hash].parent = aux;
+			set_child(rbt, aux, 0, hash);
+			set_parent(rbt, hash, aux);
 		}
 	}
-	tmp = rbt->slots[hash].parent;
-	aux = rbt->slots[hash].child[0];
+	tmp = parent_of(rbt, hash);
+	aux = child_of(rbt, hash, 0);
 	if (aux == not_a_hash) {
-		aux = rbt->slots[hash].child[1];
+		aux = child_of(rbt, hash, 1);
 	}
 	if (aux != not_a_hash) {
-		rbt->slots[aux].is_black = 1;
-		rbt->slots[aux].parent = tmp;
+		set_black(rbt, aux, 1);
+		set_parent(rbt, aux, tmp);
 	} else {
-		if (rbt->slots[hash].is_black) {
+		if (is_black(rbt, hash)) {
 			deletion_repair_rbt(rbt, hash);
 		}
 	}
 	if (tmp == not_a_hash) {
 		rbt->root = aux;
 	} else {
-		if (rbt->slots[tmp].child[0] == hash) {
-			rbt->slots[tmp].child[0] = aux;
+		if (child_of(rbt, tmp, 0) == hash) {
+			set_child(rbt, tmp, 0, aux);
 		} else {
-			rbt->slots[tmp].child[1] = aux;
+			set_child(rbt, tmp, 1, aux);
 		}
 	}
 	/* Free hash! */
-	rbt->slots[hash].child[0] = not_a_hash;
-	rbt->slots[hash].child[1] = not_a_hash;
-	rbt->slots[hash].parent = not_a_hash;
-	rbt->slots[hash].previous = not_a_hash;
-	rbt->slots[hash].next = rbt->first_free;
-	rbt->slots[hash].is_black = 0;
+	rbt->slots[hash].parent = NO_LINK;
+	set_child(rbt, hash, 0, not_a_hash);
+	set_child(rbt, hash, 1, not_a_hash);
+	set_previous(rbt, hash, not_a_hash);
+	set_next(rbt, hash, rbt->first_free);
 	if (rbt->first_free != not_a_hash) {
-		rbt->slots[rbt->first_free].previous = hash;
+		set_previous(rbt, rbt->first_free, hash);
 	}
 	rbt->first_free = hash;
 	DEBUG_RBT(rbt);
 	return 1;
 }
+
+/* Keys order of two hashes */
+static int compare_hashes(const struct rbt *rbt, size_t a, size_t b) {
+	return memcmp(key_of(rbt, a), key_of(rbt, b), rbt->key_size);
+}
+
+static void sift_down(const struct rbt *rbt, size_t *hashes, size_t root, size_t count) {
+	for (size_t child = 2 * root + 1; child < count; child = 2 * root + 1) {
+		if ((child + 1 < count) && (compare_hashes(rbt, hashes[child], hashes[child + 1]) < 0)) {
+			++child;
+		}
+		if (compare_hashes(rbt, hashes[root], hashes[child]) >= 0) {
+			return;
+		}
+		size_t tmp = hashes[root];
+		hashes[root] = hashes[child];
+		hashes[child] = tmp;
+		root = child;
+	}
+	return;
+}
+
+/* Heap sort of hashes by their keys, in place and without allocation */
+static void sort_hashes(const struct rbt *rbt, size_t *hashes, size_t count) {
+	for (size_t i = count / 2; i > 0; --i) {
+		sift_down(rbt, hashes, i - 1, count);
+	}
+	for (size_t end = count; end > 1; --end) {
+		size_t tmp = hashes[0];
+		hashes[0] = hashes[end - 1];
+		hashes[end - 1] = tmp;
+		sift_down(rbt, hashes, 0, end - 1);
+	}
+	return;
+}
+
+static _Bool increasing_keys(const struct rbt *rbt, const size_t *hashes, size_t count) {
+	for (size_t i = 1; i < count; ++i) {
+		if (compare_hashes(rbt, hashes[i - 1], hashes[i]) >= 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Link [hashes] from [lo] to [hi] (excluded), sorted by keys,
+ * as a perfectly balanced subtree of [parent] whose nodes at [red_depth] are red, and returns its root.
+ * Nodes are only at the deepest level with red_depth, so that all paths have the same number of black nodes.
+ */
+static size_t build(struct rbt *rbt, const size_t *hashes, size_t lo, size_t hi, size_t parent, size_t depth, size_t red_depth) {
+	if (lo >= hi) {
+		return not_a_hash;
+	}
+	size_t mid = lo + (hi - lo) / 2;
+	size_t node = hashes[mid];
+	rbt->slots[node].parent = NO_LINK;
+	set_parent(rbt, node, parent);
+	set_black(rbt, node, depth != red_depth);
+	set_child(rbt, node, 0, build(rbt, hashes, lo, mid, node, depth + 1, red_depth));
+	set_child(rbt, node, 1, build(rbt, hashes, mid + 1, hi, node, depth + 1, red_depth));
+#if RBT_PREFIX > 0
+	memcpy(rbt->slots[node].prefix, key_of(rbt, node), (rbt->key_size < RBT_PREFIX) ? rbt->key_size : RBT_PREFIX);
+#endif
+	return node;
+}
+
+/* Make the tree of the [count] sorted [hashes], which are bound to none */
+static void build_tree(struct rbt *rbt, const size_t *hashes, size_t count) {
+	size_t deepest = 0;
+	while ((((size_t)2) << deepest) <= count) {
+		++deepest;
+	}
+	/* Unless the tree is full, its deepest level is red */
+	_Bool full = ((count & (count + 1)) == 0);
+	rbt->root = build(rbt, hashes, 0, count, not_a_hash, 0, full ? not_a_hash : deepest);
+	rbt->black_depth = (count == 0) ? 0 : (full ? deepest + 1 : deepest);
+	size_t previous = not_a_hash;
+	for (size_t i = 0; i < count; ++i) {
+		size_t node = hashes[i];
+		set_previous(rbt, node, previous);
+		if (previous != not_a_hash) {
+			set_next(rbt, previous, node);
+		}
+		previous = node;
+	}
+	if (previous != not_a_hash) {
+		set_next(rbt, previous, not_a_hash);
+	}
+	rbt->least = (count == 0) ? not_a_hash : hashes[0];
+	rbt->greatest = previous;
+	return;
+}
+
+_Bool rbt_bulk_load(struct rbt *rbt, size_t *hashes, size_t count) {
+	if ((rbt == NULL) || ((hashes == NULL) && (count > 0)) || (rbt->root != not_a_hash) || (count > rbt->max_slots)) {
+		return 0;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		if (!rbt_is_free_hash(rbt, hashes[i])) {
+			return 0;
+		}
+	}
+	/* Strictly increasing keys, which also excludes repeated hashes: hashes already in order are not sorted again */
+	if (!increasing_keys(rbt, hashes, count)) {
+		sort_hashes(rbt, hashes, count);
+		if (!increasing_keys(rbt, hashes, count)) {
+			return 0;
+		}
+	}
+	for (size_t i = 0; i < count; ++i) {
+		size_t prev = previous_of(rbt, hashes[i]);
+		size_t next = next_of(rbt, hashes[i]);
+		if (prev == not_a_hash) {
+			rbt->first_free = next;
+		} else {
+			set_next(rbt, prev, next);
+		}
+		if (next != not_a_hash) {
+			set_previous(rbt, next, prev);
+		}
+	}
+	build_tree(rbt, hashes, count);
+	DEBUG_RBT(rbt);
+	return 1;
+}
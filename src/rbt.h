@@ -12,6 +12,9 @@ size_t rbt_alignment(void);
 /* Returns the number of bytes required to store the RedBlack tree storing at most [keys] keys. */
 size_t rbt_required_size(size_t keys);
 
+/* Returns the maximum number of keys of a RedBlack tree, bounded by the width of its links (see RBT_INDEX_BITS). */
+size_t rbt_max_keys(void);
+
 /* Initializes a part of the provided memory area.
  * NULL is returned in case of failure.
  * Otherwise a valid pointer is returned.
@@ -22,7 +25,8 @@ size_t rbt_required_size(size_t keys);
  * [key_size] is the size of all keys used to sort data in RedBlack tree.
  * [cell_size] is the gap between two keys in a separate array, so that keys can be recovered from hashes.
  * [first_key] is the start of the keys array. The key bound to hash [h] is at address [first_key] + [h] * [cell_size].
- * [keys] is the maximum number of keys to be managed by the RedBlack tree.
+ *             Only its distance to the tree is stored, so the tree and the keys can be moved (or mapped elsewhere) together.
+ * [keys] is the maximum number of keys to be managed by the RedBlack tree, at most rbt_max_keys().
  */
 struct rbt *rbt_init_empty(void **data, size_t *data_size, size_t key_size, size_t cell_size, void *first_key, size_t keys);
 
@@ -49,10 +53,27 @@ _Bool rbt_get_next_hash(const struct rbt *rbt, size_t hash, size_t *next);
 /* Successful if [hash] is bound, but not the least, returns the previous bound in [*hash]. */
 _Bool rbt_get_previous_hash(const struct rbt *rbt, size_t hash, size_t *previous);
 
+/* Successful if some bound key is greater than or equal to [key], returns the hash of the least one in [*hash] if so. */
+_Bool rbt_lower_bound(const struct rbt *rbt, const void *key, size_t *hash);
+
+/* Successful if some bound key is greater than [key], returns the hash of the least one in [*hash] if so. */
+_Bool rbt_upper_bound(const struct rbt *rbt, const void *key, size_t *hash);
+
+/* Successful if some bound keys start with the [size] first bytes of [prefix],
+ * returns the hashes of the least and the greatest of them in [*first] and [*last] if so:
+ * the others follow [*first] up to [*last] (see rbt_get_next_hash).
+ * Like the bounds, it only reads the tree, in O(log(keys)), and terminates even if the tree
+ * is modified meanwhile (eg. in shared memory), in which case the result must be discarded.
+ */
+_Bool rbt_get_prefix_range(const struct rbt *rbt, const void *prefix, size_t size, size_t *first, size_t *last);
+
 /* Successful if [key] is bound in [rbt], returns its associated hash in [*hash] if so. */
 _Bool rbt_get_hash(const struct rbt *rbt, const void *key, size_t *hash);
 
-/* Successful in the following two cases:
+/* The start of the key is copied in the tree when it is bound: the key must then be stored
+ * at the address of its hash in the keys array, before any other function is called on [rbt].
+ *
+ * Successful in the following two cases:
  * - [rbt] is not empty, [key] is not bound in [rbt] and [*hash] is free in [rbt],
  * - [key] is bound to some hash in [rbt].
  * In the first case, the [key] is bound to [*hash].
@@ -63,5 +84,15 @@ _Bool rbt_bind_key(struct rbt *rbt, const void *key, size_t *hash);
 /* Successful if [hash] is bound to some key in [rbt], in that case, it is then unbound. */
 _Bool rbt_unbind(struct rbt *rbt, size_t hash);
 
-#endif
+/* Successful if [rbt] is empty, and the keys of the free [hashes] (already stored in the keys array) are all different.
+ * In that case, [hashes] are sorted by their keys, and bound to them as a perfectly balanced tree, in O(count)
+ * if they were already sorted, O(count * log(count)) otherwise.
+ */
+_Bool rbt_bulk_load(struct rbt *rbt, size_t *hashes, size_t count);
 
+/* Successful if all the invariants of [rbt] hold: colours and black depth, links, free list, order of the keys
+ * and their copied prefixes. The first broken one is reported on stderr otherwise. In O(keys).
+ */
+_Bool rbt_check(const struct rbt *rbt);
+
+#endif
@@ -8,18 +8,34 @@ struct ringbuffer {
 	char data[];
 };
 
+size_t ringbuffer_required_size(size_t size) {
+	return sizeof(struct ringbuffer) + size;
+}
+
+size_t ringbuffer_alignment(void) {
+	return _Alignof(struct ringbuffer);
+}
+
+struct ringbuffer *ringbuffer_init(void *mem, size_t size) {
+	if ((mem == NULL) || (size <= 0)) {
+		return NULL;
+	}
+	struct ringbuffer *rb = mem;
+	rb->size = size;
+	rb->start = 0;
+	rb->used = 0;
+	return rb;
+}
+
 struct ringbuffer *ringbuffer_create(size_t size) {
 	if (size <= 0) {
 		return NULL;
 	}
-	struct ringbuffer *rb = malloc(sizeof(*rb) + size);
+	struct ringbuffer *rb = malloc(ringbuffer_required_size(size));
 	if (rb == NULL) {
 		return NULL;
 	}
-	rb->size = size;
-	rb->start = 0;
-	rb->used = 0;
-	return rb;
+	return ringbuffer_init(rb, size);
 }
 
 _Bool ringbuffer_valid(const struct ringbuffer *rb) {
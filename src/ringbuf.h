@@ -6,10 +6,19 @@ struct ringbuffer;
 /* Allocate a ring buffer of provided size */
 struct ringbuffer *ringbuffer_create(size_t size);
 
+/* Number of bytes and alignment of the memory needed by a ring buffer of provided size */
+size_t ringbuffer_required_size(size_t size);
+size_t ringbuffer_alignment(void);
+
+/* Build a ring buffer of provided size in a memory block of ringbuffer_required_size(size) bytes.
+ * The ring buffer does not contain any pointer, so the block can be moved or mapped elsewhere.
+ */
+struct ringbuffer *ringbuffer_init(void *mem, size_t size);
+
 /* Check that the ring buffer is a valid one */
 _Bool ringbuffer_valid(const struct ringbuffer *rb);
 
-/* Release a ring buffer */
+/* Release a ring buffer (only for ring buffers returned by ringbuffer_create) */
 void ringbuffer_destroy(struct ringbuffer *rb);
 
 /* Returns the size the ring buffer was created with */
@@ -0,0 +1,404 @@
+#include "textstore.h"
+#include "lz.h"
+#include "metrics.h"
+#include "ringbuf.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Raw part: the last few blocks, roughly what is displayed */
+#define HOT_BLOCKS 4
+
+/* Average compressed size the block table is sized for, better ratios are limited by the table */
+#define SLOT_SPAN 1024
+
+#define CACHED_BLOCKS 4
+
+#define POSITION_MASK ((((size_t)1) << TEXTSTORE_POSITION_BITS) - 1)
+
+#define MAX_TEXT 255
+
+/* lz_bound(TEXTSTORE_BLOCK) */
+#define PACKED_SIZE (TEXTSTORE_BLOCK + TEXTSTORE_BLOCK / 255 + 16)
+
+/* Compressed block number, stored at cold ring position pos (modulo cold_size) */
+struct cold_block {
+	size_t number;
+	size_t pos;
+	uint32_t size;
+	uint32_t raw; /* 1 if stored uncompressed, as it would not shrink */
+};
+
+/* Positions [start, hot_start) are in the cold blocks start / TEXTSTORE_BLOCK on (start is then a multiple of it),
+ * positions [hot_start, end) in the hot ring buffer. The block table is a ring indexed by block number.
+ * start, hot_start and end are published with release semantics: a block is written before hot_start
+ * moves past it, and whatever refers to dropped texts is discarded (see textstore_drop_cb) before start moves.
+ */
+struct textstore {
+	size_t size;
+	size_t hot_size;
+	size_t cold_size; /* 0 if the budget is too small, texts are then only kept raw */
+	size_t slots;
+	size_t cold_offset;
+	size_t hot_offset;
+	size_t start;
+	size_t hot_start;
+	size_t end;
+	size_t cold_tail; /* cold ring position of the oldest block */
+	size_t cold_head;
+	uint64_t blocks_compressed;
+	uint64_t bytes_compressed;
+	uint64_t bytes_stored;
+	uint64_t blocks_dropped;
+	struct cold_block table[];
+};
+
+struct cached_block {
+	size_t number;
+	_Bool valid;
+	uint64_t used;
+	char data[TEXTSTORE_BLOCK];
+};
+
+struct textstore_cache {
+	pthread_mutex_t lock;
+	uint64_t clock;
+	uint64_t hits;
+	uint64_t misses;
+	struct cached_block block[CACHED_BLOCKS];
+};
+
+static size_t align_up(size_t offset, size_t alignment) {
+	return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+/* Split of the budget between the block table, the cold ring and the hot ring buffer */
+static void layout(size_t size, size_t *hot_size, size_t *cold_size, size_t *slots) {
+	*hot_size = HOT_BLOCKS * TEXTSTORE_BLOCK;
+	size_t avail = (size > *hot_size) ? size - *hot_size : 0;
+	*slots = avail / (SLOT_SPAN + sizeof(struct cold_block));
+	*cold_size = avail - *slots * sizeof(struct cold_block);
+	if (*cold_size < (4 * PACKED_SIZE)) {
+		*hot_size = size;
+		*cold_size = 0;
+		*slots = 0;
+	}
+	return;
+}
+
+size_t textstore_required_size(size_t size) {
+	size_t hot_size;
+	size_t cold_size;
+	size_t slots;
+	layout(size, &hot_size, &cold_size, &slots);
+	size_t hot_offset = align_up(sizeof(struct textstore) + slots * sizeof(struct cold_block) + cold_size, ringbuffer_alignment());
+	return hot_offset + ringbuffer_required_size(hot_size);
+}
+
+size_t textstore_alignment(void) {
+	size_t a = _Alignof(struct textstore);
+	return (ringbuffer_alignment() > a) ? ringbuffer_alignment() : a;
+}
+
+struct textstore *textstore_init(void *mem, size_t size) {
+	if ((mem == NULL) || (size <= MAX_TEXT)) {
+		return NULL;
+	}
+	struct textstore *ts = mem;
+	ts->size = size;
+	layout(size, &ts->hot_size, &ts->cold_size, &ts->slots);
+	ts->cold_offset = sizeof(struct textstore) + ts->slots * sizeof(struct cold_block);
+	ts->hot_offset = align_up(ts->cold_offset + ts->cold_size, ringbuffer_alignment());
+	ts->start = 0;
+	ts->hot_start = 0;
+	ts->end = 0;
+	ts->cold_tail = 0;
+	ts->cold_head = 0;
+	ts->blocks_compressed = 0;
+	ts->bytes_compressed = 0;
+	ts->bytes_stored = 0;
+	ts->blocks_dropped = 0;
+	if (ringbuffer_init((char *)ts + ts->hot_offset, ts->hot_size) == NULL) {
+		return NULL;
+	}
+	return ts;
+}
+
+size_t textstore_size(const struct textstore *ts) {
+	if (ts == NULL) {
+		return 0;
+	}
+	return ts->size;
+}
+
+static struct ringbuffer *hot(const struct textstore *ts) {
+	return (struct ringbuffer *)((char *)ts + ts->hot_offset);
+}
+
+static char *cold(const struct textstore *ts) {
+	return (char *)ts + ts->cold_offset;
+}
+
+static void set_start(struct textstore *ts, size_t start) {
+	__atomic_store_n(&ts->start, start, __ATOMIC_RELEASE);
+	return;
+}
+
+/* Drop the raw texts below [target] */
+static void drop_hot(struct textstore *ts, size_t target, textstore_drop_cb drop, void *ctx) {
+	drop(ctx, target);
+	ringbuffer_erase(hot(ts), ts->hot_start, target - ts->hot_start);
+	__atomic_store_n(&ts->hot_start, target, __ATOMIC_RELEASE);
+	set_start(ts, target);
+	return;
+}
+
+static void drop_cold(struct textstore *ts, textstore_drop_cb drop, void *ctx) {
+	size_t number = ts->start / TEXTSTORE_BLOCK;
+	size_t next = (number + 1) * TEXTSTORE_BLOCK;
+	drop(ctx, next);
+	set_start(ts, next);
+	ts->cold_tail = (next < ts->hot_start) ? ts->table[(number + 1) % ts->slots].pos : ts->cold_head;
+	++ts->blocks_dropped;
+	return;
+}
+
+/* Move the oldest raw block to the cold ring */
+static void compress_oldest(struct textstore *ts, textstore_drop_cb drop, void *ctx) {
+	char raw[TEXTSTORE_BLOCK];
+	char packed[PACKED_SIZE];
+	size_t number = ts->hot_start / TEXTSTORE_BLOCK;
+	(void)ringbuffer_read(hot(ts), ts->hot_start, raw, TEXTSTORE_BLOCK);
+	size_t size = lz_compress(raw, TEXTSTORE_BLOCK, packed, sizeof(packed));
+	_Bool stored_raw = (size == 0) || (size >= TEXTSTORE_BLOCK);
+	if (stored_raw) {
+		size = TEXTSTORE_BLOCK;
+	}
+	while ((ts->start < ts->hot_start) && ((number - (ts->start / TEXTSTORE_BLOCK)) >= ts->slots)) {
+		drop_cold(ts, drop, ctx);
+	}
+	size_t pos;
+	while (1) {
+		if (ts->start == ts->hot_start) {
+			/* Empty, start over at the beginning of the ring */
+			ts->cold_head = align_up(ts->cold_head, ts->cold_size);
+			ts->cold_tail = ts->cold_head;
+		}
+		pos = ts->cold_head;
+		size_t phys = pos % ts->cold_size;
+		if ((phys + size) > ts->cold_size) {
+			/* Blocks do not wrap */
+			pos += ts->cold_size - phys;
+		}
+		if ((pos + size - ts->cold_tail) <= ts->cold_size) {
+			break;
+		}
+		drop_cold(ts, drop, ctx);
+	}
+	memcpy(cold(ts) + (pos % ts->cold_size), stored_raw ? raw : packed, size);
+	ts->table[number % ts->slots] = (struct cold_block){ .number = number, .pos = pos, .size = size, .raw = stored_raw };
+	ts->cold_head = pos + size;
+	++ts->blocks_compressed;
+	ts->bytes_compressed += TEXTSTORE_BLOCK;
+	ts->bytes_stored += size;
+	/* Publish the block before the raw text can be overwritten */
+	__atomic_store_n(&ts->hot_start, ts->hot_start + TEXTSTORE_BLOCK, __ATOMIC_RELEASE);
+	ringbuffer_erase(hot(ts), number * TEXTSTORE_BLOCK, TEXTSTORE_BLOCK);
+	return;
+}
+
+int textstore_append(struct textstore *ts, const char *text, size_t size, size_t *position, textstore_drop_cb drop, void *ctx) {
+	if ((ts == NULL) || (position == NULL) || (drop == NULL) || ((text == NULL) && (size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (size > MAX_TEXT) {
+		errno = EINVAL;
+		return -1;
+	}
+	/* Low bits of the positions must designate a single retained one */
+	while ((ts->end + size - ts->start) > POSITION_MASK) {
+		if (ts->start < ts->hot_start) {
+			drop_cold(ts, drop, ctx);
+		} else {
+			drop_hot(ts, ts->end + size - POSITION_MASK, drop, ctx);
+		}
+	}
+	while ((ts->end + size - ts->hot_start) > ts->hot_size) {
+		if (ts->cold_size == 0) {
+			drop_hot(ts, ts->end + size - ts->hot_size, drop, ctx);
+		} else {
+			compress_oldest(ts, drop, ctx);
+		}
+	}
+	if (ringbuffer_write(hot(ts), ts->end, text, size) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	*position = ts->end;
+	__atomic_store_n(&ts->end, ts->end + size, __ATOMIC_RELEASE);
+	return 0;
+}
+
+size_t textstore_position(const struct textstore *ts, size_t low) {
+	if (ts == NULL) {
+		return 0;
+	}
+	size_t start = __atomic_load_n(&ts->start, __ATOMIC_ACQUIRE);
+	return start + ((low - start) & POSITION_MASK);
+}
+
+/* Copy [size] bytes at [offset] of cold block [number], returns -1 if it has been dropped or is corrupted */
+static int read_block(const struct textstore *ts, struct textstore_cache *cache, size_t number, size_t offset, size_t size, char *data) {
+	pthread_mutex_lock(&cache->lock);
+	struct cached_block *victim = &cache->block[0];
+	for (size_t i = 0; i < CACHED_BLOCKS; ++i) {
+		struct cached_block *c = &cache->block[i];
+		if (c->valid && (c->number == number)) {
+			c->used = ++cache->clock;
+			++cache->hits;
+			memcpy(data, c->data + offset, size);
+			pthread_mutex_unlock(&cache->lock);
+			return 0;
+		}
+		if (!c->valid || (c->used < victim->used)) {
+			victim = c;
+		}
+	}
+	++cache->misses;
+	victim->valid = 0;
+	struct cold_block b = ts->table[number % ts->slots];
+	atomic_thread_fence(memory_order_acquire);
+	int res = -1;
+	errno = EDOM;
+	if ((b.number == number) && (__atomic_load_n(&ts->start, __ATOMIC_RELAXED) <= (number * TEXTSTORE_BLOCK))) {
+		size_t phys = b.pos % ts->cold_size;
+		ssize_t decoded = -1;
+		errno = EIO;
+		if ((b.size <= ts->cold_size - phys) && b.raw && (b.size == TEXTSTORE_BLOCK)) {
+			memcpy(victim->data, cold(ts) + phys, TEXTSTORE_BLOCK);
+			decoded = TEXTSTORE_BLOCK;
+		} else if ((b.size <= ts->cold_size - phys) && !b.raw) {
+			decoded = lz_decompress(cold(ts) + phys, b.size, victim->data, TEXTSTORE_BLOCK);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (__atomic_load_n(&ts->start, __ATOMIC_RELAXED) > (number * TEXTSTORE_BLOCK)) {
+			/* Dropped while being decoded */
+			errno = EDOM;
+		} else if (decoded == TEXTSTORE_BLOCK) {
+			victim->number = number;
+			victim->valid = 1;
+			victim->used = ++cache->clock;
+			memcpy(data, victim->data + offset, size);
+			res = 0;
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return res;
+}
+
+int textstore_read(const struct textstore *ts, struct textstore_cache *cache, size_t position, size_t size, char *data) {
+	if ((ts == NULL) || (cache == NULL) || ((data == NULL) && (size > 0))) {
+		errno = EFAULT;
+		return -1;
+	}
+	if (size == 0) {
+		return 0;
+	}
+	size_t pos = textstore_position(ts, position);
+	if ((pos < __atomic_load_n(&ts->start, __ATOMIC_ACQUIRE)) || ((pos + size) > __atomic_load_n(&ts->end, __ATOMIC_ACQUIRE))) {
+		errno = EDOM;
+		return -1;
+	}
+	while (1) {
+		size_t hot_start = __atomic_load_n(&ts->hot_start, __ATOMIC_ACQUIRE);
+		size_t done = 0;
+		while ((done < size) && ((pos + done) < hot_start)) {
+			size_t number = (pos + done) / TEXTSTORE_BLOCK;
+			size_t offset = (pos + done) % TEXTSTORE_BLOCK;
+			size_t n = TEXTSTORE_BLOCK - offset;
+			if (n > (size - done)) {
+				n = size - done;
+			}
+			if (read_block(ts, cache, number, offset, n, data + done) != 0) {
+				return -1;
+			}
+			done += n;
+		}
+		if (done == size) {
+			return 0;
+		}
+		(void)ringbuffer_read(hot(ts), pos + done, data + done, size - done);
+		/* Raw bytes are only overwritten once their block has been compressed */
+		atomic_thread_fence(memory_order_acquire);
+		if (__atomic_load_n(&ts->hot_start, __ATOMIC_RELAXED) <= (pos + done)) {
+			return 0;
+		}
+	}
+}
+
+void textstore_usage(const struct textstore *ts, size_t *used, size_t *size) {
+	if ((ts == NULL) || (used == NULL) || (size == NULL)) {
+		return;
+	}
+	size_t hot_used = __atomic_load_n(&ts->end, __ATOMIC_ACQUIRE) - __atomic_load_n(&ts->hot_start, __ATOMIC_ACQUIRE);
+	*used = ts->slots * sizeof(struct cold_block) + (ts->cold_head - ts->cold_tail) + hot_used;
+	*size = ts->size;
+	return;
+}
+
+struct textstore_cache *textstore_cache_create(void) {
+	struct textstore_cache *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	if (pthread_mutex_init(&cache->lock, NULL) != 0) {
+		free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void textstore_cache_destroy(struct textstore_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	return;
+}
+
+void textstore_cache_clear(struct textstore_cache *cache) {
+	if (cache == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&cache->lock);
+	for (size_t i = 0; i < CACHED_BLOCKS; ++i) {
+		cache->block[i].valid = 0;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return;
+}
+
+void textstore_dump_metrics(const struct textstore *ts, const struct textstore_cache *cache, int fd) {
+	if (ts == NULL) {
+		return;
+	}
+	size_t start = __atomic_load_n(&ts->start, __ATOMIC_ACQUIRE);
+	size_t end = __atomic_load_n(&ts->end, __ATOMIC_ACQUIRE);
+	metrics_dump_counter(fd, "text", "hot_size", ts->hot_size);
+	metrics_dump_counter(fd, "text", "cold_size", ts->cold_size);
+	metrics_dump_counter(fd, "text", "retained_bytes", end - start);
+	metrics_dump_counter(fd, "text", "cold_used", ts->cold_head - ts->cold_tail);
+	metrics_dump_counter(fd, "text", "blocks_compressed", ts->blocks_compressed);
+	metrics_dump_counter(fd, "text", "blocks_dropped", ts->blocks_dropped);
+	metrics_dump_counter(fd, "text", "bytes_compressed", ts->bytes_compressed);
+	metrics_dump_counter(fd, "text", "bytes_stored", ts->bytes_stored);
+	if (cache != NULL) {
+		metrics_dump_counter(fd, "text", "cache_hits", cache->hits);
+		metrics_dump_counter(fd, "text", "cache_misses", cache->misses);
+	}
+	return;
+}
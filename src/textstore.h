@@ -0,0 +1,76 @@
+#ifndef TEXTSTORE
+#define TEXTSTORE
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Store of the entry texts, within a fixed memory budget.
+ *
+ * Texts are appended one after the other at increasing positions. The most recent ones
+ * are kept raw in a ring buffer (the hot part); once it is full, its oldest block of
+ * TEXTSTORE_BLOCK positions is LZ compressed (see lz.h) to the cold part, a ring of
+ * compressed blocks, so that the budget holds several times more text than raw.
+ * When the cold part is full too, the oldest blocks are dropped.
+ * Reading a cold text decompresses its block into a small cache of the reader.
+ *
+ * Positions only ever increase, but only their low TEXTSTORE_POSITION_BITS are kept in the entries:
+ * the store never retains more than that span, so that a low part designates a single retained position.
+ *
+ * Like the ring buffer, the store does not contain any pointer, so it can be moved or mapped elsewhere.
+ * It is written by a single thread, and can be read concurrently by any thread or process:
+ * a text copied while being dropped may be corrupted, readers must check afterwards that it is
+ * still retained (the log engine does it by checking that the entry has not been discarded).
+ */
+struct textstore;
+
+/* Decoded blocks of a reader, to be shared by the threads of a process only */
+struct textstore_cache;
+
+#define TEXTSTORE_BLOCK 16384
+
+/* Out of the 24 bits of entry text offsets, the log engine uses the last one to flag interned texts */
+#define TEXTSTORE_POSITION_BITS 23
+
+/* Called before texts below position [start] are dropped, to discard whatever refers to them */
+typedef void (*textstore_drop_cb)(void *ctx, size_t start);
+
+/* Number of bytes and alignment of the memory needed by a text store of provided budget */
+size_t textstore_required_size(size_t size);
+size_t textstore_alignment(void);
+
+/* Build a text store of provided budget in a memory block of textstore_required_size(size) bytes.
+ * Budgets too small to hold a cold part only keep raw texts.
+ */
+struct textstore *textstore_init(void *mem, size_t size);
+
+/* Returns the budget the store was built with */
+size_t textstore_size(const struct textstore *ts);
+
+/* Append a text of [size] bytes (at most 255), and set its position.
+ * drop is called with ctx before older texts are dropped to make room.
+ * Returns 0 on success, -1 on failure.
+ */
+int textstore_append(struct textstore *ts, const char *text, size_t size, size_t *position, textstore_drop_cb drop, void *ctx);
+
+/* Full position of a retained text from the low bits of its position */
+size_t textstore_position(const struct textstore *ts, size_t low);
+
+/* Read [size] bytes from the text at [position] (full, or only its low bits) to data.
+ * Returns 0 on success, -1 if they are not retained (EDOM) or their block is corrupted (EIO).
+ */
+int textstore_read(const struct textstore *ts, struct textstore_cache *cache, size_t position, size_t size, char *data);
+
+/* Get the number of bytes of the budget in use, and the budget */
+void textstore_usage(const struct textstore *ts, size_t *used, size_t *size);
+
+struct textstore_cache *textstore_cache_create(void);
+
+void textstore_cache_destroy(struct textstore_cache *cache);
+
+/* Forget the decoded blocks, when the store they come from has been replaced (eg. restored) */
+void textstore_cache_clear(struct textstore_cache *cache);
+
+/* Writes the store counters to fd, one "text.<name> <value>" line per metric, with those of the cache if not NULL */
+void textstore_dump_metrics(const struct textstore *ts, const struct textstore_cache *cache, int fd);
+
+#endif
@@ -0,0 +1,198 @@
+#include "../characters.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Micro-benchmark of the ordered index backends of the characters table,
+ * on lookups, inserts, completion and churn (unhash then hash again).
+ * Completions of both backends are compared, so that a backend cannot be fast by being wrong.
+ */
+
+#define BOLD "\x1b[1m"
+#define NORM "\x1b[0m"
+
+#define NAME_SIZE 64
+
+static const char *const backend_names[] = {
+	[CHARACTERS_RBT] = "rbt",
+	[CHARACTERS_EYTZINGER] = "eytzinger",
+};
+
+struct results {
+	uint64_t insert_ns;
+	uint64_t bulk_ns;
+	uint64_t lookup_ns;
+	uint64_t complete_ns;
+	uint64_t churn_ns;
+	uint64_t matches;
+	uint64_t checksum;
+};
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t next_random(uint64_t *seed) {
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+/* Names as found in the logs: a capital, then a few letters, sometimes accented or with a dash */
+static void make_names(char (*names)[NAME_SIZE], size_t count, uint64_t seed) {
+	static const char *const syllables[] = { "ka", "lo", "mi", "ra", "to", "é", "ze", "ou", "ni", "ï", "-", "an", "el", "so" };
+	size_t syllables_count = sizeof(syllables) / sizeof(syllables[0]);
+	for (size_t i = 0; i < count; ++i) {
+		size_t len = 0;
+		names[i][len++] = 'A' + next_random(&seed) % 26;
+		size_t parts = 2 + next_random(&seed) % 5;
+		for (size_t p = 0; p < parts; ++p) {
+			const char *s = syllables[next_random(&seed) % syllables_count];
+			size_t size = strlen(s);
+			memcpy(names[i] + len, s, size);
+			len += size;
+		}
+		/* A suffix keeps them all different */
+		snprintf(names[i] + len, NAME_SIZE - len, "%zu", i);
+	}
+	return;
+}
+
+static int run(enum characters_backend backend, char (*names)[NAME_SIZE], size_t count, size_t lookups, struct results *res) {
+	memset(res, 0, sizeof(*res));
+	struct characters *chars = characters_create(count, backend);
+	size_t *hashes = malloc(count * sizeof(*hashes));
+	const char **list = malloc(count * sizeof(*list));
+	if ((chars == NULL) || (hashes == NULL) || (list == NULL)) {
+		characters_destroy(chars);
+		free(hashes);
+		free(list);
+		return -1;
+	}
+	uint64_t seed = 7;
+	uint64_t start = now_ns();
+	for (size_t i = 0; i < count; ++i) {
+		if (characters_hash(chars, names[i], &hashes[i]) != 0) {
+			return -1;
+		}
+	}
+	res->insert_ns = (now_ns() - start) / count;
+
+	start = now_ns();
+	for (size_t i = 0; i < lookups; ++i) {
+		size_t hash;
+		size_t n = next_random(&seed) % count;
+		if ((characters_hash(chars, names[n], &hash) != 0) || (hash != hashes[n])) {
+			return -1;
+		}
+	}
+	res->lookup_ns = (now_ns() - start) / lookups;
+
+	size_t rounds = lookups / 10 + 1;
+	start = now_ns();
+	for (size_t i = 0; i < rounds; ++i) {
+		const char *name = names[next_random(&seed) % count];
+		char prefix[3] = { name[0], name[1], '\0' };
+		size_t matches;
+		if (characters_complete_all(chars, prefix, hashes, count, &matches) != 0) {
+			return -1;
+		}
+		res->matches += matches;
+		for (size_t m = 0; m < matches; ++m) {
+			/* Completions are in order: checksum of the names, weighted by their position */
+			res->checksum += (m + 1) * (unsigned char)characters_name(chars, hashes[m])[2];
+		}
+	}
+	res->complete_ns = (now_ns() - start) / rounds;
+	res->matches /= rounds;
+
+	rounds = lookups / 100 + 1;
+	start = now_ns();
+	for (size_t i = 0; i < rounds; ++i) {
+		size_t hash;
+		size_t n = next_random(&seed) % count;
+		if ((characters_find(chars, names[n], &hash) != 0) || (characters_unhash(chars, hash) != 0)
+				|| (characters_hash(chars, names[n], &hash) != 0)) {
+			return -1;
+		}
+	}
+	res->churn_ns = (now_ns() - start) / rounds;
+	characters_destroy(chars);
+
+	chars = characters_create(count, backend);
+	if (chars == NULL) {
+		return -1;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		list[i] = names[i];
+	}
+	start = now_ns();
+	if (characters_hash_all(chars, list, count, hashes) != 0) {
+		return -1;
+	}
+	res->bulk_ns = (now_ns() - start) / count;
+	characters_destroy(chars);
+	free(hashes);
+	free(list);
+	return 0;
+}
+
+static void usage(const char *progname) {
+	dprintf(2, BOLD "%s" NORM " [" BOLD "-n" NORM " <names>] [" BOLD "-l" NORM " <lookups>]\n", progname);
+	return;
+}
+
+int main(int argc, char **argv) {
+	const char *progname = (argc > 0) ? argv[0] : "wnames";
+	size_t count = 2000;
+	size_t lookups = 1000000;
+	int c;
+	while ((c = getopt(argc, argv, "n:l:")) != -1) {
+		switch (c) {
+			case 'n':
+				count = strtoul(optarg, NULL, 10);
+				break;
+			case 'l':
+				lookups = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(progname);
+				return -1;
+		}
+	}
+	if ((count == 0) || (lookups == 0)) {
+		usage(progname);
+		return -1;
+	}
+	char (*names)[NAME_SIZE] = calloc(count, sizeof(*names));
+	if (names == NULL) {
+		dprintf(2, "Not enough memory\n");
+		return -1;
+	}
+	make_names(names, count, 42);
+	printf("%zu names, %zu lookups\n", count, lookups);
+	printf("%-10s %10s %10s %10s %12s %10s %8s\n", "backend", "insert", "bulk", "lookup", "complete", "churn", "matches");
+	struct results res[2];
+	int failures = 0;
+	for (size_t b = 0; b < 2; ++b) {
+		if (run(b, names, count, lookups, &res[b]) != 0) {
+			printf("%-10s FAILED\n", backend_names[b]);
+			++failures;
+			continue;
+		}
+		printf("%-10s %7" PRIu64 " ns %7" PRIu64 " ns %7" PRIu64 " ns %9" PRIu64 " ns %7" PRIu64 " ns %8" PRIu64 "\n", backend_names[b],
+			res[b].insert_ns, res[b].bulk_ns, res[b].lookup_ns, res[b].complete_ns, res[b].churn_ns, res[b].matches);
+	}
+	if ((failures == 0) && (res[0].checksum != res[1].checksum)) {
+		printf("Completions differ between backends\n");
+		++failures;
+	}
+	free(names);
+	return (failures == 0) ? 0 : 1;
+}
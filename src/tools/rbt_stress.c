@@ -0,0 +1,365 @@
+#include "../metrics.h"
+#include "../rbt.h"
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Randomized stress test and benchmark of the RedBlack trees of rbt.h.
+ * Random binds, unbinds, lookups and walks are checked against a shadow table,
+ * and the whole tree against its invariants (rbt_check) periodically.
+ * Then each operation is timed on its own, with the cache misses counted by perf_event_open when available.
+ */
+
+#define BOLD "\x1b[1m"
+#define NORM "\x1b[0m"
+
+/* Longer than the prefix copied in the nodes, so that comparisons also read the keys */
+#define KEY_SIZE 16
+
+struct shadow {
+	size_t keys;
+	size_t universe;
+	char *cells;
+	size_t *hash_of; /* per key of the universe, not_a_hash if unbound */
+	size_t *key_of; /* per hash, the key of the universe it is bound to */
+	size_t *bound; /* bound hashes, in any order */
+	size_t *position; /* of each bound hash in bound */
+	size_t count;
+};
+
+static const size_t not_bound = SIZE_MAX;
+
+static uint64_t next_random(uint64_t *seed) {
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 7;
+	*seed ^= *seed << 17;
+	return *seed;
+}
+
+/* Key [u] of the universe: u written in base 4 with letters, the greatest digits first.
+ * Keys share long prefixes, and their order is the one of the universe.
+ */
+static void make_key(size_t u, char *key) {
+	for (size_t i = 0; i < KEY_SIZE; ++i) {
+		key[KEY_SIZE - 1 - i] = 'a' + (char)((u >> (2 * i)) & 3);
+	}
+	return;
+}
+
+static int check_failed(const char *what, uint64_t op) {
+	dprintf(2, "Operation %" PRIu64 ": %s\n", op, what);
+	return -1;
+}
+
+static void shadow_bind(struct shadow *s, size_t u, size_t hash) {
+	s->hash_of[u] = hash;
+	s->key_of[hash] = u;
+	s->position[hash] = s->count;
+	s->bound[s->count++] = hash;
+	return;
+}
+
+static void shadow_unbind(struct shadow *s, size_t hash) {
+	s->hash_of[s->key_of[hash]] = not_bound;
+	size_t last = s->bound[--s->count];
+	s->bound[s->position[hash]] = last;
+	s->position[last] = s->position[hash];
+	return;
+}
+
+/* The whole tree against the shadow: its keys in order are the bound ones */
+static int check_all(struct rbt *rbt, const struct shadow *s, uint64_t op) {
+	if (!rbt_check(rbt)) {
+		return check_failed("invariants broken", op);
+	}
+	size_t hash;
+	size_t walked = 0;
+	size_t previous = 0;
+	for (_Bool more = rbt_get_least(rbt, &hash); more; more = rbt_get_next_hash(rbt, hash, &hash)) {
+		if ((hash >= s->keys) || (s->hash_of[s->key_of[hash]] != hash)) {
+			return check_failed("unknown hash in the tree", op);
+		}
+		if ((walked > 0) && (s->key_of[hash] <= previous)) {
+			return check_failed("keys out of order", op);
+		}
+		previous = s->key_of[hash];
+		++walked;
+	}
+	if (walked != s->count) {
+		return check_failed("missing keys in the tree", op);
+	}
+	return 0;
+}
+
+static int stress(struct rbt *rbt, struct shadow *s, uint64_t ops, uint64_t period, uint64_t *seed) {
+	char key[KEY_SIZE];
+	for (uint64_t op = 0; op < ops; ++op) {
+		size_t u = next_random(seed) % s->universe;
+		unsigned kind = next_random(seed) % 100;
+		size_t hash;
+		make_key(u, key);
+		if (kind < 40) {
+			if (s->hash_of[u] != not_bound) {
+				if (!rbt_bind_key(rbt, key, &hash) || (hash != s->hash_of[u])) {
+					return check_failed("bound key not found by bind", op);
+				}
+			} else if (!rbt_get_free(rbt, &hash)) {
+				if (s->count < s->keys) {
+					return check_failed("no free hash in a tree not full", op);
+				}
+			} else {
+				memcpy(s->cells + hash * KEY_SIZE, key, KEY_SIZE);
+				size_t bound = hash;
+				if (!rbt_bind_key(rbt, key, &bound) || (bound != hash)) {
+					return check_failed("bind failed", op);
+				}
+				shadow_bind(s, u, hash);
+			}
+		} else if (kind < 60) {
+			if (s->count > 0) {
+				hash = s->bound[next_random(seed) % s->count];
+				if (!rbt_unbind(rbt, hash) || !rbt_is_free_hash(rbt, hash)) {
+					return check_failed("unbind failed", op);
+				}
+				shadow_unbind(s, hash);
+			}
+		} else if (kind < 85) {
+			_Bool found = rbt_get_hash(rbt, key, &hash);
+			if ((found != (s->hash_of[u] != not_bound)) || (found && (hash != s->hash_of[u]))) {
+				return check_failed("lookup differs from the shadow", op);
+			}
+		} else if (s->count > 0) {
+			hash = s->bound[next_random(seed) % s->count];
+			for (size_t step = 0; step < 8; ++step) {
+				size_t next;
+				if (!rbt_get_next_hash(rbt, hash, &next)) {
+					break;
+				}
+				if (s->key_of[next] <= s->key_of[hash]) {
+					return check_failed("next key is not greater", op);
+				}
+				hash = next;
+			}
+		}
+		if ((period > 0) && ((op + 1) % period == 0) && (check_all(rbt, s, op) != 0)) {
+			return -1;
+		}
+	}
+	return check_all(rbt, s, ops);
+}
+
+static int open_cache_misses(void) {
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_MISSES,
+		.disabled = 1,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+struct measure {
+	int fd;
+	uint64_t start;
+	uint64_t ns;
+	uint64_t misses;
+	uint64_t ops;
+};
+
+static void measure_start(struct measure *m) {
+	if (m->fd >= 0) {
+		ioctl(m->fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(m->fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	m->start = metrics_now();
+	return;
+}
+
+static void measure_stop(struct measure *m, uint64_t ops) {
+	m->ns += metrics_now() - m->start;
+	m->ops += ops;
+	uint64_t misses;
+	if ((m->fd >= 0) && (ioctl(m->fd, PERF_EVENT_IOC_DISABLE, 0) == 0) && (read(m->fd, &misses, sizeof(misses)) == sizeof(misses))) {
+		m->misses += misses;
+	}
+	return;
+}
+
+static void report(const char *name, const struct measure *m) {
+	char duration[16];
+	metrics_format_duration(duration, sizeof(duration), m->ops ? m->ns / m->ops : 0);
+	printf("%-8s %10" PRIu64 " ops %8s/op %10.2f Mops/s", name, m->ops, duration, m->ns ? (1000.0 * m->ops) / m->ns : 0.0);
+	if (m->fd >= 0) {
+		printf(" %8.2f cache misses/op", m->ops ? (double)m->misses / m->ops : 0.0);
+	}
+	printf("\n");
+	return;
+}
+
+/* Each round fills the empty tree in a random order, looks keys up (half of them unbound),
+ * walks it in order, and empties it in a random order.
+ */
+static int bench(struct rbt *rbt, struct shadow *s, uint64_t ops, uint64_t *seed) {
+	struct measure m[4];
+	const char *names[4] = { "bind", "lookup", "next", "unbind" };
+	int fd = open_cache_misses();
+	for (size_t i = 0; i < 4; ++i) {
+		m[i] = (struct measure){ .fd = fd };
+	}
+	size_t *order = malloc(s->keys * sizeof(*order));
+	if (order == NULL) {
+		return -1;
+	}
+	char key[KEY_SIZE];
+	size_t hash;
+	while (s->count > 0) {
+		rbt_unbind(rbt, s->bound[0]);
+		shadow_unbind(s, s->bound[0]);
+	}
+	for (uint64_t done = 0; done < ops; done += s->keys) {
+		for (size_t i = 0; i < s->keys; ++i) {
+			order[i] = i;
+		}
+		for (size_t i = s->keys - 1; i > 0; --i) {
+			size_t j = next_random(seed) % (i + 1);
+			size_t t = order[i];
+			order[i] = order[j];
+			order[j] = t;
+		}
+		/* Keys are the even ones of the universe, so that the odd ones are missing */
+		for (size_t i = 0; i < s->keys; ++i) {
+			make_key(2 * order[i], s->cells + i * KEY_SIZE);
+		}
+		measure_start(&m[0]);
+		for (size_t i = 0; i < s->keys; ++i) {
+			hash = i;
+			if (!rbt_bind_key(rbt, s->cells + i * KEY_SIZE, &hash)) {
+				return check_failed("bind failed", done);
+			}
+		}
+		measure_stop(&m[0], s->keys);
+
+		size_t found = 0;
+		measure_start(&m[1]);
+		for (size_t i = 0; i < s->keys; ++i) {
+			make_key(order[i], key);
+			found += rbt_get_hash(rbt, key, &hash);
+		}
+		measure_stop(&m[1], s->keys);
+
+		size_t walked = 0;
+		measure_start(&m[2]);
+		for (_Bool more = rbt_get_least(rbt, &hash); more; more = rbt_get_next_hash(rbt, hash, &hash)) {
+			++walked;
+		}
+		measure_stop(&m[2], walked);
+
+		measure_start(&m[3]);
+		for (size_t i = 0; i < s->keys; ++i) {
+			if (!rbt_unbind(rbt, order[i])) {
+				return check_failed("unbind failed", done);
+			}
+		}
+		measure_stop(&m[3], s->keys);
+		if ((walked != s->keys) || (found == 0)) {
+			return check_failed("bench tree inconsistent", done);
+		}
+	}
+	for (size_t i = 0; i < 4; ++i) {
+		report(names[i], &m[i]);
+	}
+	if (fd < 0) {
+		printf("(cache misses unavailable: perf_event_open failed)\n");
+	} else {
+		close(fd);
+	}
+	free(order);
+	return 0;
+}
+
+static void usage(const char *progname) {
+	dprintf(2, BOLD "%s" NORM " [" BOLD "-n" NORM " <keys>] [" BOLD "-o" NORM " <operations>] [" BOLD "-c" NORM " <check period>] [" BOLD "-s" NORM " <seed>]\n", progname);
+	dprintf(2, "  The tree is checked every <check period> operations of the stress test, 0 to only check at its end.\n");
+	return;
+}
+
+int main(int argc, char **argv) {
+	const char *progname = (argc > 0) ? argv[0] : "wrbt";
+	size_t keys = 10000;
+	uint64_t ops = 4000000;
+	uint64_t period = 100000;
+	uint64_t seed = 1;
+	int c;
+	while ((c = getopt(argc, argv, "n:o:c:s:")) != -1) {
+		switch (c) {
+			case 'n':
+				keys = strtoul(optarg, NULL, 10);
+				break;
+			case 'o':
+				ops = strtoull(optarg, NULL, 10);
+				break;
+			case 'c':
+				period = strtoull(optarg, NULL, 10);
+				break;
+			case 's':
+				seed = strtoull(optarg, NULL, 10);
+				break;
+			default:
+				usage(progname);
+				return -1;
+		}
+	}
+	if ((keys == 0) || (keys > rbt_max_keys()) || (seed == 0)) {
+		usage(progname);
+		return -1;
+	}
+	struct shadow s = {
+		.keys = keys,
+		.universe = 2 * keys,
+		.cells = malloc(keys * KEY_SIZE),
+		.hash_of = malloc(2 * keys * sizeof(size_t)),
+		.key_of = malloc(keys * sizeof(size_t)),
+		.bound = malloc(keys * sizeof(size_t)),
+		.position = malloc(keys * sizeof(size_t)),
+	};
+	size_t size = rbt_required_size(keys);
+	void *mem = aligned_alloc(rbt_alignment(), ((size + rbt_alignment() - 1) / rbt_alignment()) * rbt_alignment());
+	if ((s.cells == NULL) || (s.hash_of == NULL) || (s.key_of == NULL) || (s.bound == NULL) || (s.position == NULL) || (mem == NULL)) {
+		dprintf(2, "Not enough memory\n");
+		return -1;
+	}
+	for (size_t u = 0; u < s.universe; ++u) {
+		s.hash_of[u] = not_bound;
+	}
+	void *data = mem;
+	struct rbt *rbt = rbt_init_empty(&data, &size, KEY_SIZE, KEY_SIZE, s.cells, keys);
+	if (rbt == NULL) {
+		dprintf(2, "Could not initialize the tree\n");
+		return -1;
+	}
+	printf("%zu keys, %" PRIu64 " operations, seed %" PRIu64 "\n", keys, ops, seed);
+	uint64_t start = metrics_now();
+	if (stress(rbt, &s, ops, period, &seed) != 0) {
+		return 1;
+	}
+	char duration[16];
+	metrics_format_duration(duration, sizeof(duration), metrics_now() - start);
+	printf("stress   %10" PRIu64 " ops checked in %s\n", ops, duration);
+	if (bench(rbt, &s, ops, &seed) != 0) {
+		return 1;
+	}
+	free(mem);
+	free(s.cells);
+	free(s.hash_of);
+	free(s.key_of);
+	free(s.bound);
+	free(s.position);
+	return 0;
+}
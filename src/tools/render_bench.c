@@ -0,0 +1,499 @@
+#include "../log_engine.h"
+#include "../interfaces/term/config.h"
+#include "../interfaces/term/logview.h"
+#include "../interfaces/term/status.h"
+#include "../interfaces/term/viewport.h"
+#include "../interfaces/term/window_print.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Headless benchmark of the term interface rendering.
+ * The output stream is parsed by a virtual terminal into a grid of cells,
+ * which is checked after each frame.
+ */
+
+#define BOLD "\x1b[1m"
+#define NORM "\x1b[0m"
+
+#define TIME_SIZE 8
+#define NAME_SIZE 32
+#define MARGE (TIME_SIZE + NAME_SIZE)
+
+struct vterm {
+	size_t width;
+	size_t height;
+	size_t row;
+	size_t col;
+	int state; /* 0: text, 1: after escape, 2: in control sequence */
+	char params[32];
+	size_t params_size;
+	uint32_t cp;
+	int cont;
+	uint64_t bytes;
+	uint64_t writes;
+	uint64_t overflows;
+	uint32_t *cells;
+	_Bool *touched;
+};
+
+static int vterm_resize(struct vterm *vt, size_t width, size_t height) {
+	uint32_t *cells = realloc(vt->cells, width * height * sizeof(*cells));
+	if (cells == NULL) {
+		return -1;
+	}
+	vt->cells = cells;
+	_Bool *touched = realloc(vt->touched, width * height * sizeof(*touched));
+	if (touched == NULL) {
+		return -1;
+	}
+	vt->touched = touched;
+	vt->width = width;
+	vt->height = height;
+	for (size_t i = 0; i < width * height; ++i) {
+		vt->cells[i] = ' ';
+		vt->touched[i] = 0;
+	}
+	vt->row = 0;
+	vt->col = 0;
+	return 0;
+}
+
+static void vterm_put(struct vterm *vt, uint32_t cp) {
+	if ((vt->row >= vt->height) || (vt->col >= vt->width)) {
+		++vt->overflows;
+	} else {
+		vt->cells[vt->row * vt->width + vt->col] = cp;
+		vt->touched[vt->row * vt->width + vt->col] = 1;
+	}
+	++vt->col;
+	return;
+}
+
+static void vterm_csi(struct vterm *vt, char final) {
+	vt->params[vt->params_size] = '\0';
+	if (final == 'H') {
+		unsigned long row = 1;
+		unsigned long col = 1;
+		char *end;
+		if (vt->params_size > 0) {
+			row = strtoul(vt->params, &end, 10);
+			if (*end == ';') {
+				col = strtoul(end + 1, NULL, 10);
+			}
+		}
+		vt->row = (row > 0) ? row - 1 : 0;
+		vt->col = (col > 0) ? col - 1 : 0;
+	}
+	/* Styles (m) do not change the grid, other sequences are not emitted by the term interface */
+	return;
+}
+
+static void vterm_feed(void *ctx, const char *data, size_t size) {
+	struct vterm *vt = ctx;
+	++vt->writes;
+	vt->bytes += size;
+	for (size_t i = 0; i < size; ++i) {
+		unsigned char c = data[i];
+		switch (vt->state) {
+			case 1:
+				if (c == '[') {
+					vt->state = 2;
+					vt->params_size = 0;
+				} else {
+					vt->state = 0;
+				}
+				continue;
+			case 2:
+				if ((c >= 0x30) && (c <= 0x3f)) {
+					if (vt->params_size < sizeof(vt->params) - 1) {
+						vt->params[vt->params_size] = c;
+						++vt->params_size;
+					}
+				} else {
+					vterm_csi(vt, c);
+					vt->state = 0;
+				}
+				continue;
+			default:
+				break;
+		}
+		if (c == 0x1b) {
+			vt->state = 1;
+			continue;
+		}
+		if (vt->cont > 0) {
+			vt->cp = (vt->cp << 6) | (c & 0x3f);
+			--vt->cont;
+			if (vt->cont == 0) {
+				vterm_put(vt, vt->cp);
+			}
+			continue;
+		}
+		if (c == '\r') {
+			vt->col = 0;
+		} else if (c == '\n') {
+			++vt->row;
+		} else if (c < 0x80) {
+			vterm_put(vt, c);
+		} else if ((c & 0xe0) == 0xc0) {
+			vt->cp = c & 0x1f;
+			vt->cont = 1;
+		} else if ((c & 0xf0) == 0xe0) {
+			vt->cp = c & 0x0f;
+			vt->cont = 2;
+		} else {
+			vt->cp = c & 0x07;
+			vt->cont = 3;
+		}
+	}
+	return;
+}
+
+/* UTF-8 content of a part of a grid row, with spaces trimmed on both ends */
+static size_t vterm_text(const struct vterm *vt, size_t row, size_t col, size_t width, char *text, size_t text_size) {
+	size_t start = col;
+	size_t end = col + width;
+	const uint32_t *cells = vt->cells + row * vt->width;
+	while ((start < end) && (cells[start] == ' ')) {
+		++start;
+	}
+	while ((end > start) && (cells[end - 1] == ' ')) {
+		--end;
+	}
+	size_t size = 0;
+	for (size_t i = start; (i < end) && (size + 4 < text_size); ++i) {
+		uint32_t cp = cells[i];
+		if (cp < 0x80) {
+			text[size++] = cp;
+		} else if (cp < 0x800) {
+			text[size++] = 0xc0 | (cp >> 6);
+			text[size++] = 0x80 | (cp & 0x3f);
+		} else if (cp < 0x10000) {
+			text[size++] = 0xe0 | (cp >> 12);
+			text[size++] = 0x80 | ((cp >> 6) & 0x3f);
+			text[size++] = 0x80 | (cp & 0x3f);
+		} else {
+			text[size++] = 0xf0 | (cp >> 18);
+			text[size++] = 0x80 | ((cp >> 12) & 0x3f);
+			text[size++] = 0x80 | ((cp >> 6) & 0x3f);
+			text[size++] = 0x80 | (cp & 0x3f);
+		}
+	}
+	text[size] = '\0';
+	return size;
+}
+
+struct bench {
+	struct config *cfg;
+	struct logs *lgs;
+	struct viewport *vp;
+	struct vterm vt;
+	struct term_metrics tm;
+	int logfile;
+	int reader;
+	unsigned int seed;
+	uint64_t lines_written;
+	uint64_t failures;
+};
+
+static const char * const words[] = {
+	"vends", "achète", "parchemin", "dofus", "guilde", "recrute", "niveau", "panoplie",
+	"kamas", "salut", "merci", "donjon", "Astrub", "Bonta", "Brâkmar", "élevage",
+};
+
+static const char * const names[] = {
+	"Éloïse", "Bob", "Alice", "Zorg", "Krak-Ten", "Mira", "Sadida", "Xélor", "Iop-Rôtisseur", "Ecaflip",
+};
+
+static unsigned int next_random(struct bench *b) {
+	b->seed = b->seed * 1103515245u + 12345u;
+	return (b->seed >> 16) & 0x7fff;
+}
+
+/* Append some lines to the log file, and read them */
+static int append_lines(struct bench *b, size_t count) {
+	static const char * const formats[] = {
+		"[Commerce] %s : ",
+		"[Guilde] %s : ",
+		"[Proximité] %s : ",
+		"[Recrutement] %s : ",
+		"[Privé] FROM \"%s\" : ",
+		"[Groupe] %s : ",
+	};
+	char line[1024];
+	for (size_t i = 0; i < count; ++i) {
+		uint64_t t = b->lines_written;
+		int w = snprintf(line, sizeof(line), "%02u:%02u:%02u,%03u - ", (unsigned int)((t / 3600) % 24), (unsigned int)((t / 60) % 60), (unsigned int)(t % 60), (unsigned int)(t % 1000));
+		w += snprintf(line + w, sizeof(line) - w, formats[next_random(b) % (sizeof(formats) / sizeof(formats[0]))], names[next_random(b) % (sizeof(names) / sizeof(names[0]))]);
+		size_t nwords = 1 + next_random(b) % 30;
+		for (size_t j = 0; j < nwords; ++j) {
+			w += snprintf(line + w, sizeof(line) - w, "%s%s", (j > 0) ? " " : "", words[next_random(b) % (sizeof(words) / sizeof(words[0]))]);
+		}
+		w += snprintf(line + w, sizeof(line) - w, "\r\n");
+		if (write(b->logfile, line, w) != w) {
+			return -1;
+		}
+		++b->lines_written;
+	}
+	int r = logs_refresh(b->lgs);
+	while (r == 0) {
+		r = logs_refresh(b->lgs);
+	}
+	return (r == 1) ? 0 : -1;
+}
+
+static _Bool ends_with(const char *text, size_t text_size, const char *suffix, size_t suffix_size) {
+	while ((text_size > 0) && (text[text_size - 1] == ' ')) {
+		--text_size;
+	}
+	if (suffix_size > text_size) {
+		return 0;
+	}
+	return memcmp(text + text_size - suffix_size, suffix, suffix_size) == 0;
+}
+
+/* Check the grid after a frame, returns the number of failed checks */
+static unsigned int check_frame(struct bench *b) {
+	struct vterm *vt = &b->vt;
+	size_t lines = vt->height - 2;
+	unsigned int failures = 0;
+	char grid[1024];
+	char text[1024];
+	if (vt->overflows > 0) {
+		dprintf(2, "check: %" PRIu64 " characters printed out of the terminal\n", vt->overflows);
+		++failures;
+	}
+	/* The whole log area is printed */
+	for (size_t i = 0; i < lines * vt->width; ++i) {
+		if (!vt->touched[i]) {
+			dprintf(2, "check: cell %zu:%zu not printed\n", i / vt->width + 1, i % vt->width + 1);
+			++failures;
+			break;
+		}
+	}
+	size_t total = viewport_lines(b->vp);
+	size_t next_entry = logs_get_next_entry(b->lgs);
+	/* When following, the last line is the end of the last displayed entry */
+	if (viewport_following(b->vp) && (total > 0)) {
+		size_t last = next_entry;
+		while ((last > 0) && (viewport_entry_lines(b->vp, last - 1) == 0)) {
+			--last;
+		}
+		struct entry e;
+		if ((last > 0) && (logs_get_entry(b->lgs, last - 1, &e) == 0)) {
+			size_t ts = (e.text.size > sizeof(text)) ? sizeof(text) : e.text.size;
+			logs_get_text(b->lgs, e.text.offset, ts, text);
+			size_t gs = vterm_text(vt, lines - 1, MARGE, vt->width - MARGE, grid, sizeof(grid));
+			if (!ends_with(text, ts, grid, gs)) {
+				dprintf(2, "check: last line \"%s\" does not end entry %zu \"%.*s\"\n", grid, last - 1, (int)ts, text);
+				++failures;
+			}
+		}
+	}
+	/* The first line shows the name of the source of its entry, if it is the first line of the entry */
+	size_t entry;
+	size_t line;
+	viewport_top(b->vp, &entry, &line);
+	while ((entry < next_entry) && (viewport_entry_lines(b->vp, entry) == 0)) {
+		++entry;
+	}
+	struct entry e;
+	if ((line == 0) && (entry < next_entry) && (logs_get_entry(b->lgs, entry, &e) == 0)) {
+		size_t row = (total < lines) ? lines - total : 0;
+		char name[70];
+		logs_name_source(b->lgs, e.src, name, 64);
+		strcat(name, " :");
+		vterm_text(vt, row, TIME_SIZE, NAME_SIZE, grid, sizeof(grid));
+		if (strcmp(grid, name) != 0) {
+			dprintf(2, "check: first line shows \"%s\" instead of \"%s\"\n", grid, name);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+struct scenario_stats {
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t writes;
+	uint64_t cpu_ns;
+	uint64_t wall_ns;
+	uint64_t failures;
+};
+
+static uint64_t cpu_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/* Render a frame as term_refresh does, and check the result */
+static int frame(struct bench *b, _Bool force, struct scenario_stats *st) {
+	struct vterm *vt = &b->vt;
+	for (size_t i = 0; i < vt->width * vt->height; ++i) {
+		vt->touched[i] = 0;
+	}
+	vt->overflows = 0;
+	uint64_t bytes = vt->bytes;
+	uint64_t writes = vt->writes;
+	uint64_t cpu = cpu_now();
+	uint64_t wall = metrics_now();
+	int r = log_view(b->cfg, b->lgs, b->vp, 1, vt->width, 1, vt->height - 2, force);
+	flush_ostream();
+	if (r > 0) {
+		histogram_record(&b->tm.render_ns, metrics_now() - wall);
+		++b->tm.frames;
+	}
+	status_line(b->lgs, &b->tm, vt->height, 1, vt->width);
+	flush_ostream();
+	st->wall_ns += metrics_now() - wall;
+	st->cpu_ns += cpu_now() - cpu;
+	st->bytes += vt->bytes - bytes;
+	st->writes += vt->writes - writes;
+	++st->frames;
+	if (r < 0) {
+		++st->failures;
+		return -1;
+	}
+	if (r > 0) {
+		st->failures += check_frame(b);
+	}
+	return 0;
+}
+
+static void report(const char *name, const struct scenario_stats *st) {
+	uint64_t f = (st->frames > 0) ? st->frames : 1;
+	printf("%-12s %6" PRIu64 " frames %9" PRIu64 " B/frame %6" PRIu64 ".%02" PRIu64 " writes/frame %8" PRIu64 " ns cpu/frame %8" PRIu64 " ns wall/frame  check %s\n",
+		name, st->frames, st->bytes / f, st->writes / f, (st->writes * 100 / f) % 100, st->cpu_ns / f, st->wall_ns / f, (st->failures == 0) ? "ok" : "FAILED");
+	return;
+}
+
+static void usage(const char *progname) {
+	dprintf(2, BOLD "%s" NORM " [" BOLD "-n" NORM " <entries>] [" BOLD "-w" NORM " <columns>] [" BOLD "-h" NORM " <lines>] [" BOLD "-f" NORM " <frames>]\n", progname);
+	return;
+}
+
+int main(int argc, char **argv) {
+	const char *progname = (argc > 0) ? argv[0] : "wrender";
+	size_t entries = 5000;
+	size_t width = 120;
+	size_t height = 40;
+	size_t frames = 200;
+	int c;
+	while ((c = getopt(argc, argv, "n:w:h:f:")) != -1) {
+		switch (c) {
+			case 'n':
+				entries = strtoul(optarg, NULL, 10);
+				break;
+			case 'w':
+				width = strtoul(optarg, NULL, 10);
+				break;
+			case 'h':
+				height = strtoul(optarg, NULL, 10);
+				break;
+			case 'f':
+				frames = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(progname);
+				return -1;
+		}
+	}
+	if ((width <= MARGE) || (height < 3) || (frames == 0)) {
+		usage(progname);
+		return -1;
+	}
+	if ((setlocale(LC_ALL, "C.UTF-8") == NULL) && (setlocale(LC_ALL, "en_US.utf8") == NULL)) {
+		dprintf(2, "No UTF-8 locale available\n");
+	}
+	struct bench b;
+	memset(&b, 0, sizeof(b));
+	b.seed = 42;
+	char path[] = "/tmp/wrender-XXXXXX";
+	b.logfile = mkstemp(path);
+	if (b.logfile < 0) {
+		dprintf(2, "Cannot create log file: %s\n", strerror(errno));
+		return -1;
+	}
+	b.reader = open(path, O_RDONLY);
+	unlink(path);
+	if (b.reader < 0) {
+		dprintf(2, "Cannot open log file: %s\n", strerror(errno));
+		return -1;
+	}
+	b.lgs = logs_create(b.reader, 200, 1000000, 5000);
+	b.cfg = config_create();
+	b.vp = viewport_create(logs_get_max_entries(b.lgs));
+	histogram_reset(&b.tm.render_ns);
+	histogram_reset(&b.tm.e2e_ns);
+	if ((b.lgs == NULL) || (b.cfg == NULL) || (b.vp == NULL) || (vterm_resize(&b.vt, width, height) != 0)) {
+		dprintf(2, "Not enough memory\n");
+		return -1;
+	}
+	if (append_lines(&b, entries) != 0) {
+		dprintf(2, "Cannot fill the logs\n");
+		return -1;
+	}
+	set_ostream_sink(vterm_feed, &b.vt);
+	uint64_t failures = 0;
+	struct scenario_stats st;
+
+	memset(&st, 0, sizeof(st));
+	for (size_t i = 0; i < frames; ++i) {
+		frame(&b, 1, &st);
+	}
+	report("full", &st);
+	failures += st.failures;
+
+	memset(&st, 0, sizeof(st));
+	for (size_t i = 0; i < frames; ++i) {
+		append_lines(&b, 1);
+		frame(&b, 0, &st);
+	}
+	report("new_entry", &st);
+	failures += st.failures;
+
+	memset(&st, 0, sizeof(st));
+	for (size_t i = 0; i < frames; ++i) {
+		viewport_scroll(b.vp, b.cfg, b.lgs, -1);
+		frame(&b, 1, &st);
+	}
+	report("scroll_line", &st);
+	failures += st.failures;
+
+	memset(&st, 0, sizeof(st));
+	for (size_t i = 0; i < frames; ++i) {
+		viewport_scroll_pages(b.vp, b.cfg, b.lgs, ((i / 10) % 2) ? 1 : -1);
+		frame(&b, 1, &st);
+	}
+	report("scroll_page", &st);
+	failures += st.failures;
+
+	memset(&st, 0, sizeof(st));
+	viewport_end(b.vp);
+	static const size_t sizes[][2] = { { 80, 24 }, { 120, 40 }, { 200, 60 }, { 60, 10 } };
+	for (size_t i = 0; i < frames; ++i) {
+		const size_t *s = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+		vterm_resize(&b.vt, s[0], s[1]);
+		frame(&b, 1, &st);
+	}
+	report("resize", &st);
+	failures += st.failures;
+
+	set_ostream_sink(NULL, NULL);
+	viewport_destroy(b.vp);
+	config_destroy(b.cfg);
+	logs_destroy(b.lgs);
+	close(b.reader);
+	close(b.logfile);
+	free(b.vt.cells);
+	free(b.vt.touched);
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+#include "../log_engine.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Append a recorded Wakfu log to a file, as the game would, at a configurable rate.
+ * Latency markers (see LOGS_MARKER_PREFIX) are inserted before marked lines,
+ * so that wlog can measure the latency from write to display.
+ */
+
+#define BOLD "\x1b[1m"
+#define NORM "\x1b[0m"
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns) {
+	struct timespec ts;
+	ts.tv_sec = ns / 1000000000u;
+	ts.tv_nsec = ns % 1000000000u;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+	}
+	return;
+}
+
+/* Parse "hh:mm:ss,mmm" at the start of a line, returns -1 if there is no timestamp */
+static int64_t line_time_ms(const char *line, size_t size) {
+	if ((size < 12) || (line[2] != ':') || (line[5] != ':') || (line[8] != ',')) {
+		return -1;
+	}
+	static const int digits[] = { 0, 1, 3, 4, 6, 7, 9, 10, 11 };
+	for (size_t i = 0; i < sizeof(digits) / sizeof(digits[0]); ++i) {
+		if ((line[digits[i]] < '0') || (line[digits[i]] > '9')) {
+			return -1;
+		}
+	}
+	int64_t hour = (line[0] - '0') * 10 + (line[1] - '0');
+	int64_t min = (line[3] - '0') * 10 + (line[4] - '0');
+	int64_t sec = (line[6] - '0') * 10 + (line[7] - '0');
+	int64_t milli = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+	return ((hour * 60 + min) * 60 + sec) * 1000 + milli;
+}
+
+static int full_write(int fd, const char *data, size_t size) {
+	while (size > 0) {
+		ssize_t w = write(fd, data, size);
+		if (w < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		data += w;
+		size -= w;
+	}
+	return 0;
+}
+
+static void usage(const char *progname) {
+	dprintf(2, BOLD "%s -i" NORM " <recorded log> " BOLD "-o" NORM " <log file> [" BOLD "-s" NORM " <speed>] [" BOLD "-m" NORM " <lines>]\n", progname);
+	dprintf(2, "  speed: 1 for real time (default), N for N times faster, 0 for as fast as possible\n");
+	dprintf(2, "  lines: a latency marker is inserted every <lines> lines (default 1, 0 for none)\n");
+	return;
+}
+
+int main(int argc, char **argv) {
+	const char *progname = (argc > 0) ? argv[0] : "wreplay";
+	const char *input = NULL;
+	const char *output = NULL;
+	double speed = 1;
+	unsigned long every = 1;
+	int c;
+	while ((c = getopt(argc, argv, "i:o:s:m:")) != -1) {
+		switch (c) {
+			case 'i':
+				input = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 's':
+				speed = strtod(optarg, NULL);
+				break;
+			case 'm':
+				every = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(progname);
+				return -1;
+		}
+	}
+	if ((input == NULL) || (output == NULL) || (speed < 0)) {
+		usage(progname);
+		return -1;
+	}
+	FILE *in = fopen(input, "r");
+	if (in == NULL) {
+		dprintf(2, "Cannot open %s: %s\n", input, strerror(errno));
+		return -1;
+	}
+	int out = open(output, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	if (out < 0) {
+		dprintf(2, "Cannot open %s: %s\n", output, strerror(errno));
+		fclose(in);
+		return -1;
+	}
+	char *line = NULL;
+	size_t line_alloc = 0;
+	char *frame = NULL;
+	size_t frame_alloc = 0;
+	ssize_t len;
+	uint64_t lines = 0;
+	uint64_t markers = 0;
+	uint64_t bytes = 0;
+	int64_t first_ms = -1;
+	int64_t last_ms = -1;
+	int64_t day_offset = 0;
+	uint64_t start = now_ns();
+	int res = 0;
+	while ((len = getline(&line, &line_alloc, in)) > 0) {
+		int64_t ms = line_time_ms(line, len);
+		if ((ms >= 0) && (speed > 0)) {
+			if (first_ms < 0) {
+				first_ms = ms;
+			}
+			if ((last_ms >= 0) && ((ms + day_offset) < last_ms)) {
+				/* Past midnight */
+				day_offset += 24 * 3600 * 1000;
+			}
+			last_ms = ms + day_offset;
+			sleep_until(start + (uint64_t)((last_ms - first_ms) * 1000000.0 / speed));
+		}
+		size_t needed = len + sizeof(LOGS_MARKER_PREFIX) + 48;
+		if (needed > frame_alloc) {
+			char *f = realloc(frame, needed);
+			if (f == NULL) {
+				res = -1;
+				break;
+			}
+			frame = f;
+			frame_alloc = needed;
+		}
+		size_t fsize = 0;
+		if ((every > 0) && ((lines % every) == 0)) {
+			fsize = sprintf(frame, LOGS_MARKER_PREFIX "%" PRIu64 " %" PRIu64 "\n", markers, now_ns());
+			++markers;
+		}
+		memcpy(frame + fsize, line, len);
+		fsize += len;
+		/* Marker and line in a single write, so that they are read together */
+		if (full_write(out, frame, fsize) != 0) {
+			dprintf(2, "Cannot write to %s: %s\n", output, strerror(errno));
+			res = -1;
+			break;
+		}
+		bytes += fsize;
+		++lines;
+	}
+	uint64_t elapsed = now_ns() - start;
+	dprintf(2, "%" PRIu64 " lines (%" PRIu64 " markers, %" PRIu64 " bytes) in %" PRIu64 ".%03" PRIu64 "s", lines, markers, bytes, elapsed / 1000000000u, (elapsed / 1000000u) % 1000);
+	if (elapsed > 0) {
+		dprintf(2, ", %.0f lines/s", lines * 1e9 / elapsed);
+	}
+	dprintf(2, "\n");
+	free(frame);
+	free(line);
+	close(out);
+	fclose(in);
+	return res;
+}
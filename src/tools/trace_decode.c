@@ -0,0 +1,83 @@
+#include "../trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Decode a trace ring dumped by wlog (built with make TRACE=1) */
+
+static int cmp_records(const void *a, const void *b) {
+	const struct trace_record *ra = a;
+	const struct trace_record *rb = b;
+	return (ra->seq > rb->seq) - (ra->seq < rb->seq);
+}
+
+static int read_all(int fd, void *data, size_t size) {
+	char *d = data;
+	while (size > 0) {
+		ssize_t rd = read(fd, d, size);
+		if (rd <= 0) {
+			return -1;
+		}
+		d += rd;
+		size -= rd;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		dprintf(2, "%s <trace file>\n", (argc > 0) ? argv[0] : "wtrace");
+		return -1;
+	}
+	int fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
+		dprintf(2, "Cannot open %s: %s\n", argv[1], strerror(errno));
+		return -1;
+	}
+	struct trace_header hdr;
+	if (read_all(fd, &hdr, sizeof(hdr)) != 0) {
+		dprintf(2, "Truncated header\n");
+		close(fd);
+		return -1;
+	}
+	if ((hdr.magic != TRACE_MAGIC) || (hdr.version != TRACE_VERSION) || (hdr.record_size != sizeof(struct trace_record))) {
+		dprintf(2, "Not a supported trace file\n");
+		close(fd);
+		return -1;
+	}
+	struct trace_record *recs = malloc(hdr.records * sizeof(*recs));
+	if (recs == NULL) {
+		close(fd);
+		return -1;
+	}
+	if (read_all(fd, recs, hdr.records * sizeof(*recs)) != 0) {
+		dprintf(2, "Truncated trace\n");
+		free(recs);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	/* Keep only fully written records from the last lap of the ring */
+	size_t used = 0;
+	for (size_t i = 0; i < hdr.records; ++i) {
+		uint64_t seq = recs[i].seq;
+		if ((seq == 0) || (seq > hdr.head) || ((seq - 1) % hdr.records != i) || ((hdr.head - seq) >= hdr.records)) {
+			continue;
+		}
+		recs[used] = recs[i];
+		++used;
+	}
+	qsort(recs, used, sizeof(*recs), cmp_records);
+	uint64_t start = (used > 0) ? recs[0].time : 0;
+	printf("# %zu events, %" PRIu64 " recorded, %" PRIu64 " lost\n", used, hdr.head, hdr.head - used);
+	for (size_t i = 0; i < used; ++i) {
+		uint64_t t = recs[i].time - start;
+		printf("%" PRIu64 " %" PRIu64 ".%09" PRIu64 " %s %" PRIu64 " %" PRIu64 "\n", recs[i].seq - 1, t / 1000000000u, t % 1000000000u, trace_event_name(recs[i].event), recs[i].args[0], recs[i].args[1]);
+	}
+	free(recs);
+	return 0;
+}
@@ -0,0 +1,111 @@
+#include "trace.h"
+
+static const char * const event_names[trace_events] = {
+	[trace_none         ] = "none",
+	[trace_refresh      ] = "refresh",
+	[trace_entry_added  ] = "entry_added",
+	[trace_entry_dropped] = "entry_dropped",
+	[trace_view_start   ] = "view_start",
+	[trace_view_entry   ] = "view_entry",
+	[trace_view_end     ] = "view_end",
+	[trace_key_unknown  ] = "key_unknown",
+	[trace_key_error    ] = "key_error",
+};
+
+const char *trace_event_name(uint32_t event) {
+	if (event >= trace_events) {
+		return "invalid";
+	}
+	return event_names[event];
+}
+
+#ifdef WLOG_TRACE
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Must be a power of 2 */
+#define TRACE_RECORDS (1u << 16)
+
+static struct trace_record ring[TRACE_RECORDS];
+static _Atomic uint64_t head = 0;
+static const char *dump_path = NULL;
+
+void trace_record(enum trace_event event, uint64_t a, uint64_t b) {
+	struct timespec ts;
+	uint64_t pos = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+	struct trace_record *rec = ring + (pos & (TRACE_RECORDS - 1));
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	/* Mark the record as being written, the decoder drops records whose seq does not match */
+	__atomic_store_n(&rec->seq, 0, __ATOMIC_RELAXED);
+	atomic_thread_fence(memory_order_release);
+	rec->time = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+	rec->event = event;
+	rec->pad = 0;
+	rec->args[0] = a;
+	rec->args[1] = b;
+	__atomic_store_n(&rec->seq, pos + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+static void full_write(int fd, const void *data, size_t size) {
+	const char *d = data;
+	while (size > 0) {
+		ssize_t w = write(fd, d, size);
+		if (w <= 0) {
+			return;
+		}
+		d += w;
+		size -= w;
+	}
+	return;
+}
+
+void trace_dump(void) {
+	if (dump_path == NULL) {
+		return;
+	}
+	int fd = open(dump_path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		return;
+	}
+	struct trace_header hdr = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.record_size = sizeof(struct trace_record),
+		.records = TRACE_RECORDS,
+		.head = atomic_load_explicit(&head, memory_order_acquire),
+	};
+	full_write(fd, &hdr, sizeof(hdr));
+	full_write(fd, ring, sizeof(ring));
+	close(fd);
+	return;
+}
+
+static void trace_signal_handler(int signo) {
+	(void)signo;
+	trace_dump();
+	return;
+}
+
+int trace_init(const char *path, int signo) {
+	if (path == NULL) {
+		return -1;
+	}
+	dump_path = path;
+	struct sigaction sa;
+	sa.sa_handler = trace_signal_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(signo, &sa, NULL) != 0) {
+		return -1;
+	}
+	atexit(trace_dump);
+	return 0;
+}
+
+#endif /* WLOG_TRACE */
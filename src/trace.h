@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Tracing records fixed size binary events in an in-memory ring,
+ * it is only compiled in when WLOG_TRACE is defined (make TRACE=1),
+ * otherwise TRACE() expands to nothing and its arguments are not evaluated.
+ *
+ * The ring is dumped to a file on exit or on signal, use wtrace to decode it.
+ */
+
+enum trace_event {
+	trace_none,
+	trace_refresh,        /* a: bytes read, b: next entry */
+	trace_entry_added,    /* a: entry index, b: text size */
+	trace_entry_dropped,  /* a: line size, b: errno */
+	trace_view_start,     /* a: top entry, b: total lines */
+	trace_view_entry,     /* a: entry index, b: displayed lines */
+	trace_view_end,       /* a: next entry, b: first cleared line */
+	trace_key_unknown,    /* a: key code, b: key modifiers */
+	trace_key_error,      /* a: input offset, b: input size */
+	trace_events,
+};
+
+#define TRACE_MAGIC 0x52544c57u /* "WLTR" */
+#define TRACE_VERSION 1u
+
+struct trace_record {
+	uint64_t seq;  /* position in the ring + 1, 0 if never written */
+	uint64_t time; /* CLOCK_MONOTONIC in nanoseconds */
+	uint32_t event;
+	uint32_t pad;
+	uint64_t args[2];
+};
+
+/* Dump file: a header followed by [records] records, not sorted */
+struct trace_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t records;
+	uint64_t head;
+};
+
+/* Name of an event, for decoding */
+const char *trace_event_name(uint32_t event);
+
+#ifdef WLOG_TRACE
+
+void trace_record(enum trace_event event, uint64_t a, uint64_t b);
+
+/* Dump the ring to [path] on exit and whenever [signo] is received, returns 0 on success, -1 on failure */
+int trace_init(const char *path, int signo);
+
+/* Dump the ring, this is async-signal-safe */
+void trace_dump(void);
+
+#define TRACE(event, a, b) trace_record((event), (uint64_t)(a), (uint64_t)(b))
+#define TRACE_INIT(path, signo) trace_init((path), (signo))
+
+#else
+
+#define TRACE(event, a, b) do { } while (0)
+#define TRACE_INIT(path, signo) 0
+
+#endif /* WLOG_TRACE */
+
+#endif /* TRACE_H */
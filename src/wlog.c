@@ -1,13 +1,57 @@
+#include "dispatch.h"
 #include "interface.h"
+#include "trace.h"
 #include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <fcntl.h>
+#include <signal.h>
 
 #define BOLD "\x1b[1m"
 #define NORM "\x1b[0m"
 
+/* Minimum delay between periodic snapshots (see -r) */
+#define SNAPSHOT_PERIOD_NS (60 * 1000000000ull)
+
+static volatile sig_atomic_t metrics_requested = 0;
+
+static volatile sig_atomic_t quit_requested = 0;
+
+static void metrics_handler(int signo) {
+	(void)signo;
+	metrics_requested = 1;
+	return;
+}
+
+/* Leave cleanly, so that a shared memory object is removed */
+static void quit_handler(int signo) {
+	(void)signo;
+	quit_requested = 1;
+	return;
+}
+
+/* Append all metrics to the "metrics" file, an empty line ends each dump */
+static void dump_metrics(struct logs *lgs, struct dispatcher *disp, struct interface *siface, struct iface_state *istate) {
+	int fd = open("metrics", O_CREAT | O_WRONLY | O_APPEND, 0644);
+	if (fd < 0) {
+		return;
+	}
+	metrics_dump_counter(fd, "wlog", "time_ns", metrics_now());
+	logs_dump_metrics(lgs, fd);
+	if (disp != NULL) {
+		dispatcher_dump_metrics(disp, fd);
+	}
+	if (siface->dump_metrics != NULL) {
+		siface->dump_metrics(istate, fd);
+	}
+	dprintf(fd, "\n");
+	close(fd);
+	return;
+}
+
 int main(int argc, char **argv) {
 	char c;
 	_Bool help_set = 0;
@@ -15,7 +59,12 @@ int main(int argc, char **argv) {
 	_Bool log_set = 0;
 	char *iface = "";
 	char *lpath = "";
-	char *opts = "i:l:";
+	long import = -1;
+	char *share = NULL;
+	char *attach = NULL;
+	char *snapshot = NULL;
+	char *archive = NULL;
+	char *opts = "i:l:j:s:a:r:d:";
 	c = getopt(argc, argv, opts);
 	while (c != -1) {
 		switch (c) {
@@ -33,6 +82,24 @@ int main(int argc, char **argv) {
 				log_set = 1;
 				lpath = optarg;
 				break;
+			case 'j':
+				import = strtol(optarg, NULL, 10);
+				if (import < 0) {
+					help_set = 1;
+				}
+				break;
+			case 's':
+				share = optarg;
+				break;
+			case 'a':
+				attach = optarg;
+				break;
+			case 'r':
+				snapshot = optarg;
+				break;
+			case 'd':
+				archive = optarg;
+				break;
 			default:
 				help_set = 1;
 		}
@@ -60,9 +127,14 @@ int main(int argc, char **argv) {
 			dprintf(2, "Selected interface %zu (%s)\n", iface_idx, siface.name);
 		}
 	}
-	int log;
+	int log = -1;
 	if (!help_set) {
-		if (!log_set) {
+		if (attach != NULL) {
+			/* The attached process reads the log file */
+			if (log_set || (share != NULL) || (import >= 0) || (snapshot != NULL) || (archive != NULL)) {
+				help_set = 1;
+			}
+		} else if (!log_set) {
 			help_set = 1;
 		} else {
 			log = open(lpath, O_RDWR);
@@ -73,7 +145,12 @@ int main(int argc, char **argv) {
 	}
 	if (help_set) {
 		char *progname = (argc > 0) ? argv[0] : "wlog";
-		dprintf(2, BOLD "%s -i" NORM " <interface> " BOLD "-l" NORM " <logfile>\n", progname);
+		dprintf(2, BOLD "%s -i" NORM " <interface> " BOLD "-l" NORM " <logfile> [" BOLD "-j" NORM " <threads>] [" BOLD "-s" NORM " <name>] [" BOLD "-r" NORM " <snapshot>] [" BOLD "-d" NORM " <archive>]\n", progname);
+		dprintf(2, BOLD "%s -i" NORM " <interface> " BOLD "-a" NORM " <name>\n", progname);
+		dprintf(2, "  threads: import the existing logs with this many threads (0 for one per CPU) before following the file\n");
+		dprintf(2, "  name: shared memory object (eg. /wlog) holding the logs, created by -s and read by any number of -a\n");
+		dprintf(2, "  snapshot: file the logs are restored from on start, and saved to periodically and on exit\n");
+		dprintf(2, "  archive: directory where the logs evicted from memory are kept\n");
 		dprintf(2, "List of available interfaces:\n");
 		size_t ifaces = supported_interfaces();
 		for (size_t iface_idx = 0; iface_idx < ifaces; ++iface_idx) {
@@ -82,12 +159,57 @@ int main(int argc, char **argv) {
 		}
 		return -1;
 	}
-	struct logs *lgs = logs_create(log, 200, 1000000, 5000);
+	if (TRACE_INIT("trace", SIGUSR2) != 0) {
+		dprintf(2, "Could not set up tracing\n");
+	}
+	struct sigaction sa;
+	sa.sa_handler = metrics_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = 0;
+	if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+		dprintf(2, "Could not set up metrics dump on SIGUSR1\n");
+	}
+	sa.sa_handler = quit_handler;
+	if ((sigaction(SIGTERM, &sa, NULL) != 0) || (sigaction(SIGINT, &sa, NULL) != 0) || (sigaction(SIGHUP, &sa, NULL) != 0)) {
+		dprintf(2, "Could not set up termination signals\n");
+	}
+	struct logs *lgs;
+	if (attach != NULL) {
+		lgs = logs_attach(attach);
+	} else if (share != NULL) {
+		lgs = logs_create_shared(share, log, 200, 1000000, 32768);
+	} else {
+		lgs = logs_create(log, 200, 1000000, 32768);
+	}
 	if (lgs == NULL) {
-		dprintf(2, "Could not create logs structure, aborting\n");
+		dprintf(2, "Could not create logs structure (%s), aborting\n", strerror(errno));
 		close(log);
 		return -1;
 	}
+	if ((attach == NULL) && (logs_follow(lgs, lpath) != 0)) {
+		dprintf(2, "Could not follow %s: %s\n", lpath, strerror(errno));
+	}
+	if (snapshot != NULL) {
+		uint64_t start = metrics_now();
+		if (logs_restore(lgs, snapshot) == 0) {
+			uint64_t elapsed = metrics_now() - start;
+			dprintf(2, "Restored %zu entries from %s in %" PRIu64 "ms\n", logs_get_used_entries(lgs), snapshot, elapsed / 1000000);
+		} else if (errno != ENOENT) {
+			dprintf(2, "Could not restore %s (%s), reading the logs from the start\n", snapshot, strerror(errno));
+		}
+	}
+	if ((archive != NULL) && (logs_archive(lgs, archive) != 0)) {
+		dprintf(2, "Could not open the archive %s: %s\n", archive, strerror(errno));
+	}
+	if (import >= 0) {
+		uint64_t start = metrics_now();
+		if (logs_import(lgs, import) != 0) {
+			dprintf(2, "Could not import logs: %s\n", strerror(errno));
+		} else {
+			uint64_t elapsed = metrics_now() - start;
+			dprintf(2, "Imported %" PRIu64 " entries in %" PRIu64 "ms\n", logs_get_metrics(lgs)->entries_added, elapsed / 1000000);
+		}
+	}
 	struct iface_state *istate = siface.init();
 	if (istate == NULL) {
 		dprintf(2, "Could not create interface state, aborting\n");
@@ -95,22 +217,60 @@ int main(int argc, char **argv) {
 		close(log);
 		return -1;
 	}
-	int cont = siface.refresh(istate, lgs);
+	struct dispatcher *disp = NULL;
+	if (siface.on_entries != NULL) {
+		disp = dispatcher_create();
+		if (disp == NULL) {
+			dprintf(2, "Could not create entries dispatcher, aborting\n");
+			siface.release(istate);
+			logs_destroy(lgs);
+			close(log);
+			return -1;
+		}
+	}
+	if (logs_start(lgs) != 0) {
+		dprintf(2, "Could not start reading logs, aborting\n");
+		dispatcher_destroy(disp);
+		siface.release(istate);
+		logs_destroy(lgs);
+		close(log);
+		return -1;
+	}
+	uint64_t snapshot_ns = metrics_now();
+	size_t snapshot_entry = logs_get_next_entry(lgs);
+	int cont = 1;
 	while (cont == 1) {
-		int r = logs_refresh(lgs);
-		while (r == 0) {
-			r = logs_refresh(lgs);
+		if (disp != NULL) {
+			dispatch(disp, lgs, &siface, istate);
 		}
-		if (r == 1) {
-			cont = siface.refresh(istate, lgs);
-		} else {
-			dprintf(2, "Could not refresh logs\n");
+		cont = siface.refresh(istate, lgs);
+		if (metrics_requested) {
+			metrics_requested = 0;
+			dump_metrics(lgs, disp, &siface, istate);
+		}
+		if ((cont == 1) && (quit_requested || !logs_running(lgs))) {
 			cont = 0;
 		}
+		if ((snapshot != NULL) && ((metrics_now() - snapshot_ns) >= SNAPSHOT_PERIOD_NS) && (logs_get_next_entry(lgs) != snapshot_entry)) {
+			snapshot_ns = metrics_now();
+			snapshot_entry = logs_get_next_entry(lgs);
+			if (logs_snapshot(lgs, snapshot) != 0) {
+				dprintf(2, "Could not save %s: %s\n", snapshot, strerror(errno));
+			}
+		}
+	}
+	if (logs_stop(lgs) != 0) {
+		dprintf(2, "Could not refresh logs: %s\n", strerror(errno));
+	}
+	if ((snapshot != NULL) && (logs_snapshot(lgs, snapshot) != 0)) {
+		dprintf(2, "Could not save %s: %s\n", snapshot, strerror(errno));
 	}
+	dispatcher_destroy(disp);
 	siface.release(istate);
 	logs_destroy(lgs);
-	close(log);
+	if (log >= 0) {
+		close(log);
+	}
 	return cont ? -1 : 0;
 }
 